@@ -0,0 +1,259 @@
+/**
+ * @file corpus.c
+ * @brief Synthetic Decaf corpus generator for the benchmarks
+ */
+#include "corpus.h"
+
+const CorpusMix corpus_presets[] = {
+    /*                 id  kw dec hex str cmt sym blank */
+    { "default",     { 30, 10,  6,  3,  4,  5, 34,  8 } },
+    { "identifiers", { 70,  5,  2,  1,  1,  1, 15,  5 } },
+    { "comments",    { 15,  5,  2,  1,  1, 50, 16, 10 } },
+    { "whitespace",  { 20,  5,  3,  1,  1,  5, 20, 45 } },
+    { "strings",     { 15,  5,  2,  1, 50,  2, 20,  5 } },
+    { "literals",    { 10,  5, 35, 25,  2,  2, 16,  5 } },
+    { NULL,          {  0,  0,  0,  0,  0,  0,  0,  0 } }
+};
+
+/**
+ * @brief Specification keys, in @ref CorpusItem order
+ */
+static const char* item_keys[CORPUS_ITEM_COUNT] = {
+    "id", "kw", "dec", "hex", "str", "comment", "sym", "blank"
+};
+
+static const char* keywords[] = {
+    "def", "if", "else", "while", "return", "break", "continue",
+    "int", "bool", "void", "true", "false"
+};
+
+static const char* reserved[] = {
+    "for", "callout", "class", "interface", "extends", "implements",
+    "new", "this", "string", "float", "double", "null"
+};
+
+static const char* symbols[] = {
+    "+", "-", "*", "/", "%", "<", ">", "<=", ">=", "==", "!=", "=", "!",
+    "&&", "||", "(", ")", "{", "}", "[", "]", ",", ";"
+};
+
+#define COUNT_OF(A) (sizeof(A) / sizeof((A)[0]))
+
+/**
+ * @brief Corpus under construction
+ */
+typedef struct Corpus
+{
+    char* text;             /**< @brief Text so far */
+    size_t length;          /**< @brief Length of the text */
+    size_t capacity;        /**< @brief Allocated size of @c text */
+    size_t column;          /**< @brief Characters since the last newline */
+    uint32_t state;         /**< @brief Random number generator state */
+} Corpus;
+
+/**
+ * @brief Next pseudo-random number (xorshift32, so output does not depend on
+ * the C library)
+ */
+static uint32_t next_random (Corpus* corpus)
+{
+    uint32_t x = corpus->state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    corpus->state = x;
+    return x;
+}
+
+/**
+ * @brief Random number in <tt>[0, n)</tt>
+ */
+static uint32_t random_below (Corpus* corpus, uint32_t n)
+{
+    return next_random(corpus) % n;
+}
+
+static void put_char (Corpus* corpus, char c)
+{
+    if (corpus->length + 1 >= corpus->capacity) {
+        corpus->capacity *= 2;
+        corpus->text = (char*)realloc(corpus->text, corpus->capacity);
+        CHECK_MALLOC_PTR(corpus->text)
+    }
+    corpus->text[corpus->length++] = c;
+    corpus->column = (c == '\n' ? 0 : corpus->column + 1);
+}
+
+static void put_string (Corpus* corpus, const char* text)
+{
+    while (*text != '\0') {
+        put_char(corpus, *text++);
+    }
+}
+
+static void put_random_chars (Corpus* corpus, const char* alphabet, size_t count)
+{
+    size_t n = strlen(alphabet);
+    for (size_t i = 0; i < count; i++) {
+        put_char(corpus, alphabet[random_below(corpus, (uint32_t)n)]);
+    }
+}
+
+static void put_identifier (Corpus* corpus)
+{
+    size_t start = corpus->length;
+    put_random_chars(corpus, "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ", 1);
+    put_random_chars(corpus, "abcdefghijklmnopqrstuvwxyz_0123456789",
+            random_below(corpus, 12));
+
+    /* an identifier that happens to be a word is made longer */
+    size_t length = corpus->length - start;
+    for (size_t i = 0; i < COUNT_OF(reserved); i++) {
+        if (strlen(reserved[i]) == length &&
+                memcmp(corpus->text + start, reserved[i], length) == 0) {
+            put_char(corpus, 'x');
+        }
+    }
+    for (size_t i = 0; i < COUNT_OF(keywords); i++) {
+        if (strlen(keywords[i]) == length &&
+                memcmp(corpus->text + start, keywords[i], length) == 0) {
+            put_char(corpus, 'x');
+        }
+    }
+}
+
+static void put_string_literal (Corpus* corpus)
+{
+    static const char* escapes[] = { "\\n", "\\t", "\\\"", "\\\\" };
+    put_char(corpus, '"');
+    size_t count = 1 + random_below(corpus, 24);
+    for (size_t i = 0; i < count; i++) {
+        if (i + 1 < count && random_below(corpus, 12) == 0) {
+            put_string(corpus, escapes[random_below(corpus, COUNT_OF(escapes))]);
+        } else {
+            put_random_chars(corpus,
+                    "abcdefghijklmnopqrstuvwxyzABCDEFGHIJ0123456789     _:#", 1);
+        }
+    }
+    put_char(corpus, '"');
+}
+
+static void put_blank (Corpus* corpus)
+{
+    if (random_below(corpus, 3) == 0) {
+        /* blank lines and indentation */
+        size_t lines = 1 + random_below(corpus, 2);
+        for (size_t i = 0; i < lines; i++) {
+            put_char(corpus, '\n');
+        }
+        put_random_chars(corpus, "\t", 1 + random_below(corpus, 4));
+    } else {
+        put_random_chars(corpus, "  \t", 1 + random_below(corpus, 8));
+    }
+}
+
+bool CorpusMix_parse (const char* spec, CorpusMix* mix)
+{
+    for (const CorpusMix* preset = corpus_presets; preset->name != NULL; preset++) {
+        if (strcmp(spec, preset->name) == 0) {
+            *mix = *preset;
+            return true;
+        }
+    }
+
+    memset(mix, 0, sizeof(*mix));
+    mix->name = spec;
+    unsigned int total = 0;
+    const char* p = spec;
+    while (*p != '\0') {
+        size_t key_len = strcspn(p, "=");
+        int item = -1;
+        for (int i = 0; i < CORPUS_ITEM_COUNT; i++) {
+            if (strlen(item_keys[i]) == key_len && strncmp(p, item_keys[i], key_len) == 0) {
+                item = i;
+            }
+        }
+        if (item < 0 || p[key_len] != '=') {
+            return false;
+        }
+        char* end;
+        unsigned long weight = strtoul(p + key_len + 1, &end, 10);
+        if (end == p + key_len + 1 || (*end != ',' && *end != '\0') || weight > 1000) {
+            return false;
+        }
+        mix->weights[item] = (unsigned int)weight;
+        total += (unsigned int)weight;
+        p = (*end == ',' ? end + 1 : end);
+    }
+    return total > 0;
+}
+
+char* Corpus_generate (const CorpusMix* mix, size_t size, unsigned int seed,
+        size_t* length)
+{
+    Corpus corpus = { NULL, 0, size + 256, 0, seed * 2654435761u + 1 };
+    corpus.text = (char*)malloc(corpus.capacity);
+    CHECK_MALLOC_PTR(corpus.text)
+
+    unsigned int total = 0;
+    for (int i = 0; i < CORPUS_ITEM_COUNT; i++) {
+        total += mix->weights[i];
+    }
+
+    bool last_word = false;         /* last item would merge with a word */
+    bool last_symbol = false;       /* last item would merge with a symbol */
+    while (corpus.length < size) {
+        uint32_t pick = random_below(&corpus, total);
+        int item = 0;
+        while (pick >= mix->weights[item]) {
+            pick -= mix->weights[item++];
+        }
+
+        bool word = (item <= CORPUS_HEX);
+        bool symbol = (item == CORPUS_SYMBOL || item == CORPUS_COMMENT);
+        if ((word && last_word) || (symbol && last_symbol)) {
+            put_char(&corpus, corpus.column > 72 ? '\n' : ' ');
+        } else if (corpus.column > 100 && item != CORPUS_BLANK) {
+            put_char(&corpus, '\n');
+        }
+
+        switch ((CorpusItem)item) {
+            case CORPUS_IDENTIFIER:
+                put_identifier(&corpus);
+                break;
+            case CORPUS_KEYWORD:
+                put_string(&corpus, keywords[random_below(&corpus, COUNT_OF(keywords))]);
+                break;
+            case CORPUS_DECIMAL:
+                put_random_chars(&corpus, "123456789", 1);
+                put_random_chars(&corpus, "0123456789", random_below(&corpus, 6));
+                break;
+            case CORPUS_HEX:
+                put_string(&corpus, "0x");
+                put_random_chars(&corpus, "0123456789abcdef", 1 + random_below(&corpus, 8));
+                break;
+            case CORPUS_STRING:
+                put_string_literal(&corpus);
+                break;
+            case CORPUS_COMMENT:
+                put_string(&corpus, "// ");
+                put_random_chars(&corpus, "abcdefghijklmnopqrstuvwxyz    ,.;()",
+                        10 + random_below(&corpus, 50));
+                put_char(&corpus, '\n');
+                break;
+            case CORPUS_SYMBOL:
+                put_string(&corpus, symbols[random_below(&corpus, COUNT_OF(symbols))]);
+                break;
+            case CORPUS_BLANK:
+            case CORPUS_ITEM_COUNT:
+                put_blank(&corpus);
+                break;
+        }
+        last_word = word;
+        last_symbol = (item == CORPUS_SYMBOL);
+    }
+
+    corpus.text[corpus.length] = '\0';
+    *length = corpus.length;
+    return corpus.text;
+}
@@ -0,0 +1,78 @@
+/**
+ * @file corpus.h
+ * @brief Synthetic Decaf corpus generator for the benchmarks
+ *
+ * Generates lexically valid Decaf text with a chosen mix of lexeme kinds, so
+ * that the benchmarks can stress one part of the lexer at a time (e.g., a
+ * comment-heavy or indentation-heavy corpus). Output only depends on the mix,
+ * size, and seed, so runs are reproducible across machines.
+ */
+
+#ifndef __CORPUS_H
+#define __CORPUS_H
+
+#include "common.h"
+
+/**
+ * @brief Kinds of items the generator can emit
+ *
+ * May be any of the following:
+ *
+ * <ul>
+ * <li> @c CORPUS_IDENTIFIER - identifier (never a keyword or reserved word) </li>
+ * <li> @c CORPUS_KEYWORD - keyword </li>
+ * <li> @c CORPUS_DECIMAL - decimal literal </li>
+ * <li> @c CORPUS_HEX - hexadecimal literal </li>
+ * <li> @c CORPUS_STRING - string literal (sometimes with escapes) </li>
+ * <li> @c CORPUS_COMMENT - line comment </li>
+ * <li> @c CORPUS_SYMBOL - operator or punctuation </li>
+ * <li> @c CORPUS_BLANK - run of spaces and tabs, or blank lines and
+ *      indentation </li>
+ * </ul>
+ */
+typedef enum CorpusItem {
+    CORPUS_IDENTIFIER, CORPUS_KEYWORD, CORPUS_DECIMAL, CORPUS_HEX,
+    CORPUS_STRING, CORPUS_COMMENT, CORPUS_SYMBOL, CORPUS_BLANK,
+    CORPUS_ITEM_COUNT
+} CorpusItem;
+
+/**
+ * @brief Relative frequency of each kind of item
+ */
+typedef struct CorpusMix
+{
+    const char* name;                       /**< @brief Name for reports */
+    unsigned int weights[CORPUS_ITEM_COUNT];  /**< @brief Weight of each item */
+} CorpusMix;
+
+/**
+ * @brief Built-in mixes (terminated by an entry with a @c NULL name)
+ */
+extern const CorpusMix corpus_presets[];
+
+/**
+ * @brief Parse a mix from a preset name or a specification
+ *
+ * A specification lists weights as comma-separated <tt>key=weight</tt> pairs,
+ * with keys @c id, @c kw, @c dec, @c hex, @c str, @c comment, @c sym, and
+ * @c blank (missing keys get weight zero), e.g. <tt>id=40,sym=40,blank=20</tt>.
+ *
+ * @param spec Preset name or specification (kept as the mix name)
+ * @param mix Output: parsed mix
+ * @returns True if and only if the specification is valid
+ */
+bool CorpusMix_parse (const char* spec, CorpusMix* mix);
+
+/**
+ * @brief Generate a corpus
+ *
+ * @param mix Mix of items to generate
+ * @param size Approximate size of the corpus (in bytes)
+ * @param seed Random seed
+ * @param length Output: actual size of the corpus
+ * @returns Newly-allocated, NUL-terminated corpus text
+ */
+char* Corpus_generate (const CorpusMix* mix, size_t size, unsigned int seed,
+        size_t* length);
+
+#endif
@@ -0,0 +1,45 @@
+/**
+ * @file gencorpus.c
+ * @brief Write a synthetic Decaf corpus to standard output
+ *
+ * Useful for feeding the same inputs as @c lexperf to @c decaf itself, e.g.:
+ *
+ *     ./gencorpus -s 4096 -m comments > comments.decaf
+ */
+
+#include "corpus.h"
+
+static void usage (const char* name)
+{
+    fprintf(stderr, "Usage: %s [-s <KiB>] [-r <seed>] [-m <mix>]\n", name);
+}
+
+int main (int argc, char** argv)
+{
+    size_t size = 1024 * 1024;
+    unsigned int seed = 1;
+    CorpusMix mix = corpus_presets[0];
+
+    for (int i = 1; i < argc; i++) {
+        bool has_value = (i + 1 < argc);
+        if (strcmp(argv[i], "-s") == 0 && has_value) {
+            size = (size_t)strtoul(argv[++i], NULL, 10) * 1024;
+        } else if (strcmp(argv[i], "-r") == 0 && has_value) {
+            seed = (unsigned int)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-m") == 0 && has_value) {
+            if (!CorpusMix_parse(argv[++i], &mix)) {
+                fprintf(stderr, "Invalid mix: %s\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+        } else {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    size_t length;
+    char* text = Corpus_generate(&mix, size, seed, &length);
+    fwrite(text, 1, length, stdout);
+    free(text);
+    return EXIT_SUCCESS;
+}
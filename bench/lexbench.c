@@ -0,0 +1,302 @@
+/**
+ * @file lexbench.c
+ * @brief Lexer benchmarks
+ *
+ * Measures the per-call cost of lexing small Decaf programs, comparing a lexer
+ * that is compiled for every call (the original behavior of @c lex) against a
+ * single shared @ref Lexer, the throughput of each lexer engine on a large
+ * generated program, how the DFA engine scales when a single (even larger)
+ * program is split across 1 to N threads, and how long it takes a
+ * @ref LexCursor to produce the first token of that program.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <time.h>
+
+#include "cursor.h"
+#include "p1-lexer.h"
+#include "simd.h"
+#include "threadpool.h"
+
+/**
+ * @brief Data structure used by @c setjmp / @c longjmp for exception handling
+ */
+jmp_buf decaf_error;
+
+/**
+ * @brief Abort the benchmark (none of the benchmark inputs should fail)
+ */
+void Error_throw_printf (const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+    longjmp(decaf_error, 1);
+}
+
+/**
+ * @brief Small Decaf program used as the benchmark input
+ */
+static char small_program[] =
+    "def int main()\n"
+    "{\n"
+    "\tint a;\n"
+    "\ta = 4 + 5;\n"
+    "\treturn a;\n"
+    "}\n";
+
+/**
+ * @brief Program fragment that is repeated to build the large benchmark input
+ *
+ * Exercises every token class (including the tricky cases for the DFA).
+ */
+static const char large_fragment[] =
+    "// compute something moderately interesting\n"
+    "def int fib(int n)\n"
+    "{\n"
+    "    int a; int b; int tmp;\n"
+    "    a = 0; b = 1;\n"
+    "    while (n > 0 && a <= 0x7fffffff || !done) {\n"
+    "        tmp = a + b * 10 - 3 % 2 / 1;\n"
+    "        a = b; b = tmp; n = n - 1;\n"
+    "        if (a != b) { print_str(\"a\\\" is not b\\n\"); }\n"
+    "    }\n"
+    "    return a >= b == true;\n"
+    "}\n";
+
+/**
+ * @brief Current time in seconds (monotonic clock)
+ */
+static double now ()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Lex the input repeatedly, compiling a new lexer for every call
+ *
+ * @param iterations Number of times to lex the input
+ * @returns Elapsed time in seconds
+ */
+static double bench_compile_per_call (int iterations)
+{
+    double start = now();
+    for (int i = 0; i < iterations; i++) {
+        Lexer* lexer = Lexer_new(LEXER_REGEX);
+        TokenQueue_free(Lexer_lex(lexer, small_program));
+        Lexer_free(lexer);
+    }
+    return now() - start;
+}
+
+/**
+ * @brief Lex the input repeatedly using a single shared lexer
+ *
+ * @param iterations Number of times to lex the input
+ * @returns Elapsed time in seconds
+ */
+static double bench_shared_lexer (int iterations)
+{
+    double start = now();
+    Lexer* lexer = Lexer_new(LEXER_REGEX);
+    for (int i = 0; i < iterations; i++) {
+        TokenQueue_free(Lexer_lex(lexer, small_program));
+    }
+    Lexer_free(lexer);
+    return now() - start;
+}
+
+/**
+ * @brief Build a large program by repeating @ref large_fragment
+ *
+ * @param size Approximate size of the program (in bytes)
+ * @returns Newly-allocated, NUL-terminated program text
+ */
+static char* make_large_program (size_t size)
+{
+    size_t frag_len = strlen(large_fragment);
+    size_t copies = size / frag_len + 1;
+    char* text = (char*)malloc(copies * frag_len + 1);
+    CHECK_MALLOC_PTR(text)
+    for (size_t i = 0; i < copies; i++) {
+        memcpy(text + i * frag_len, large_fragment, frag_len);
+    }
+    text[copies * frag_len] = '\0';
+    return text;
+}
+
+/**
+ * @brief Check that two token queues contain exactly the same tokens
+ */
+static bool same_tokens (TokenQueue* a, TokenQueue* b)
+{
+    Token* t1 = a->head;
+    Token* t2 = b->head;
+    while (t1 != NULL && t2 != NULL) {
+        if (t1->type != t2->type || t1->line != t2->line ||
+                t1->offset != t2->offset || t1->length != t2->length) {
+            return false;
+        }
+        t1 = t1->next;
+        t2 = t2->next;
+    }
+    return t1 == NULL && t2 == NULL;
+}
+
+/**
+ * @brief Lex a large program once with the given engine
+ *
+ * @param engine Engine to benchmark
+ * @param text Program to lex
+ * @param tokens Output: lexed tokens (caller must free)
+ * @returns Elapsed time in seconds (not including lexer creation)
+ */
+static double bench_engine (LexerEngine engine, char* text, TokenQueue** tokens)
+{
+    Lexer* lexer = Lexer_new(engine);
+    double start = now();
+    *tokens = Lexer_lex(lexer, text);
+    double elapsed = now() - start;
+    Lexer_free(lexer);
+    return elapsed;
+}
+
+/**
+ * @brief Lex a program with the DFA engine on the given number of threads
+ *
+ * @param lexer Lexer to use
+ * @param text Program to lex
+ * @param length Length of the program (in bytes)
+ * @param nthreads Number of threads
+ * @param reference Tokens from a single-threaded run to compare against
+ * @param same Output: whether the tokens matched @c reference
+ * @returns Best elapsed time of three runs, in seconds
+ */
+static double bench_threads (Lexer* lexer, char* text, size_t length,
+        int nthreads, TokenQueue* reference, bool* same)
+{
+    char error[MAX_ERROR_LEN];
+    double best = 0.0;
+    *same = true;
+    for (int run = 0; run < 3; run++) {
+        double start = now();
+        TokenQueue* tokens = Lexer_try_lex_parallel(lexer, text, length,
+                nthreads, 0, error);
+        double elapsed = now() - start;
+        if (tokens == NULL) {
+            *same = false;
+            return elapsed;
+        }
+        if (run == 0 || elapsed < best) {
+            best = elapsed;
+        }
+        if (run == 0) {
+            *same = same_tokens(reference, tokens);
+        }
+        TokenQueue_free(tokens);
+    }
+    return best;
+}
+
+/**
+ * @brief Benchmark entry point
+ *
+ * @param argc Number of command-line arguments
+ * @param argv Array of command-line argument strings (optional iteration count,
+ * large input size in KiB, scaling input size in MiB, and maximum threads)
+ * @returns @c EXIT_SUCCESS if all benchmarks ran and @c EXIT_FAILURE otherwise
+ */
+int main (int argc, char** argv)
+{
+    int iterations = (argc > 1 ? atoi(argv[1]) : 2000);
+    int large_kb = (argc > 2 ? atoi(argv[2]) : 64);
+    int scaling_mb = (argc > 3 ? atoi(argv[3]) : 16);
+    int max_threads = (argc > 4 ? atoi(argv[4]) : ThreadPool_cpu_count());
+    if (iterations <= 0 || large_kb <= 0 || scaling_mb <= 0 || max_threads <= 0) {
+        fprintf(stderr, "Usage: %s [iterations] [large-input-KiB] "
+                "[scaling-input-MiB] [max-threads]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (setjmp(decaf_error) != 0) {
+        return EXIT_FAILURE;
+    }
+
+    double per_call = bench_compile_per_call(iterations);
+    double shared = bench_shared_lexer(iterations);
+
+    printf("small input (%d bytes), %d iterations\n",
+            (int)strlen(small_program), iterations);
+    printf("  %-24s %10.2f us/call\n", "compile per call",
+            per_call * 1e6 / iterations);
+    printf("  %-24s %10.2f us/call\n", "shared lexer",
+            shared * 1e6 / iterations);
+    printf("  %-24s %10.2fx\n", "speedup", per_call / shared);
+
+    char* large = make_large_program((size_t)large_kb * 1024);
+    double mb = (double)strlen(large) / (1024.0 * 1024.0);
+    TokenQueue* regex_tokens = NULL;
+    TokenQueue* dfa_tokens = NULL;
+    TokenQueue* table_tokens = NULL;
+    double regex_time = bench_engine(LEXER_REGEX, large, &regex_tokens);
+    double dfa_time = bench_engine(LEXER_DFA, large, &dfa_tokens);
+    double table_time = bench_engine(LEXER_TABLE, large, &table_tokens);
+    bool same = same_tokens(regex_tokens, dfa_tokens) &&
+                same_tokens(regex_tokens, table_tokens);
+
+    printf("large input (%.2f MiB, %d tokens)\n", mb,
+            (int)TokenQueue_size(dfa_tokens));
+    printf("  %-24s %10.2f MB/s\n", "regex engine", mb / regex_time);
+    printf("  %-24s %10.2f MB/s\n", "dfa engine", mb / dfa_time);
+    printf("  %-24s %10.2f MB/s\n", "table engine", mb / table_time);
+    printf("  %-24s %10.2fx\n", "speedup", regex_time / dfa_time);
+    printf("  %-24s %10s\n", "tokens match", same ? "yes" : "NO");
+
+    TokenQueue_free(regex_tokens);
+    TokenQueue_free(dfa_tokens);
+    TokenQueue_free(table_tokens);
+    free(large);
+
+    char* huge = make_large_program((size_t)scaling_mb * 1024 * 1024);
+    size_t huge_len = strlen(huge);
+    Lexer* lexer = Lexer_new(LEXER_DFA);
+    char error[MAX_ERROR_LEN];
+    TokenQueue* reference = Lexer_try_lex_n(lexer, huge, huge_len, error);
+    bool matched;
+    double base = 0.0;
+
+    const char* simd_names[] = { "scalar", "sse2", "avx2" };
+    printf("thread scaling (%.2f MiB, dfa engine, %s kernels)\n",
+            (double)huge_len / (1024.0 * 1024.0), simd_names[simd_level()]);
+    for (int nthreads = 1; nthreads <= max_threads; nthreads++) {
+        double elapsed = bench_threads(lexer, huge, huge_len, nthreads,
+                reference, &matched);
+        if (nthreads == 1) {
+            base = elapsed;
+        }
+        same = same && matched;
+        printf("  %2d thread%-15s %10.2f MB/s %8.2fx %s\n", nthreads,
+                nthreads == 1 ? "" : "s",
+                (double)huge_len / (1024.0 * 1024.0) / elapsed,
+                base / elapsed, matched ? "" : "(tokens DIFFER)");
+    }
+
+    double first = now();
+    LexCursor* cursor = LexCursor_new(lexer, huge, huge_len, 1);
+    Token* token = LexCursor_next(cursor);
+    first = now() - first;
+    same = same && token != NULL && token->offset == reference->head->offset;
+    printf("time to first token (%.2f MiB)\n", (double)huge_len / (1024.0 * 1024.0));
+    printf("  %-24s %10.2f us\n", "eager (1 thread)", base * 1e6);
+    printf("  %-24s %10.2f us\n", "lazy cursor", first * 1e6);
+    LexCursor_free(cursor);
+
+    TokenQueue_free(reference);
+    Lexer_free(lexer);
+    free(huge);
+    return same ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,266 @@
+/**
+ * @file lexperf.c
+ * @brief Lexer throughput and memory benchmark on synthetic corpora
+ *
+ * Lexes generated corpora (see corpus.h) with @c lex and reports, for each
+ * mix, throughput in MB/s and tokens/s, heap allocations per token, and peak
+ * resident set size. Each mix runs in its own child process so that the peak
+ * RSS of one mix does not hide the next. Results are printed one record per
+ * line, as JSON objects (the default) or CSV, so runs can be compared by
+ * scripts.
+ *
+ * Allocations are counted by wrapping @c malloc, @c calloc, and @c realloc at
+ * link time (see the Makefile), so only the lexer's own allocations count.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "corpus.h"
+#include "p1-lexer.h"
+
+/**
+ * @brief Data structure used by @c setjmp / @c longjmp for exception handling
+ */
+jmp_buf decaf_error;
+
+/**
+ * @brief Abort the benchmark (generated corpora should always lex)
+ */
+void Error_throw_printf (const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+    longjmp(decaf_error, 1);
+}
+
+/**
+ * @brief Number of allocation calls made so far
+ */
+static size_t alloc_count = 0;
+
+/**
+ * @brief Number of bytes requested by allocation calls so far
+ */
+static size_t alloc_bytes = 0;
+
+void* __real_malloc (size_t size);
+void* __real_calloc (size_t count, size_t size);
+void* __real_realloc (void* ptr, size_t size);
+
+void* __wrap_malloc (size_t size)
+{
+    alloc_count++;
+    alloc_bytes += size;
+    return __real_malloc(size);
+}
+
+void* __wrap_calloc (size_t count, size_t size)
+{
+    alloc_count++;
+    alloc_bytes += count * size;
+    return __real_calloc(count, size);
+}
+
+void* __wrap_realloc (void* ptr, size_t size)
+{
+    alloc_count++;
+    alloc_bytes += size;
+    return __real_realloc(ptr, size);
+}
+
+/**
+ * @brief Output formats
+ */
+typedef enum ReportFormat { REPORT_JSON, REPORT_CSV } ReportFormat;
+
+/**
+ * @brief Benchmark settings
+ */
+typedef struct PerfOptions
+{
+    size_t size;            /**< @brief Corpus size (in bytes) */
+    int iterations;         /**< @brief Number of timed runs per mix */
+    unsigned int seed;      /**< @brief Corpus random seed */
+    ReportFormat format;    /**< @brief Output format */
+} PerfOptions;
+
+/**
+ * @brief Current time in seconds (monotonic clock)
+ */
+static double now ()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Generate a corpus, lex it, and print one result record
+ *
+ * @param mix Corpus mix
+ * @param options Benchmark settings
+ * @returns True if and only if every run lexed successfully
+ */
+static bool run_mix (const CorpusMix* mix, const PerfOptions* options)
+{
+    size_t length;
+    char* text = Corpus_generate(mix, options->size, options->seed, &length);
+
+    /* warm-up run (also builds the shared lexer and faults in the text) */
+    if (setjmp(decaf_error)) {
+        fprintf(stderr, "lexperf: mix '%s' failed to lex\n", mix->name);
+        free(text);
+        return false;
+    }
+    TokenQueue* tokens = lex(text);
+    size_t count = TokenQueue_size(tokens);
+    TokenQueue_free(tokens);
+
+    size_t start_count = alloc_count;
+    size_t start_bytes = alloc_bytes;
+    double best = 1e30;
+    for (int i = 0; i < options->iterations; i++) {
+        double start = now();
+        tokens = lex(text);
+        double elapsed = now() - start;
+        TokenQueue_free(tokens);
+        if (elapsed < best) {
+            best = elapsed;
+        }
+    }
+    double runs = (double)options->iterations * (double)count;
+    double allocs_per_token = (double)(alloc_count - start_count) / runs;
+    double bytes_per_token = (double)(alloc_bytes - start_bytes) / runs;
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    if (options->format == REPORT_JSON) {
+        printf("{\"bench\":\"lex\",\"mix\":\"%s\",\"lexer_version\":%d,"
+                "\"bytes\":%zu,\"tokens\":%zu,\"iterations\":%d,"
+                "\"best_seconds\":%.6f,\"mb_per_s\":%.2f,\"tokens_per_s\":%.0f,"
+                "\"allocs_per_token\":%.4f,\"alloc_bytes_per_token\":%.2f,"
+                "\"peak_rss_kib\":%ld}\n",
+                mix->name, LEXER_VERSION, length, count, options->iterations,
+                best, (double)length / best / 1e6, (double)count / best,
+                allocs_per_token, bytes_per_token, usage.ru_maxrss);
+    } else {
+        printf("lex,\"%s\",%d,%zu,%zu,%d,%.6f,%.2f,%.0f,%.4f,%.2f,%ld\n",
+                mix->name, LEXER_VERSION, length, count, options->iterations,
+                best, (double)length / best / 1e6, (double)count / best,
+                allocs_per_token, bytes_per_token, usage.ru_maxrss);
+    }
+    free(text);
+    return true;
+}
+
+/**
+ * @brief Run one mix in a child process (so that its peak RSS is its own)
+ */
+static bool run_mix_isolated (const CorpusMix* mix, const PerfOptions* options)
+{
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) {
+        return run_mix(mix, options);
+    }
+    if (pid == 0) {
+        bool ok = run_mix(mix, options);
+        fflush(stdout);
+        _exit(ok ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+    int status;
+    if (waitpid(pid, &status, 0) < 0) {
+        return false;
+    }
+    return WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS;
+}
+
+static void usage (const char* name)
+{
+    fprintf(stderr, "Usage: %s [-s <MiB>] [-n <iterations>] [-r <seed>] "
+            "[-f json|csv] [-m <mix>]...\n", name);
+    fprintf(stderr, "  <mix> is a preset (");
+    for (const CorpusMix* preset = corpus_presets; preset->name != NULL; preset++) {
+        fprintf(stderr, "%s%s", (preset == corpus_presets ? "" : ", "), preset->name);
+    }
+    fprintf(stderr, ") or weights like id=40,sym=40,blank=20\n"
+            "  keys: id, kw, dec, hex, str, comment, sym, blank\n");
+}
+
+int main (int argc, char** argv)
+{
+    PerfOptions options = { 8 * 1024 * 1024, 5, 1, REPORT_JSON };
+    CorpusMix* mixes = (CorpusMix*)malloc((size_t)argc * sizeof(CorpusMix));
+    CHECK_MALLOC_PTR(mixes)
+    int mix_count = 0;
+
+    for (int i = 1; i < argc; i++) {
+        bool has_value = (i + 1 < argc);
+        if (strcmp(argv[i], "-s") == 0 && has_value) {
+            double mib = atof(argv[++i]);
+            if (mib <= 0) {
+                usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+            options.size = (size_t)(mib * 1024 * 1024);
+        } else if (strcmp(argv[i], "-n") == 0 && has_value) {
+            options.iterations = atoi(argv[++i]);
+            if (options.iterations < 1) {
+                usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "-r") == 0 && has_value) {
+            options.seed = (unsigned int)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-f") == 0 && has_value) {
+            i++;
+            if (strcmp(argv[i], "json") == 0) {
+                options.format = REPORT_JSON;
+            } else if (strcmp(argv[i], "csv") == 0) {
+                options.format = REPORT_CSV;
+            } else {
+                usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "-m") == 0 && has_value) {
+            if (!CorpusMix_parse(argv[++i], &mixes[mix_count])) {
+                fprintf(stderr, "Invalid mix: %s\n", argv[i]);
+                usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+            mix_count++;
+        } else {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    /* default to every preset */
+    if (mix_count == 0) {
+        for (const CorpusMix* preset = corpus_presets; preset->name != NULL; preset++) {
+            mixes = (CorpusMix*)realloc(mixes, (size_t)(mix_count + 1) * sizeof(CorpusMix));
+            CHECK_MALLOC_PTR(mixes)
+            mixes[mix_count++] = *preset;
+        }
+    }
+
+    if (options.format == REPORT_CSV) {
+        printf("bench,mix,lexer_version,bytes,tokens,iterations,best_seconds,"
+                "mb_per_s,tokens_per_s,allocs_per_token,alloc_bytes_per_token,"
+                "peak_rss_kib\n");
+    }
+
+    bool ok = true;
+    for (int i = 0; i < mix_count; i++) {
+        ok = run_mix_isolated(&mixes[i], &options) && ok;
+    }
+    free(mixes);
+    return (ok ? EXIT_SUCCESS : EXIT_FAILURE);
+}
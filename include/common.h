@@ -31,11 +31,6 @@
 #include <stdlib.h>
 #include <string.h>
 
-/**
- * @brief Maximum size (in bytes) of any Decaf source file
- */
-#define MAX_FILE_SIZE 65536
-
 /**
  * @brief Maximum length (in characters) of any single line of input
  */
@@ -83,6 +78,86 @@ const char* DecafType_to_string(DecafType type);
  */
 void print_escaped_string(const char* string, FILE* output);
 
+/**
+ * @brief Size of the per-thread buffer used by the output routines
+ */
+#define OUTPUT_BUFFER_SIZE (64 * 1024)
+
+/**
+ * @brief Output buffer that formats text in memory and flushes it in bulk
+ *
+ * Used by the routines that print large amounts of output (e.g.,
+ * @ref TokenQueue_print) instead of calling @c fprintf for every item. When
+ * the stream has a file descriptor, the buffer is written directly with
+ * @c write (after flushing anything pending in the stream itself, so output
+ * stays in order); otherwise it falls back to @c fwrite.
+ *
+ * Initialize with @ref OutputBuffer_init and finish with
+ * @ref OutputBuffer_flush.
+ */
+typedef struct OutputBuffer
+{
+    FILE* out;          /**< @brief Stream to flush to */
+    int fd;             /**< @brief File descriptor of @c out (or -1) */
+    char* data;         /**< @brief Buffer storage */
+    size_t length;      /**< @brief Number of bytes currently buffered */
+    size_t capacity;    /**< @brief Size of the buffer storage */
+} OutputBuffer;
+
+/**
+ * @brief Start buffering output for a stream
+ *
+ * The buffer storage is a per-thread block of #OUTPUT_BUFFER_SIZE bytes that
+ * is reused by every call on the same thread, so only one buffer may be in use
+ * per thread at a time.
+ *
+ * @param buffer Buffer to initialize
+ * @param out Stream to write to
+ */
+void OutputBuffer_init (OutputBuffer* buffer, FILE* out);
+
+/**
+ * @brief Append raw bytes to a buffer
+ *
+ * @param buffer Buffer to append to
+ * @param text Bytes to append
+ * @param length Number of bytes
+ */
+void OutputBuffer_write (OutputBuffer* buffer, const char* text, size_t length);
+
+/**
+ * @brief Append a single character to a buffer
+ *
+ * @param buffer Buffer to append to
+ * @param c Character to append
+ */
+void OutputBuffer_putc (OutputBuffer* buffer, char c);
+
+/**
+ * @brief Append a string left-justified in a field (like @c %-Ns)
+ *
+ * @param buffer Buffer to append to
+ * @param text NUL-terminated string to append
+ * @param width Minimum field width (padded with spaces on the right)
+ */
+void OutputBuffer_write_padded (OutputBuffer* buffer, const char* text, int width);
+
+/**
+ * @brief Append a decimal integer zero-padded to a width (like @c %0Nd)
+ *
+ * @param buffer Buffer to append to
+ * @param value Integer to append
+ * @param width Minimum field width (including any minus sign)
+ */
+void OutputBuffer_write_int (OutputBuffer* buffer, int value, int width);
+
+/**
+ * @brief Write out everything buffered so far
+ *
+ * @param buffer Buffer to flush
+ */
+void OutputBuffer_flush (OutputBuffer* buffer);
+
 /**
  * @brief Throw an exception with an error message using @c printf syntax
  *
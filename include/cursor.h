@@ -0,0 +1,151 @@
+/**
+ * @file cursor.h
+ * @brief Lazy (on-demand) token cursor over an in-memory buffer
+ *
+ * A cursor scans tokens only when the consumer asks for them, instead of
+ * lexing the whole input up front like @ref Lexer_lex. Only a small window of
+ * lookahead tokens is ever stored, so memory use does not depend on the size
+ * of the input, and the first token is available as soon as it is scanned.
+ * This suits consumers that only look at the beginning of a file or stop at
+ * the first problem they find.
+ *
+ * Typical use:
+ *
+ *     LexCursor* cursor = LexCursor_new(lexer, text, length, 2);
+ *     while ((token = LexCursor_next(cursor)) != NULL) {
+ *         if (... LexCursor_peek(cursor, 0) ...) { ... }
+ *     }
+ *     if (cursor->failed) {
+ *         ... report cursor->error ...
+ *     }
+ *     LexCursor_free(cursor);
+ */
+
+#ifndef __CURSOR_H
+#define __CURSOR_H
+
+#include "p1-lexer.h"
+
+/**
+ * @brief Lazy lexer state
+ *
+ * Tokens are kept in a ring buffer that holds the lookahead window plus the
+ * token most recently returned by @ref LexCursor_next. Their text points into
+ * the input buffer, which must not be modified or freed while the cursor is
+ * in use.
+ *
+ * Allocate with @ref LexCursor_new and de-allocate with @ref LexCursor_free.
+ *
+ * Methods:
+ * - @ref LexCursor_next
+ * - @ref LexCursor_peek
+ */
+typedef struct LexCursor
+{
+    /**
+     * @brief Lexer used to scan the input (must outlive the cursor)
+     */
+    const Lexer* lexer;
+
+    /**
+     * @brief Input text
+     */
+    const char* text;
+
+    /**
+     * @brief Length of the input (in bytes)
+     */
+    size_t length;
+
+    /**
+     * @brief Position of the next lexeme to scan
+     */
+    ScanPosition pos;
+
+    /**
+     * @brief Token storage (a ring buffer of @c mask + 1 tokens)
+     */
+    Token* window;
+
+    /**
+     * @brief Size of @c window minus one (the size is a power of two)
+     */
+    size_t mask;
+
+    /**
+     * @brief Index in @c window of the next token to return
+     */
+    size_t head;
+
+    /**
+     * @brief Number of tokens scanned but not yet returned
+     */
+    size_t count;
+
+    /**
+     * @brief Maximum number of tokens that may be peeked at
+     */
+    size_t lookahead;
+
+    /**
+     * @brief True once an invalid token has been found (@c pos is left at it)
+     */
+    bool failed;
+
+    /**
+     * @brief Message describing the invalid token (only valid if @c failed)
+     */
+    char error[MAX_ERROR_LEN];
+
+} LexCursor;
+
+/**
+ * @brief Allocate a cursor at the start of a buffer
+ *
+ * Nothing is scanned until a token is requested.
+ *
+ * @param lexer Lexer to use (must outlive the cursor)
+ * @param text Text to lex
+ * @param length Length of the text (in bytes)
+ * @param lookahead Maximum number of upcoming tokens that @ref LexCursor_peek
+ * may look at (at least one)
+ * @returns Newly-created cursor
+ */
+LexCursor* LexCursor_new (const Lexer* lexer, const char* text, size_t length,
+        size_t lookahead);
+
+/**
+ * @brief Look at an upcoming token without consuming it
+ *
+ * Scans just far enough to find the token. The returned token belongs to the
+ * cursor and stays valid until it has been consumed by @ref LexCursor_next and
+ * @ref LexCursor_next is called again.
+ *
+ * @param cursor Cursor to look ahead with
+ * @param k Number of tokens to skip (0 is the token the next call to
+ * @ref LexCursor_next will return); must be less than the cursor's lookahead
+ * @returns The token, or @c NULL if the input ends (or an invalid token is
+ * found; see @c failed) before it, or if @c k is out of range
+ */
+Token* LexCursor_peek (LexCursor* cursor, size_t k);
+
+/**
+ * @brief Consume the next token
+ *
+ * The returned token belongs to the cursor and stays valid until the next
+ * call to @ref LexCursor_next (copy it to keep it longer).
+ *
+ * @param cursor Cursor to advance
+ * @returns The token, or @c NULL at the end of the input or if an invalid
+ * token was found (see @c failed)
+ */
+Token* LexCursor_next (LexCursor* cursor);
+
+/**
+ * @brief Deallocate a cursor
+ *
+ * @param cursor Cursor to deallocate
+ */
+void LexCursor_free (LexCursor* cursor);
+
+#endif
@@ -0,0 +1,113 @@
+/**
+ * @file diagnostic.h
+ * @brief Positioned lexer error reports
+ *
+ * Used by @ref Lexer_lex_recover, which keeps lexing after an invalid token
+ * and reports every error in a single pass instead of stopping at the first
+ * one.
+ */
+
+#ifndef __DIAGNOSTIC_H
+#define __DIAGNOSTIC_H
+
+#include "common.h"
+#include "scanner.h"
+
+/**
+ * @brief Kinds of lexer errors
+ *
+ * May be any of the following:
+ *
+ * <ul>
+ * <li> @c LEX_ERROR_CHARACTER - one or more characters that cannot start a
+ *      token (e.g., @c $ or a lone @c &) </li>
+ * <li> @c LEX_ERROR_RESERVED_WORD - a reserved word used as an identifier </li>
+ * <li> @c LEX_ERROR_STRING - a string literal that is not closed or that
+ *      contains a character not allowed in strings </li>
+ * </ul>
+ */
+typedef enum LexErrorKind {
+    LEX_ERROR_CHARACTER, LEX_ERROR_RESERVED_WORD, LEX_ERROR_STRING
+} LexErrorKind;
+
+/**
+ * @brief Single lexer error
+ */
+typedef struct LexDiagnostic
+{
+    LexErrorKind kind;  /**< @brief What went wrong */
+    int line;           /**< @brief Line of the first bad character */
+    int column;         /**< @brief Column of the first bad character */
+    size_t offset;      /**< @brief Byte offset of the first bad character */
+    size_t length;      /**< @brief Length of the text skipped to recover */
+} LexDiagnostic;
+
+/**
+ * @brief List of lexer errors, in source order
+ *
+ * Initialize with @ref LexDiagnostics_init and de-allocate with
+ * @ref LexDiagnostics_free.
+ *
+ * Methods:
+ * - @ref LexDiagnostics_add
+ * - @ref LexDiagnostics_print
+ */
+typedef struct LexDiagnostics
+{
+    LexDiagnostic* items;   /**< @brief Errors found so far */
+    size_t count;           /**< @brief Number of errors */
+    size_t capacity;        /**< @brief Allocated size of @c items */
+} LexDiagnostics;
+
+/**
+ * @brief Initialize an empty list
+ *
+ * @param list List to initialize
+ */
+void LexDiagnostics_init (LexDiagnostics* list);
+
+/**
+ * @brief Add an error to a list
+ *
+ * Invalid characters right after a previous invalid character are merged into
+ * its report, so a run of garbage is reported once.
+ *
+ * @param list List to add to
+ * @param kind What went wrong
+ * @param pos Position of the first bad character
+ * @param length Length of the text skipped to recover
+ */
+void LexDiagnostics_add (LexDiagnostics* list, LexErrorKind kind,
+        const ScanPosition* pos, size_t length);
+
+/**
+ * @brief Describe an error
+ *
+ * @param diagnostic Error to describe
+ * @param text Source text the error was found in
+ * @param buffer Output: NUL-terminated message (without position)
+ * @param size Size of the buffer
+ */
+void LexDiagnostic_format (const LexDiagnostic* diagnostic, const char* text,
+        char* buffer, size_t size);
+
+/**
+ * @brief Print every error in a list, one per line, as
+ * <tt>filename:line:column: error: message</tt>
+ *
+ * @param list List to print
+ * @param filename Name of the source file
+ * @param text Source text the errors were found in
+ * @param out Stream to print to
+ */
+void LexDiagnostics_print (const LexDiagnostics* list, const char* filename,
+        const char* text, FILE* out);
+
+/**
+ * @brief Deallocate the storage of a list (the list itself is not freed)
+ *
+ * @param list List to clean up
+ */
+void LexDiagnostics_free (LexDiagnostics* list);
+
+#endif
@@ -0,0 +1,184 @@
+/**
+ * @file lexstats.h
+ * @brief Optional lexer profiling counters
+ *
+ * When the project is built with @c DECAF_STATS defined (<tt>make STATS=1</tt>
+ * after a <tt>make clean</tt>), the lexer counts how often each rule is tried
+ * and how often it matches, how long each rule takes, how many tokens of each
+ * type are produced, and the driver times each phase of a compilation. Without
+ * @c DECAF_STATS the @c LEXSTATS_ hooks below expand to nothing, so the lexer
+ * is exactly as fast as if they were not there; the functions still exist but
+ * always report zeros.
+ *
+ * Counts are kept per thread while lexing and added to process-wide totals
+ * (under a lock) at the end of each call to @ref Lexer_lex_range.
+ */
+
+#ifndef __LEXSTATS_H
+#define __LEXSTATS_H
+
+#include "common.h"
+#include "token.h"
+#include "scanner.h"
+
+/**
+ * @brief Lexer rules, in the order the regex engine tries them
+ *
+ * May be any of the following:
+ *
+ * <ul>
+ * <li> @c LEX_RULE_WHITESPACE - spaces and tabs </li>
+ * <li> @c LEX_RULE_NEWLINE - line breaks </li>
+ * <li> @c LEX_RULE_COMMENT - line comments </li>
+ * <li> @c LEX_RULE_HEX - hexadecimal literals </li>
+ * <li> @c LEX_RULE_LETTER - identifier-like words </li>
+ * <li> @c LEX_RULE_KEYWORD - keyword lookup of a word (tried for every word,
+ *      matches keywords) </li>
+ * <li> @c LEX_RULE_NUMBERS - decimal literals </li>
+ * <li> @c LEX_RULE_OR_EQUAL - two-character comparison symbols </li>
+ * <li> @c LEX_RULE_GROUPING - grouping and separator symbols </li>
+ * <li> @c LEX_RULE_SYMBOLS - operator symbols </li>
+ * <li> @c LEX_RULE_STRINGS - string literals </li>
+ * </ul>
+ *
+ * The DFA engine decides on a lexeme in a single pass, so each lexeme counts
+ * as one attempt and one match of the rule the regex engine would have used.
+ */
+typedef enum LexRule {
+    LEX_RULE_WHITESPACE, LEX_RULE_NEWLINE, LEX_RULE_COMMENT, LEX_RULE_HEX,
+    LEX_RULE_LETTER, LEX_RULE_KEYWORD, LEX_RULE_NUMBERS, LEX_RULE_OR_EQUAL,
+    LEX_RULE_GROUPING, LEX_RULE_SYMBOLS, LEX_RULE_STRINGS,
+    LEX_RULE_COUNT
+} LexRule;
+
+/**
+ * @brief Phases of a compilation timed by the driver
+ */
+typedef enum LexPhase {
+    LEX_PHASE_READ, LEX_PHASE_LEX, LEX_PHASE_PRINT,
+    LEX_PHASE_COUNT
+} LexPhase;
+
+/**
+ * @brief Number of token types (see @ref TokenType)
+ */
+#define LEXSTATS_TOKEN_TYPES (SYM + 1)
+
+/**
+ * @brief Counters for a single rule
+ */
+typedef struct LexRuleStats
+{
+    uint64_t attempts;      /**< @brief Number of times the rule was tried */
+    uint64_t matches;       /**< @brief Number of times the rule matched */
+    uint64_t nanoseconds;   /**< @brief Time spent trying the rule */
+} LexRuleStats;
+
+/**
+ * @brief Lexer statistics
+ */
+typedef struct LexStats
+{
+    LexRuleStats rules[LEX_RULE_COUNT];             /**< @brief Per-rule counters */
+    uint64_t tokens[LEXSTATS_TOKEN_TYPES];          /**< @brief Tokens of each type */
+    uint64_t token_bytes[LEXSTATS_TOKEN_TYPES];     /**< @brief Text in tokens of each type */
+    uint64_t lexemes;                               /**< @brief Lexemes scanned (including
+                                                         whitespace and comments) */
+    uint64_t bytes;                                 /**< @brief Text scanned (in bytes) */
+    uint64_t phase_nanoseconds[LEX_PHASE_COUNT];    /**< @brief Time spent in each phase
+                                                         (summed over threads) */
+} LexStats;
+
+/**
+ * @brief Check whether statistics were compiled in
+ *
+ * @returns True if and only if the project was built with @c DECAF_STATS
+ */
+bool LexStats_enabled ();
+
+/**
+ * @brief Get a copy of the process-wide statistics
+ *
+ * @param stats Output: statistics so far
+ */
+void LexStats_get (LexStats* stats);
+
+/**
+ * @brief Reset the process-wide statistics to zero
+ */
+void LexStats_reset ();
+
+/**
+ * @brief Print statistics as a table
+ *
+ * @param stats Statistics to print
+ * @param out Stream to print to
+ */
+void LexStats_print (const LexStats* stats, FILE* out);
+
+/**
+ * @brief Current time for the hooks below (monotonic, in nanoseconds)
+ */
+uint64_t LexStats_now ();
+
+/**
+ * @brief Record one attempt of a rule (use @ref LEXSTATS_RULE)
+ */
+void LexStats_record_rule (LexRule rule, bool matched, uint64_t start);
+
+/**
+ * @brief Record a lexeme found by the DFA or table engine (use @ref LEXSTATS_DFA)
+ */
+void LexStats_record_dfa (const char* text, const Lexeme* lexeme, uint64_t start);
+
+/**
+ * @brief Record a token (use @ref LEXSTATS_TOKEN)
+ */
+void LexStats_record_token (TokenType type, size_t length);
+
+/**
+ * @brief Record a scanned lexeme (use @ref LEXSTATS_LEXEME)
+ */
+void LexStats_record_lexeme (size_t length);
+
+/**
+ * @brief Record the time spent in a phase (use @ref LEXSTATS_PHASE)
+ */
+void LexStats_record_phase (LexPhase phase, uint64_t start);
+
+/**
+ * @brief Add this thread's counts to the process-wide totals (use
+ * @ref LEXSTATS_FLUSH)
+ */
+void LexStats_flush ();
+
+#ifdef DECAF_STATS
+
+/** @brief Start timing something (declares a variable) */
+#define LEXSTATS_START(var)                 uint64_t var = LexStats_now()
+/** @brief Record one attempt of a regex rule */
+#define LEXSTATS_RULE(rule, matched, start) LexStats_record_rule(rule, matched, start)
+/** @brief Record a lexeme found by the DFA engine */
+#define LEXSTATS_DFA(text, lexeme, start)   LexStats_record_dfa(text, lexeme, start)
+/** @brief Record a token */
+#define LEXSTATS_TOKEN(type, length)        LexStats_record_token(type, length)
+/** @brief Record a scanned lexeme */
+#define LEXSTATS_LEXEME(length)             LexStats_record_lexeme(length)
+/** @brief Record the time spent in a phase */
+#define LEXSTATS_PHASE(phase, start)        LexStats_record_phase(phase, start)
+/** @brief Add this thread's counts to the process-wide totals */
+#define LEXSTATS_FLUSH()                    LexStats_flush()
+
+#else
+
+#define LEXSTATS_START(var)
+#define LEXSTATS_RULE(rule, matched, start)
+#define LEXSTATS_DFA(text, lexeme, start)
+#define LEXSTATS_TOKEN(type, length)
+#define LEXSTATS_LEXEME(length)
+#define LEXSTATS_PHASE(phase, start)
+#define LEXSTATS_FLUSH()
+
+#endif
+
+#endif
@@ -7,14 +7,403 @@
 #define __P1_LEXER_H
 
 #include "common.h"
+#include "diagnostic.h"
 #include "token.h"
+#include "tokenpool.h"
+#include "scanner.h"
+
+/**
+ * @brief Version of the lexer's output
+ *
+ * Must be increased whenever the tokens produced for some input change, so
+ * that stale entries in token caches (see tokencache.h) are not used.
+ */
+#define LEXER_VERSION 2
+
+/**
+ * @brief Scanning engines
+ *
+ * May be any of the following:
+ *
+ * <ul>
+ * <li> @c LEXER_REGEX - POSIX regular expressions tried in priority order </li>
+ * <li> @c LEXER_DFA - hand-written single-pass DFA (see scanner.h) </li>
+ * <li> @c LEXER_TABLE - DFA generated at build time from @c src/tokens.spec
+ *      (see @ref scan_table) </li>
+ * </ul>
+ *
+ * All engines produce exactly the same tokens; the regex engine is kept as a
+ * reference implementation to cross-check the others against.
+ */
+typedef enum LexerEngine {
+    LEXER_REGEX, LEXER_DFA, LEXER_TABLE
+} LexerEngine;
+
+/**
+ * @brief Reusable lexer context
+ *
+ * Holds the compiled token grammar so that the regular expressions only need
+ * to be compiled once no matter how many programs are lexed. The grammar is
+ * never modified after the lexer is configured and its pool and symbol table
+ * lock internally, so a single instance may be shared by several threads
+ * (POSIX guarantees that @c regexec is reentrant).
+ *
+ * Queues returned by a lexer take their storage from the lexer's
+ * @ref TokenPool, so freeing the tokens of one program makes the memory
+ * available for lexing the next one (use @ref TokenPool_get_stats on
+ * @c pool to size it). The queues may outlive the lexer.
+ *
+ * With @ref Lexer_set_interning, the text of every identifier and string
+ * literal is interned in the lexer's @ref SymbolTable, which is shared by
+ * everything the lexer lexes, so equal names get equal symbols across all
+ * programs lexed by one lexer. Symbols are only meaningful while the lexer is
+ * alive (and until @ref Lexer_clear_symbols). Interning is off by default:
+ * every token it covers takes the table's lock, and the table keeps every
+ * name it has seen, which does not suit shared or long-lived lexers. In
+ * particular, neither the default lexer behind @ref lex nor the @c decaf
+ * driver interns, so their tokens always have @ref SYMBOL_NONE; a later phase
+ * that wants to compare names by symbol must lex with its own lexer that has
+ * interning turned on.
+ *
+ * Allocate with @ref Lexer_new and de-allocate with @ref Lexer_free.
+ *
+ * Methods:
+ * - @ref Lexer_lex
+ */
+typedef struct Lexer
+{
+    LexerEngine engine; /**< @brief Scanning engine */
+    int threads;        /**< @brief Threads to use for large inputs */
+    TokenPool* pool;    /**< @brief Storage for the tokens of returned queues */
+    SymbolTable* interned;  /**< @brief Interned identifiers and string literals
+                                 (or @c NULL if interning is off) */
+
+    /* compiled regular expressions (only used by LEXER_REGEX) */
+    Regex* whitespace;  /**< @brief Spaces and tabs */
+    Regex* newline;     /**< @brief Line breaks */
+    Regex* letter;      /**< @brief Identifiers, keywords, and reserved words */
+    Regex* numbers;     /**< @brief Decimal literals */
+    Regex* grouping;    /**< @brief Grouping and separator symbols */
+    Regex* symbols;     /**< @brief Operator symbols */
+    Regex* or_equal;    /**< @brief Two-character comparison symbols */
+    Regex* strings;     /**< @brief String literals */
+    Regex* hex;         /**< @brief Hexadecimal literals */
+    Regex* comment;     /**< @brief Start of a line comment */
+
+} Lexer;
+
+/**
+ * @brief Allocate a new lexer and compile the token grammar
+ *
+ * @param engine Scanning engine to use
+ * @returns Newly-created lexer
+ */
+Lexer* Lexer_new (LexerEngine engine);
+
+/**
+ * @brief Convert a string containing a Decaf program into a queue of tokens
+ * using a previously-compiled lexer.
+ *
+ * Invalid tokens are reported using @ref Error_throw_printf. The tokens point
+ * into @c text, so it must not be modified or freed until the tokens are.
+ *
+ * @param lexer Lexer to use
+ * @param text String to lex
+ * @returns Newly-created queue of tokens
+ */
+TokenQueue* Lexer_lex (const Lexer* lexer, const char* text);
+
+/**
+ * @brief Convert a buffer containing a Decaf program into a queue of tokens
+ * using a previously-compiled lexer.
+ *
+ * This is the same as @ref Lexer_lex except that the length of the text is
+ * given explicitly, so the text may contain NUL characters (which are invalid
+ * tokens) and need not be a C string. Neither engine reads anything outside
+ * <tt>[text, text + length)</tt>, so the text may be a slice of a larger
+ * buffer (e.g., part of a memory-mapped file or a network buffer).
+ *
+ * @param lexer Lexer to use
+ * @param text Text to lex
+ * @param length Length of the text (in bytes)
+ * @returns Newly-created queue of tokens
+ */
+TokenQueue* Lexer_lex_n (const Lexer* lexer, const char* text, size_t length);
+
+/**
+ * @brief Lexing option: do not intern the text of identifiers and string
+ * literals, even if the lexer interns (their @c symbol is left as
+ * @ref SYMBOL_NONE)
+ *
+ * For callers that share a long-lived lexer but have no use for symbols
+ * (e.g., the server in server.h), so its symbol table does not grow with their
+ * input.
+ */
+#define LEX_NO_INTERN 1
+
+/**
+ * @brief Lex a buffer without throwing exceptions
+ *
+ * This is the same as @ref Lexer_lex_n except that errors are reported by
+ * returning @c NULL (after cleaning up any tokens) and writing a message to
+ * the given buffer instead of calling @ref Error_throw_printf. All error state
+ * belongs to the caller, so this is safe to call from several threads at once
+ * with the same lexer.
+ *
+ * @param lexer Lexer to use
+ * @param text Text to lex
+ * @param length Length of the text (in bytes)
+ * @param error Output: error message (must be at least #MAX_ERROR_LEN long)
+ * @returns Newly-created queue of tokens or @c NULL if there was an error
+ */
+TokenQueue* Lexer_try_lex_n (const Lexer* lexer, const char* text, size_t length,
+        char* error);
+
+/**
+ * @brief Lex a buffer without throwing exceptions, with options
+ *
+ * This is the same as @ref Lexer_try_lex_n with lexing options.
+ *
+ * @param lexer Lexer to use
+ * @param text Text to lex
+ * @param length Length of the text (in bytes)
+ * @param options Any of @ref LEX_NO_INTERN (or 0)
+ * @param error Output: error message (must be at least #MAX_ERROR_LEN long)
+ * @returns Newly-created queue of tokens or @c NULL if there was an error
+ */
+TokenQueue* Lexer_try_lex_n_opts (const Lexer* lexer, const char* text,
+        size_t length, int options, char* error);
+
+/**
+ * @brief Lex a buffer on the calling thread only
+ *
+ * This is the same as @ref Lexer_try_lex_n but never splits the text across
+ * threads, whatever the lexer's thread setting (see @ref Lexer_set_threads).
+ * @ref Lexer_try_lex_parallel falls back to it for inputs too small to split.
+ *
+ * @param lexer Lexer to use
+ * @param text Text to lex (must not be @c NULL)
+ * @param length Length of the text (in bytes)
+ * @param options Any of @ref LEX_NO_INTERN (or 0)
+ * @param error Output: error message (must be at least #MAX_ERROR_LEN long)
+ * @returns Newly-created queue of tokens or @c NULL if there was an error
+ */
+TokenQueue* Lexer_try_lex_serial (const Lexer* lexer, const char* text,
+        size_t length, int options, char* error);
+
+/**
+ * @brief Lex a buffer, reporting every invalid token instead of stopping
+ *
+ * Never throws or fails: each invalid token is added to @c diagnostics with
+ * its position, a little text is skipped to get back in sync (see
+ * @ref LexDiagnostics), and lexing continues. The returned queue holds all of
+ * the valid tokens; if no diagnostics were added, it is exactly what
+ * @ref Lexer_lex_n would return.
+ *
+ * @param lexer Lexer to use
+ * @param text Text to lex
+ * @param length Length of the text (in bytes)
+ * @param diagnostics List to add errors to (see diagnostic.h)
+ * @returns Newly-created queue of the valid tokens
+ */
+TokenQueue* Lexer_lex_recover (const Lexer* lexer, const char* text, size_t length,
+        LexDiagnostics* diagnostics);
+
+/**
+ * @brief Lex a buffer, reporting every invalid token, with options
+ *
+ * This is the same as @ref Lexer_lex_recover with lexing options.
+ *
+ * @param lexer Lexer to use
+ * @param text Text to lex
+ * @param length Length of the text (in bytes)
+ * @param options Any of @ref LEX_NO_INTERN (or 0)
+ * @param diagnostics List to add errors to (see diagnostic.h)
+ * @returns Newly-created queue of the valid tokens
+ */
+TokenQueue* Lexer_lex_recover_opts (const Lexer* lexer, const char* text,
+        size_t length, int options, LexDiagnostics* diagnostics);
+
+/**
+ * @brief Minimum amount of text (in bytes) lexed by each thread when a
+ * single input is split across several threads
+ */
+#define LEXER_MIN_PARALLEL_CHUNK (64 * 1024)
+
+/**
+ * @brief Lex a single buffer using several threads
+ *
+ * The text is split into roughly equal chunks, each starting right after a
+ * newline, and each chunk is lexed by its own thread as if it started a new
+ * line. A split is only trusted if the previous chunk's lexing reaches a token
+ * boundary exactly at it (otherwise it was inside a string literal or similar
+ * and the chunk is lexed again from the right place), so the result is always
+ * identical to lexing on a single thread. Line numbers are fixed up when the
+ * chunks are stitched together.
+ *
+ * @ref Lexer_try_lex_n calls this automatically for large inputs if the lexer
+ * was configured with @ref Lexer_set_threads.
+ *
+ * @param lexer Lexer to use
+ * @param text Text to lex
+ * @param length Length of the text (in bytes)
+ * @param nthreads Maximum number of threads to use
+ * @param options Any of @ref LEX_NO_INTERN (or 0)
+ * @param error Output: error message (must be at least #MAX_ERROR_LEN long)
+ * @returns Newly-created queue of tokens or @c NULL if there was an error
+ */
+TokenQueue* Lexer_try_lex_parallel (const Lexer* lexer, const char* text,
+        size_t length, int nthreads, int options, char* error);
+
+/**
+ * @brief Lex part of a buffer, appending to an existing queue
+ *
+ * Lexes from the given position until a lexeme would start at or after
+ * @c stop (or the end of the text is reached). This is the building block for
+ * the other lexing functions.
+ *
+ * @param lexer Lexer to use
+ * @param text Start of the whole text
+ * @param length Length of the whole text (in bytes)
+ * @param stop Offset at which to stop starting new lexemes
+ * @param pos Position to start from; updated to where lexing stopped
+ * @param tokens Queue to add tokens to
+ * @param options Any of @ref LEX_NO_INTERN (or 0)
+ * @param error Output: error message (must be at least #MAX_ERROR_LEN long)
+ * @returns True if and only if no invalid tokens were found (on error,
+ * @c pos is left at the invalid token)
+ */
+bool Lexer_lex_range (const Lexer* lexer, const char* text, size_t length,
+        size_t stop, ScanPosition* pos, TokenQueue* tokens, int options,
+        char* error);
+
+/**
+ * @brief Scan a single lexeme with a lexer's engine
+ *
+ * This is the step that all lexing functions repeat; it is exposed for
+ * consumers that drive the scanning themselves (e.g., @ref LexCursor).
+ *
+ * @param lexer Lexer to use
+ * @param text Start of the lexeme (must be before @c end)
+ * @param end End of the input
+ * @param lexeme Output: kind, type, and length of the lexeme
+ */
+void Lexer_scan (const Lexer* lexer, const char* text, const char* end,
+        Lexeme* lexeme);
+
+/**
+ * @brief Get the symbol for the text of a new token
+ *
+ * @param lexer Lexer whose symbol table to use
+ * @param type Type of the token
+ * @param text Text of the token
+ * @param length Length of the text (in bytes)
+ * @returns Interned symbol for identifiers and string literals, and
+ * @ref SYMBOL_NONE for all other tokens (or if interning is off)
+ */
+Symbol Lexer_intern (const Lexer* lexer, TokenType type, const char* text,
+        size_t length);
+
+/**
+ * @brief Turn interning of identifiers and string literals on or off
+ *
+ * Turning it off frees the symbol table. Must not be called while another
+ * thread is using the lexer.
+ *
+ * @param lexer Lexer to configure
+ * @param enabled True to intern (see symtab.h)
+ */
+void Lexer_set_interning (Lexer* lexer, bool enabled);
+
+/**
+ * @brief Forget every interned symbol (see @ref SymbolTable_clear)
+ *
+ * Keeps the memory of a long-lived lexer bounded; tokens lexed before the call
+ * keep symbols that no longer mean anything.
+ *
+ * @param lexer Lexer whose symbol table to clear (nothing happens if
+ * interning is off)
+ */
+void Lexer_clear_symbols (Lexer* lexer);
+
+/**
+ * @brief Set the number of threads a lexer may use for a single large input
+ *
+ * Must not be called while another thread is using the lexer.
+ *
+ * @param lexer Lexer to configure
+ * @param threads Number of threads (1 disables parallel lexing)
+ */
+void Lexer_set_threads (Lexer* lexer, int threads);
+
+/**
+ * @brief Description of a single edit to a text
+ *
+ * The edited text is the original text with @c deleted bytes starting at
+ * @c offset replaced by @c inserted new bytes.
+ */
+typedef struct LexEdit
+{
+    size_t offset;      /**< @brief Where the edit starts (same in both texts) */
+    size_t deleted;     /**< @brief Number of bytes removed from the old text */
+    size_t inserted;    /**< @brief Number of bytes added in the new text */
+} LexEdit;
+
+/**
+ * @brief Update the tokens of a text after an edit without lexing it all
+ *
+ * Lexing restarts a little before the edit (at a point that no earlier
+ * token's lookahead can reach past) and stops as soon as a new token starts
+ * where an old token started, shifted by the edit. Only the tokens in between
+ * are replaced; the ones after it have their offsets, line numbers, and (on
+ * the edited line) columns shifted. The result is identical to lexing the
+ * whole new text.
+ *
+ * The new text may be the old buffer modified in place or a different buffer
+ * (in which case the text pointers of all tokens are updated).
+ *
+ * @param lexer Lexer to use
+ * @param tokens Tokens lexed from the text before the edit; updated in place
+ * (pointers to tokens after the restart point become invalid)
+ * @param text New text (after the edit)
+ * @param length Length of the new text (in bytes)
+ * @param edit Edit that turned the old text into the new one
+ * @param error Output: error message (must be at least #MAX_ERROR_LEN long)
+ * @returns True if and only if the new text has no invalid tokens (on error,
+ * the queue is left unchanged)
+ */
+bool Lexer_relex (const Lexer* lexer, TokenQueue* tokens, const char* text,
+        size_t length, LexEdit edit, char* error);
+
+/**
+ * @brief Deallocate a lexer
+ *
+ * @param lexer Lexer to deallocate
+ */
+void Lexer_free (Lexer* lexer);
 
 /**
  * @brief Convert a string containing a Decaf program into a queue of tokens.
  *
+ * This uses a process-wide @c LEXER_DFA lexer that is created on first use.
+ * The tokens point into @c text (see @ref Lexer_lex).
+ *
  * @param text String to lex
  * @returns Newly-created queue of tokens
  */
 TokenQueue* lex(char* text);
 
+/**
+ * @brief Convert a buffer containing a Decaf program into a queue of tokens.
+ *
+ * Same as @ref lex except that the length of the text is given explicitly
+ * (see @ref Lexer_lex_n), so the text need not be NUL-terminated and nothing
+ * outside <tt>[text, text + len)</tt> is read.
+ *
+ * @param text Text to lex
+ * @param len Length of the text (in bytes)
+ * @returns Newly-created queue of tokens
+ */
+TokenQueue* lex_n(const char* text, size_t len);
+
 #endif
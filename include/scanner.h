@@ -0,0 +1,146 @@
+/**
+ * @file scanner.h
+ * @brief Single-lexeme scanners shared by the lexer engines
+ *
+ * A scanner looks at the text at the current position and decides what the
+ * next lexeme is (a token, something to skip, or an error) and how long it is.
+ * The lexer driver (see p1-lexer.c) handles everything else: line counting,
+ * building tokens, and reporting errors.
+ */
+
+#ifndef __SCANNER_H
+#define __SCANNER_H
+
+#include "common.h"
+#include "token.h"
+
+/**
+ * @brief Kinds of lexemes
+ *
+ * May be any of the following:
+ *
+ * <ul>
+ * <li> @c LEX_TOKEN - a token (see @ref Lexeme.type) </li>
+ * <li> @c LEX_BLANK - one or more spaces or tabs </li>
+ * <li> @c LEX_NEWLINE - a line break, possibly followed by more whitespace
+ *      (including more line breaks) </li>
+ * <li> @c LEX_COMMENT - a line comment (not including the line break) </li>
+ * <li> @c LEX_INVALID - a reserved word or invalid character </li>
+ * </ul>
+ */
+typedef enum LexemeKind {
+    LEX_TOKEN, LEX_BLANK, LEX_NEWLINE, LEX_COMMENT, LEX_INVALID
+} LexemeKind;
+
+/**
+ * @brief Result of scanning a single lexeme
+ */
+typedef struct Lexeme
+{
+    /**
+     * @brief Kind of lexeme
+     */
+    LexemeKind kind;
+
+    /**
+     * @brief Token type (only valid if @c kind is @c LEX_TOKEN)
+     */
+    TokenType type;
+
+    /**
+     * @brief Length of the lexeme (in characters)
+     */
+    size_t length;
+
+    /**
+     * @brief True if the scanner ran into the end of the input while deciding
+     * on this lexeme, meaning that more input could change the result (only
+     * set by @ref scan_dfa and @ref scan_table)
+     */
+    bool at_end;
+
+} Lexeme;
+
+/**
+ * @brief Position of a scanner in its input
+ *
+ * Tracks what is needed to place tokens in the source: the byte offset of the
+ * next lexeme, the current line number, and where the current line started
+ * (for computing columns).
+ */
+typedef struct ScanPosition
+{
+    /**
+     * @brief Byte offset of the next lexeme from the start of the source
+     */
+    size_t offset;
+
+    /**
+     * @brief Byte offset of the first character of the current line
+     */
+    size_t line_start;
+
+    /**
+     * @brief Current line number
+     */
+    int line;
+
+} ScanPosition;
+
+/**
+ * @brief Classify an identifier-like word
+ *
+ * Looks the word up in a perfect hash table of keywords and reserved words.
+ * Sets @c kind and @c type of the lexeme to @c LEX_TOKEN / @c KEY for keywords,
+ * @c LEX_INVALID for reserved words, and @c LEX_TOKEN / @c ID otherwise.
+ *
+ * @param text Start of the word
+ * @param lexeme Lexeme to classify (@c length must already be set and nonzero)
+ */
+void scan_classify_word (const char* text, Lexeme* lexeme);
+
+/**
+ * @brief Scan one lexeme using the hand-written DFA
+ *
+ * Recognizes exactly the same language as the regular expressions in
+ * @ref Lexer_new (including their priority order) in a single left-to-right
+ * pass. Never reads at or past @c end.
+ *
+ * @param text Start of the lexeme (must be before @c end)
+ * @param end End of the input
+ * @param lexeme Output: kind, type, and length of the lexeme
+ */
+void scan_dfa (const char* text, const char* end, Lexeme* lexeme);
+
+/**
+ * @brief Scan one lexeme using the generated DFA tables
+ *
+ * Takes the longest match of the rules in @c src/tokens.spec, which is
+ * compiled into a minimized DFA at build time by @c tools/lexgen (the
+ * definition lives in the generated @c src/lextables.c). Recognizes the same
+ * language as @ref scan_dfa and never reads at or past @c end.
+ *
+ * @param text Start of the lexeme (must be before @c end)
+ * @param end End of the input
+ * @param lexeme Output: kind, type, and length of the lexeme
+ */
+void scan_table (const char* text, const char* end, Lexeme* lexeme);
+
+/**
+ * @brief Initialize a position to the start of the source
+ *
+ * @param pos Position to initialize
+ */
+void ScanPosition_init (ScanPosition* pos);
+
+/**
+ * @brief Move a position past a lexeme
+ *
+ * @param pos Position to update (must be the start of the lexeme)
+ * @param text Text of the lexeme
+ * @param lexeme Lexeme to move past
+ */
+void ScanPosition_advance (ScanPosition* pos, const char* text,
+        const Lexeme* lexeme);
+
+#endif
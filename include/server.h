@@ -0,0 +1,227 @@
+/**
+ * @file server.h
+ * @brief Long-running lexer server over a Unix domain socket
+ *
+ * Started with <tt>decaf --serve socket</tt>. The server keeps one warm
+ * @ref Lexer (with its token pool) for its whole life, so a request only
+ * costs the lexing itself, not process startup. Requests are lexed with
+ * @ref LEX_NO_INTERN, so the server's memory does not grow with the names its
+ * clients send, even if the lexer interns.
+ *
+ * Clients connect to the socket and send any number of requests over the
+ * same connection, waiting for each response before sending the next
+ * request. All integers are 32-bit unsigned in network byte order.
+ *
+ * Request:
+ * <ol>
+ * <li> @c flags - any of @ref LEXSERVER_BINARY and @ref LEXSERVER_KEEP_GOING </li>
+ * <li> @c length - length of the source (at most #LEXSERVER_MAX_REQUEST) </li>
+ * <li> the source text (@c length bytes) </li>
+ * </ol>
+ *
+ * Response:
+ * <ol>
+ * <li> @c status - @ref LEXSERVER_OK, @ref LEXSERVER_LEX_ERROR, or
+ *      @ref LEXSERVER_BAD_REQUEST </li>
+ * <li> @c tokens_length - length of the token section </li>
+ * <li> @c errors_length - length of the error section </li>
+ * <li> the tokens: the same listing @c decaf prints, or the binary format from
+ *      tokenfile.h with @ref LEXSERVER_BINARY </li>
+ * <li> the errors: the error message, or with @ref LEXSERVER_KEEP_GOING one
+ *      <tt>&lt;input&gt;:line:column: error: message</tt> line per error (see
+ *      diagnostic.h) </li>
+ * </ol>
+ *
+ * Without @ref LEXSERVER_KEEP_GOING, the token section is empty if there is
+ * an error. After a @ref LEXSERVER_BAD_REQUEST response (e.g., a source that
+ * is too long) the server closes the connection.
+ *
+ * The main thread reads requests from all idle connections at once (with
+ * @c poll on non-blocking sockets), collecting the bytes of each request as
+ * they arrive, and only hands complete requests to a worker from a
+ * @ref ThreadPool, which lexes the source and writes the response. Idle or
+ * slow clients never tie up a worker, so any number of clients may stay
+ * connected.
+ */
+
+#ifndef __SERVER_H
+#define __SERVER_H
+
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+
+#include "p1-lexer.h"
+#include "threadpool.h"
+
+/**
+ * @brief Request flag: return the tokens in the binary format (tokenfile.h)
+ */
+#define LEXSERVER_BINARY 1
+
+/**
+ * @brief Request flag: report every invalid token and return the valid ones
+ * (see @ref Lexer_lex_recover)
+ */
+#define LEXSERVER_KEEP_GOING 2
+
+/**
+ * @brief Response status: the source was lexed without errors
+ */
+#define LEXSERVER_OK 0
+
+/**
+ * @brief Response status: the source contains invalid tokens
+ */
+#define LEXSERVER_LEX_ERROR 1
+
+/**
+ * @brief Response status: the request was malformed (the connection is closed)
+ */
+#define LEXSERVER_BAD_REQUEST 2
+
+/**
+ * @brief Largest source accepted in a single request (in bytes)
+ */
+#define LEXSERVER_MAX_REQUEST (64 * 1024 * 1024)
+
+/**
+ * @brief Size of a request header (flags and length)
+ */
+#define LEXSERVER_HEADER_SIZE 8
+
+/**
+ * @brief Seconds a client may take to send the rest of a request that has
+ * started arriving (or to accept a response) before the connection is dropped
+ */
+#define LEXSERVER_TIMEOUT 10
+
+/**
+ * @brief Client connection (used internally by the server)
+ */
+typedef struct LexConnection
+{
+    struct LexServer* server;   /**< @brief Server the client is connected to */
+    int fd;                     /**< @brief Connected socket */
+    bool busy;                  /**< @brief A worker is serving a request */
+    bool closed;                /**< @brief The connection is finished */
+    uint32_t header[2];         /**< @brief Header of the current request (as
+                                     received) */
+    uint32_t flags;             /**< @brief Flags of the current request */
+    size_t length;              /**< @brief Source length of the current
+                                     request (once the header is complete) */
+    size_t received;            /**< @brief Bytes of the current request
+                                     received so far (header included) */
+    time_t started;             /**< @brief When the current request started
+                                     arriving */
+    char* buffer;               /**< @brief Request source (reused) */
+    size_t capacity;            /**< @brief Allocated size of @c buffer */
+} LexConnection;
+
+/**
+ * @brief Lexer server state
+ *
+ * Allocate with @ref LexServer_new and de-allocate with @ref LexServer_free.
+ *
+ * Methods:
+ * - @ref LexServer_run
+ * - @ref LexServer_stop
+ */
+typedef struct LexServer
+{
+    const Lexer* lexer;             /**< @brief Shared warm lexer */
+    char* path;                     /**< @brief Path of the listening socket */
+    int listen_fd;                  /**< @brief Listening socket */
+    int wake[2];                    /**< @brief Pipe that wakes the main loop */
+    ThreadPool* pool;               /**< @brief Workers serving requests */
+    LexConnection** connections;    /**< @brief Open connections */
+    size_t count;                   /**< @brief Number of open connections */
+    size_t capacity;                /**< @brief Allocated size of @c connections */
+    volatile sig_atomic_t stopping; /**< @brief Set by @ref LexServer_stop */
+    size_t requests;                /**< @brief Number of requests served */
+    pthread_mutex_t lock;           /**< @brief Protects @c requests and the
+                                         @c busy and @c closed flags (the
+                                         main loop owns everything else in a
+                                         connection until it is busy) */
+} LexServer;
+
+/**
+ * @brief Create a server listening on a Unix domain socket
+ *
+ * A stale socket file at the path (one that no server is listening on) is
+ * replaced.
+ *
+ * @param lexer Lexer to use (must outlive the server)
+ * @param path Path of the socket to create
+ * @param nthreads Number of worker threads (at least one)
+ * @param error Output: error message (must be at least #MAX_ERROR_LEN long)
+ * @returns Newly-created server or @c NULL if the socket could not be created
+ */
+LexServer* LexServer_new (const Lexer* lexer, const char* path, int nthreads,
+        char* error);
+
+/**
+ * @brief Serve clients until @ref LexServer_stop is called
+ *
+ * @param server Server to run
+ */
+void LexServer_run (LexServer* server);
+
+/**
+ * @brief Make @ref LexServer_run return (after the requests being served are
+ * answered)
+ *
+ * Safe to call from other threads and from signal handlers.
+ *
+ * @param server Server to stop
+ */
+void LexServer_stop (LexServer* server);
+
+/**
+ * @brief Close all connections, remove the socket, and deallocate a server
+ *
+ * @param server Server to deallocate (must not be running)
+ */
+void LexServer_free (LexServer* server);
+
+/**
+ * @brief Response to a request (client side)
+ */
+typedef struct LexResponse
+{
+    uint32_t status;        /**< @brief Status code */
+    char* tokens;           /**< @brief Token section (NUL-terminated) */
+    size_t tokens_length;   /**< @brief Length of the token section */
+    char* errors;           /**< @brief Error section (NUL-terminated) */
+    size_t errors_length;   /**< @brief Length of the error section */
+} LexResponse;
+
+/**
+ * @brief Connect to a server (client side)
+ *
+ * @param path Path of the server's socket
+ * @returns Connected socket or -1 on error (see @c errno)
+ */
+int LexServer_connect (const char* path);
+
+/**
+ * @brief Send a request and wait for the response (client side)
+ *
+ * @param fd Socket from @ref LexServer_connect
+ * @param flags Request flags
+ * @param text Source to lex
+ * @param length Length of the source (in bytes)
+ * @param response Output: response (free with @ref LexResponse_free)
+ * @returns True if and only if a complete response was received
+ */
+bool LexServer_request (int fd, uint32_t flags, const char* text, size_t length,
+        LexResponse* response);
+
+/**
+ * @brief Deallocate the sections of a response
+ *
+ * @param response Response to clean up (the structure itself is not freed)
+ */
+void LexResponse_free (LexResponse* response);
+
+#endif
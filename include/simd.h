@@ -0,0 +1,119 @@
+/**
+ * @file simd.h
+ * @brief Vectorized character-class kernels used by the scanner
+ *
+ * Each kernel scans a byte range for the end of a run of characters in some
+ * class (or for the next newline), 16 (SSE2) or 32 (AVX2) bytes at a time. A
+ * scalar version of every kernel is always available, and the fastest version
+ * supported by the CPU is picked once at program start-up. Kernels never read
+ * outside of <tt>[text, end)</tt>.
+ */
+
+#ifndef __SIMD_H
+#define __SIMD_H
+
+#include "common.h"
+
+/**
+ * @brief Kernel implementations
+ *
+ * May be any of the following:
+ *
+ * <ul>
+ * <li> @c SIMD_SCALAR - one byte at a time (always available) </li>
+ * <li> @c SIMD_SSE2 - 16 bytes at a time (x86 only) </li>
+ * <li> @c SIMD_AVX2 - 32 bytes at a time (x86 only) </li>
+ * </ul>
+ */
+typedef enum SimdLevel {
+    SIMD_SCALAR, SIMD_SSE2, SIMD_AVX2
+} SimdLevel;
+
+/**
+ * @brief Find the end of a run of blanks (<tt>[ \\t]*</tt>)
+ *
+ * @param text Start of the run
+ * @param end End of the input
+ * @returns Pointer to the first character that is not a blank (or @c end)
+ */
+const char* simd_skip_blanks (const char* text, const char* end);
+
+/**
+ * @brief Find the end of a run of whitespace (<tt>[ \\t\\n]*</tt>)
+ *
+ * @param text Start of the run
+ * @param end End of the input
+ * @returns Pointer to the first character that is not whitespace (or @c end)
+ */
+const char* simd_skip_space (const char* text, const char* end);
+
+/**
+ * @brief Find the next line break
+ *
+ * @param text Where to start looking
+ * @param end End of the input
+ * @returns Pointer to the first @c '\\n' (or @c end if there is none)
+ */
+const char* simd_find_newline (const char* text, const char* end);
+
+/**
+ * @brief Count the line breaks in a range
+ *
+ * @param text Start of the range
+ * @param end End of the range
+ * @returns Number of @c '\\n' characters in the range
+ */
+size_t simd_count_newlines (const char* text, const char* end);
+
+/**
+ * @brief Find the end of a run of identifier characters
+ * (<tt>[a-zA-Z0-9_]*</tt>)
+ *
+ * @param text Start of the run
+ * @param end End of the input
+ * @returns Pointer to the first non-identifier character (or @c end)
+ */
+const char* simd_skip_word (const char* text, const char* end);
+
+/**
+ * @brief Find the end of a run of plain string literal characters
+ *
+ * Plain characters are the ones that may appear unescaped in a string literal
+ * (letters, digits, @c '\\n', @c '\\t', @c '#', space, @c '_', and @c ':'). The
+ * run stops at anything else, including quotes and backslashes.
+ *
+ * @param text Start of the run
+ * @param end End of the input
+ * @returns Pointer to the first character that is not plain (or @c end)
+ */
+const char* simd_skip_string_chars (const char* text, const char* end);
+
+/**
+ * @brief Get the kernel implementation currently in use
+ *
+ * @returns Active implementation
+ */
+SimdLevel simd_level ();
+
+/**
+ * @brief Check whether the CPU supports a kernel implementation
+ *
+ * @param level Implementation to check
+ * @returns True if and only if @ref simd_set_level would accept @c level
+ */
+bool simd_supported (SimdLevel level);
+
+/**
+ * @brief Switch to a different kernel implementation
+ *
+ * Meant for tests and benchmarks; must not be called while other threads are
+ * scanning. The @c DECAF_SIMD environment variable (@c scalar, @c sse2, or
+ * @c avx2) can also be used to limit the implementation picked at start-up.
+ *
+ * @param level Implementation to use
+ * @returns True if and only if the implementation is supported (otherwise
+ * nothing changes)
+ */
+bool simd_set_level (SimdLevel level);
+
+#endif
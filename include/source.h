@@ -0,0 +1,59 @@
+/**
+ * @file source.h
+ * @brief Reading source files into memory
+ *
+ * Regular files are memory-mapped so that they can be lexed in place without
+ * copying them, no matter how large they are. Anything that cannot be mapped
+ * (pipes, terminals, standard input) is read into a heap buffer instead.
+ */
+
+#ifndef __SOURCE_H
+#define __SOURCE_H
+
+#include "common.h"
+
+/**
+ * @brief Contents of a source file
+ *
+ * The text is always followed by a NUL character (which is not counted in
+ * @c length), so it can be passed to functions that expect a C string as well
+ * as to length-bounded ones. The text may contain NUL characters of its own.
+ *
+ * Allocate with @ref SourceBuffer_open and de-allocate with
+ * @ref SourceBuffer_free.
+ */
+typedef struct SourceBuffer
+{
+    /**
+     * @brief File contents (read-only)
+     */
+    const char* text;
+
+    /**
+     * @brief Length of the file contents (in bytes)
+     */
+    size_t length;
+
+    /**
+     * @brief Size of the memory mapping (or zero if @c text is on the heap)
+     */
+    size_t mapped_size;
+
+} SourceBuffer;
+
+/**
+ * @brief Read a source file into memory
+ *
+ * @param filename Name of file to read (or "-" for standard input)
+ * @returns Newly-created buffer, or @c NULL if the file could not be read
+ */
+SourceBuffer* SourceBuffer_open (const char* filename);
+
+/**
+ * @brief Deallocate (or unmap) a source buffer
+ *
+ * @param source Buffer to deallocate
+ */
+void SourceBuffer_free (SourceBuffer* source);
+
+#endif
@@ -0,0 +1,164 @@
+/**
+ * @file stream.h
+ * @brief Streaming (pull-based) lexer over chunked input
+ *
+ * A stream lets a consumer (e.g., the parser) receive tokens while the input
+ * is still being read. The producer feeds the input in chunks of any size, and
+ * the consumer pulls tokens out as soon as they are complete. Tokens may span
+ * chunk boundaries; the stream holds on to the unfinished part of a lexeme
+ * until enough input arrives to decide where it ends.
+ *
+ * Typical use:
+ *
+ *     LexStream* stream = LexStream_new(lexer);
+ *     while ((n = read_some(chunk)) > 0) {
+ *         LexStream_feed(stream, chunk, n);
+ *         while (LexStream_next(stream, &token) == LEXSTREAM_TOKEN) {
+ *             ... use token ...
+ *         }
+ *     }
+ *     LexStream_finish(stream);
+ *     while (LexStream_next(stream, &token) == LEXSTREAM_TOKEN) {
+ *         ... use token ...
+ *     }
+ */
+
+#ifndef __STREAM_H
+#define __STREAM_H
+
+#include "p1-lexer.h"
+
+/**
+ * @brief Result of pulling from a stream
+ *
+ * May be any of the following:
+ *
+ * <ul>
+ * <li> @c LEXSTREAM_TOKEN - a token was returned </li>
+ * <li> @c LEXSTREAM_NEED_INPUT - more input must be fed (or the stream must be
+ *      finished) before the next token is known </li>
+ * <li> @c LEXSTREAM_END - the stream is finished and all tokens were returned </li>
+ * <li> @c LEXSTREAM_ERROR - the input contains an invalid token </li>
+ * </ul>
+ */
+typedef enum LexStreamStatus {
+    LEXSTREAM_TOKEN, LEXSTREAM_NEED_INPUT, LEXSTREAM_END, LEXSTREAM_ERROR
+} LexStreamStatus;
+
+/**
+ * @brief Streaming lexer state
+ *
+ * The stream only buffers input that has not been consumed yet, so its memory
+ * use is bounded by the largest chunk plus the longest lexeme. Streams scan
+ * with the generated tables if the lexer's engine is @c LEXER_TABLE and with
+ * the DFA otherwise, because the regex engine cannot tell when a lexeme runs
+ * into the end of the available input.
+ *
+ * Allocate with @ref LexStream_new and de-allocate with @ref LexStream_free.
+ *
+ * Methods:
+ * - @ref LexStream_feed
+ * - @ref LexStream_finish
+ * - @ref LexStream_next
+ */
+typedef struct LexStream
+{
+    /**
+     * @brief Lexer that created the stream
+     */
+    const Lexer* lexer;
+
+    /**
+     * @brief Unconsumed input
+     */
+    char* buffer;
+
+    /**
+     * @brief Number of bytes in @c buffer
+     */
+    size_t length;
+
+    /**
+     * @brief Allocated size of @c buffer
+     */
+    size_t capacity;
+
+    /**
+     * @brief Index in @c buffer of the next lexeme
+     */
+    size_t start;
+
+    /**
+     * @brief Source position of the next lexeme (offsets are from the start
+     * of the whole input, not the buffer)
+     */
+    ScanPosition pos;
+
+    /**
+     * @brief True once @ref LexStream_finish has been called
+     */
+    bool finished;
+
+    /**
+     * @brief True once an invalid token has been found
+     */
+    bool failed;
+
+    /**
+     * @brief Storage for the most recently returned token
+     */
+    Token token;
+
+} LexStream;
+
+/**
+ * @brief Allocate and initialize a new stream with no input
+ *
+ * @param lexer Lexer to use (must outlive the stream)
+ * @returns Newly-created stream
+ */
+LexStream* LexStream_new (const Lexer* lexer);
+
+/**
+ * @brief Add a chunk of input to the end of a stream
+ *
+ * The chunk is copied, so it may be reused as soon as this returns. Feeding
+ * invalidates the last token returned by @ref LexStream_next.
+ *
+ * @param stream Stream to feed
+ * @param chunk Next part of the input
+ * @param length Length of the chunk (in bytes)
+ */
+void LexStream_feed (LexStream* stream, const char* chunk, size_t length);
+
+/**
+ * @brief Mark the end of the input
+ *
+ * After this, lexemes at the end of the input are treated as complete.
+ *
+ * @param stream Stream to finish
+ */
+void LexStream_finish (LexStream* stream);
+
+/**
+ * @brief Pull the next complete token from a stream
+ *
+ * The returned token (and its text) belongs to the stream and is only valid
+ * until the next call to @ref LexStream_next or @ref LexStream_feed; copy it
+ * (including its text, e.g. with @ref Token_text) to keep it.
+ *
+ * @param stream Stream to pull from
+ * @param token Output: next token (only set if the result is
+ * @c LEXSTREAM_TOKEN)
+ * @returns Status of the stream
+ */
+LexStreamStatus LexStream_next (LexStream* stream, Token** token);
+
+/**
+ * @brief Deallocate a stream
+ *
+ * @param stream Stream to deallocate
+ */
+void LexStream_free (LexStream* stream);
+
+#endif
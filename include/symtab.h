@@ -0,0 +1,146 @@
+/**
+ * @file symtab.h
+ * @brief Interned token text
+ *
+ * A @ref Lexer owns a symbol table if interning is turned on with
+ * @ref Lexer_set_interning. Each distinct identifier or string literal it
+ * lexes is then stored in the table once and numbered, and the number is
+ * stored in the token's @c symbol field. Two such tokens have the same
+ * text exactly when they have the same symbol, so later phases can compare
+ * names with an integer compare instead of @ref Token_text_eq, and can key
+ * their own tables (e.g., scopes) by symbol.
+ *
+ * The text is kept in large arena blocks that are only freed when the table
+ * is cleared or freed, so the text of a symbol never moves.
+ */
+
+#ifndef __SYMTAB_H
+#define __SYMTAB_H
+
+#include <pthread.h>
+
+#include "common.h"
+
+/**
+ * @brief Interned text identifier (numbered from 1 in order of first use)
+ */
+typedef uint32_t Symbol;
+
+/**
+ * @brief Symbol of tokens whose text was not interned (e.g., keywords and
+ * symbols, or tokens that did not come from a lexer)
+ */
+#define SYMBOL_NONE 0
+
+/**
+ * @brief Size of each block of interned text (longer strings get a block of
+ * their own)
+ */
+#define SYMTAB_BLOCK_SIZE (64 * 1024)
+
+/**
+ * @brief Interned string
+ */
+typedef struct SymbolEntry
+{
+    const char* text;   /**< @brief NUL-terminated text (in the arena) */
+    uint32_t length;    /**< @brief Length of the text (in bytes) */
+    uint32_t hash;      /**< @brief Hash of the text */
+} SymbolEntry;
+
+/**
+ * @brief Block of interned text
+ */
+typedef struct SymbolBlock
+{
+    struct SymbolBlock* next;   /**< @brief Previously-filled block */
+    size_t used;                /**< @brief Bytes used in @c data */
+    size_t size;                /**< @brief Size of @c data */
+    char data[];                /**< @brief Text */
+} SymbolBlock;
+
+/**
+ * @brief Hash table of interned strings
+ *
+ * Open addressing with linear probing; slots hold symbols (@ref SYMBOL_NONE
+ * marks an empty slot) and the table is kept at most half full. May be shared
+ * by several threads.
+ *
+ * Allocate with @ref SymbolTable_new and de-allocate with
+ * @ref SymbolTable_free.
+ *
+ * Methods:
+ * - @ref SymbolTable_intern
+ * - @ref SymbolTable_text
+ * - @ref SymbolTable_size
+ * - @ref SymbolTable_clear
+ */
+typedef struct SymbolTable
+{
+    Symbol* slots;          /**< @brief Hash slots */
+    size_t mask;            /**< @brief Number of slots minus one (a power of two) */
+    SymbolEntry* entries;   /**< @brief Interned strings, indexed by symbol */
+    size_t count;           /**< @brief Number of symbols */
+    size_t capacity;        /**< @brief Allocated size of @c entries */
+    SymbolBlock* blocks;    /**< @brief Text arena (most recent block first) */
+    size_t bytes;           /**< @brief Total length of the interned text */
+    pthread_mutex_t lock;   /**< @brief Protects everything above */
+} SymbolTable;
+
+/**
+ * @brief Allocate a new, empty table
+ *
+ * @returns Newly-created table
+ */
+SymbolTable* SymbolTable_new ();
+
+/**
+ * @brief Get the symbol of some text, adding it to the table if it is new
+ *
+ * @param table Table to look in
+ * @param text Text to intern (need not be NUL-terminated)
+ * @param length Length of the text (in bytes)
+ * @returns Symbol of the text (never @ref SYMBOL_NONE)
+ */
+Symbol SymbolTable_intern (SymbolTable* table, const char* text, size_t length);
+
+/**
+ * @brief Get the text of a symbol
+ *
+ * @param table Table the symbol came from
+ * @param symbol Symbol to look up
+ * @param length Output: length of the text (may be @c NULL)
+ * @returns NUL-terminated text (valid until the table is freed), or @c NULL
+ * if the symbol is not in the table
+ */
+const char* SymbolTable_text (SymbolTable* table, Symbol symbol, size_t* length);
+
+/**
+ * @brief Get the number of symbols in a table
+ *
+ * @param table Table to inspect
+ * @param bytes Output: total length of their text (may be @c NULL)
+ * @returns Number of distinct strings interned
+ */
+size_t SymbolTable_size (SymbolTable* table, size_t* bytes);
+
+/**
+ * @brief Remove every symbol from a table
+ *
+ * Frees the interned text (but keeps the hash slots for reuse), and numbering
+ * starts again from 1, so symbols obtained before the call must no longer be
+ * used. Meant for long-lived tables that would otherwise keep every name they
+ * have ever seen.
+ *
+ * @param table Table to clear
+ */
+void SymbolTable_clear (SymbolTable* table);
+
+/**
+ * @brief Deallocate a table and all of its text
+ *
+ * @param table Table to deallocate
+ */
+void SymbolTable_free (SymbolTable* table);
+
+#endif
@@ -0,0 +1,92 @@
+/**
+ * @file threadpool.h
+ * @brief Fixed-size pool of worker threads
+ *
+ * Tasks are run in the order they are submitted by whichever worker is free.
+ * Tasks must not use @ref Error_throw_printf unless they set up their own
+ * @c setjmp handler (the driver's handler is thread-local).
+ */
+
+#ifndef __THREADPOOL_H
+#define __THREADPOOL_H
+
+#include <pthread.h>
+
+#include "common.h"
+
+/**
+ * @brief Function run by a worker thread
+ */
+typedef void (*ThreadPoolTask) (void* arg);
+
+/**
+ * @brief Pending task (used internally by the pool)
+ */
+typedef struct ThreadPoolJob
+{
+    ThreadPoolTask task;            /**< @brief Function to run */
+    void* arg;                      /**< @brief Argument for the function */
+    struct ThreadPoolJob* next;     /**< @brief Next pending task */
+} ThreadPoolJob;
+
+/**
+ * @brief Pool of worker threads
+ *
+ * Allocate with @ref ThreadPool_new and de-allocate with @ref ThreadPool_free.
+ *
+ * Methods:
+ * - @ref ThreadPool_submit
+ * - @ref ThreadPool_wait
+ */
+typedef struct ThreadPool
+{
+    pthread_t* threads;         /**< @brief Worker threads */
+    int nthreads;               /**< @brief Number of worker threads */
+    ThreadPoolJob* head;        /**< @brief Next task to run */
+    ThreadPoolJob* tail;        /**< @brief Last task to run */
+    int active;                 /**< @brief Number of tasks currently running */
+    bool stopping;              /**< @brief Set when the pool is being freed */
+    pthread_mutex_t lock;       /**< @brief Protects all of the above */
+    pthread_cond_t work;        /**< @brief Signaled when a task is queued */
+    pthread_cond_t idle;        /**< @brief Signaled when a task finishes */
+} ThreadPool;
+
+/**
+ * @brief Start a new pool of worker threads
+ *
+ * @param nthreads Number of worker threads (at least one)
+ * @returns Newly-created pool
+ */
+ThreadPool* ThreadPool_new (int nthreads);
+
+/**
+ * @brief Queue a task to be run by a worker
+ *
+ * @param pool Pool to run the task
+ * @param task Function to run
+ * @param arg Argument to pass to the function
+ */
+void ThreadPool_submit (ThreadPool* pool, ThreadPoolTask task, void* arg);
+
+/**
+ * @brief Wait until every submitted task has finished
+ *
+ * @param pool Pool to wait for
+ */
+void ThreadPool_wait (ThreadPool* pool);
+
+/**
+ * @brief Finish all submitted tasks, stop the workers, and deallocate a pool
+ *
+ * @param pool Pool to deallocate
+ */
+void ThreadPool_free (ThreadPool* pool);
+
+/**
+ * @brief Number of processors available to run threads
+ *
+ * @returns Number of online processors (at least one)
+ */
+int ThreadPool_cpu_count ();
+
+#endif
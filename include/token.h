@@ -10,6 +10,7 @@
 #define __TOKENS_H
 
 #include "common.h"
+#include "symtab.h"
 
 /**
  * @brief Compiled regular expression
@@ -21,9 +22,23 @@
  *
  * Methods:
  * - @ref Regex_match
+ * - @ref Regex_match_span
+ * - @ref Regex_match_n
  */
 typedef regex_t Regex;
 
+/**
+ * @brief Location of a match in the text it was found in
+ *
+ * The matched text is <tt>text[start]</tt> up to (but not including)
+ * <tt>text[end]</tt>.
+ */
+typedef struct RegexSpan
+{
+    size_t start;       /**< @brief Offset of the first matched character */
+    size_t end;         /**< @brief Offset just past the last matched character */
+} RegexSpan;
+
 /**
  * @brief Allocate and compile a new regular expression
  *
@@ -36,7 +51,8 @@ Regex* Regex_new (const char* regex);
  * @brief Match a regular expression against some text.
  *
  * If the regex matches, the matched text will be written into the given match
- * buffer.
+ * buffer. Matches longer than #MAX_TOKEN_LEN - 1 characters are truncated to
+ * fit; use @ref Regex_match_span to get the full extent of a match.
  *
  * @param regex Compiled regular expression to match against
  * @param text  Text to match
@@ -45,6 +61,34 @@ Regex* Regex_new (const char* regex);
  */
 bool Regex_match (Regex *regex, const char *text, char *match);
 
+/**
+ * @brief Match a regular expression against some text without copying it
+ *
+ * @param regex Compiled regular expression to match against
+ * @param text  Text to match
+ * @param span Output: location of the match in @c text (only set if the
+ * text matched)
+ * @returns True if and only if the text matched the regular expression
+ */
+bool Regex_match_span (Regex* regex, const char* text, RegexSpan* span);
+
+/**
+ * @brief Match a regular expression against a buffer of known length
+ *
+ * Same as @ref Regex_match_span except that the text ends after @c length
+ * bytes instead of at a NUL character; nothing outside
+ * <tt>[text, text + length)</tt> is read, and NUL characters inside it are
+ * matched like any other character. Uses @c REG_STARTEND where available.
+ *
+ * @param regex Compiled regular expression to match against
+ * @param text  Text to match
+ * @param length Length of the text (in bytes)
+ * @param span Output: location of the match in @c text (only set if the
+ * text matched)
+ * @returns True if and only if the text matched the regular expression
+ */
+bool Regex_match_n (Regex* regex, const char* text, size_t length, RegexSpan* span);
+
 /**
  * @brief Deallocate a regular expression
  *
@@ -72,7 +116,13 @@ typedef enum TokenType {
 
 /**
  * @brief Single token
- * 
+ *
+ * Tokens do not store a copy of their text; instead, @c text points at the
+ * token's first character in the source buffer and @c length gives its size.
+ * The text is therefore @b not NUL-terminated, and the source buffer must
+ * outlive the token. Use @ref Token_text to get a NUL-terminated copy and
+ * @ref Token_text_eq to compare against a string.
+ *
  * Allocate with @ref Token_new and de-allocate with @ref Token_free.
  */
 typedef struct Token
@@ -83,14 +133,43 @@ typedef struct Token
     TokenType type;
 
     /**
-     * @brief Raw text of the token
+     * @brief Source line number of the first character (line breaks inside
+     * string literals count too)
      */
-    char text[MAX_TOKEN_LEN];
+    int line;
 
     /**
-     * @brief Source line number
+     * @brief Source column number (1-based, in bytes)
      */
-    int line;
+    int column;
+
+    /**
+     * @brief Length of the token's text (in characters)
+     */
+    unsigned int length;
+
+    /**
+     * @brief True if the token lives in a @ref TokenQueue's storage (and is
+     * therefore deallocated with the queue rather than by @ref Token_free)
+     */
+    bool arena;
+
+    /**
+     * @brief Interned text of identifiers and string literals (see symtab.h),
+     * or @ref SYMBOL_NONE (always, unless the lexer interns)
+     */
+    Symbol symbol;
+
+    /**
+     * @brief Byte offset of the token from the beginning of the source
+     */
+    size_t offset;
+
+    /**
+     * @brief Raw text of the token (points into the source buffer; not
+     * NUL-terminated)
+     */
+    const char* text;
 
     /**
      * @brief Pointer to next token (used to store in a list)
@@ -108,8 +187,12 @@ typedef struct Token
 const char* TokenType_to_string(TokenType type);
 
 /**
- * @brief Check string equality for tokens. Limits comparison to @c
- * MAX_TOKEN_LEN for safety.
+ * @brief Check equality of two NUL-terminated strings. Limits comparison to
+ * @c MAX_TOKEN_LEN for safety.
+ *
+ * Do not pass a token's @c text: it points into the source and is not
+ * NUL-terminated, so the comparison would run past the lexeme. Use
+ * @ref Token_text_eq to compare a token against a string.
  *
  * @param str1 First string to compare
  * @param str2 Second string to compare
@@ -121,30 +204,101 @@ bool token_str_eq(const char* str1, const char* str2);
  * @brief Allocate and initialize a new token
  *
  * Make sure Token_free() is called to deallocate the token, otherwise there
- * will be a memory leak.
+ * will be a memory leak. The text is not copied, so it must outlive the token.
+ * The column and offset are initialized to zero.
  *
  * @param type Type of new token
- * @param text Raw text for new token
+ * @param text Raw text for new token (need not be NUL-terminated)
+ * @param length Length of the text
  * @param line Line number of new token
  * @returns Newly-created token
  */
-Token* Token_new (TokenType type, const char* text, int line);
+Token* Token_new (TokenType type, const char* text, size_t length, int line);
+
+/**
+ * @brief Copy the text of a token into a buffer as a NUL-terminated string
+ *
+ * The text is truncated if the buffer is too small.
+ *
+ * @param token Token to copy
+ * @param buffer Destination buffer
+ * @param size Size of the destination buffer (must be at least one)
+ * @returns The destination buffer
+ */
+char* Token_text (const Token* token, char* buffer, size_t size);
+
+/**
+ * @brief Check whether the text of a token is equal to a string
+ *
+ * @param token Token to check
+ * @param str NUL-terminated string to compare against
+ * @return True if the strings are equal; false otherwise
+ */
+bool Token_text_eq (const Token* token, const char* str);
+
+/**
+ * @brief Find where a token ends in the source
+ *
+ * Together with the token's @c line and @c column (and @c offset and
+ * @c length for bytes), this gives the token's full span. Only string
+ * literals can span several lines, so this looks at the text of the token
+ * but never at the rest of the source.
+ *
+ * @param token Token to measure
+ * @param line Output: line just past the token's last character
+ * @param column Output: column just past the token's last character
+ */
+void Token_end (const Token* token, int* line, int* column);
+
+/**
+ * @brief Check whether two tokens have the same text
+ *
+ * If both tokens were interned (by the same lexer), this is a single integer
+ * compare; otherwise the text is compared.
+ *
+ * @param token1 First token to compare
+ * @param token2 Second token to compare
+ * @return True if the texts are equal; false otherwise
+ */
+bool Token_same_text (const Token* token1, const Token* token2);
 
 /**
  * @brief Deallocate a token
  *
+ * Does nothing for tokens that are stored in a @ref TokenQueue (including ones
+ * that have been removed from it); those are deallocated with the queue.
+ *
  * @param token Token to deallocate
  */
 void Token_free (Token* token);
 
 /**
- * @brief Linked list of tokens
- * 
+ * @brief Number of tokens in each block of a @ref TokenQueue's storage
+ */
+#define TOKEN_CHUNK_SIZE 512
+
+/**
+ * @brief Queue of tokens
+ *
+ * Tokens are stored contiguously in fixed-size blocks owned by the queue, so
+ * adding a token rarely allocates, the whole queue is freed in a handful of
+ * calls, and any token can be looked up by index. The tokens are also linked
+ * together through their @c next pointers, so the queue can be walked like a
+ * linked list (e.g., with @ref FOR_EACH).
+ *
+ * @ref TokenQueue_remove returns a separately-allocated token that the
+ * caller owns (and must release with @ref Token_free), so it stays valid after
+ * the queue is deallocated. @ref TokenQueue_next avoids that allocation: it
+ * returns the token in the queue's own storage, which remains valid only until
+ * the queue is deallocated.
+ *
  * Allocate with @ref TokenQueue_new and de-allocate with @ref TokenQueue_free.
  * 
  * Methods:
  * - @ref TokenQueue_peek
+ * - @ref TokenQueue_get
  * - @ref TokenQueue_remove
+ * - @ref TokenQueue_next
  * - @ref TokenQueue_is_empty
  * - @ref TokenQueue_size
  * - @ref TokenQueue_print
@@ -161,6 +315,37 @@ typedef struct TokenQueue
      */
     Token* tail;
 
+    /**
+     * @brief Blocks of @ref TOKEN_CHUNK_SIZE tokens
+     */
+    Token** chunks;
+
+    /**
+     * @brief Number of allocated blocks
+     */
+    size_t chunk_count;
+
+    /**
+     * @brief Capacity of the @c chunks array
+     */
+    size_t chunk_capacity;
+
+    /**
+     * @brief Index of the front of the queue (number of tokens removed)
+     */
+    size_t first;
+
+    /**
+     * @brief Number of tokens ever added to the queue
+     */
+    size_t count;
+
+    /**
+     * @brief Pool that the blocks come from and go back to (or @c NULL to use
+     * the system allocator directly)
+     */
+    struct TokenPool* pool;
+
 } TokenQueue;
 
 /**
@@ -170,14 +355,53 @@ typedef struct TokenQueue
  */
 TokenQueue* TokenQueue_new ();
 
+/**
+ * @brief Allocate a new, empty queue whose storage comes from a pool
+ *
+ * The queue keeps a reference to the pool (see tokenpool.h) and returns its
+ * blocks to it when it is deallocated.
+ *
+ * @param pool Pool to take storage blocks from
+ * @returns Newly-created queue of tokens
+ */
+TokenQueue* TokenQueue_new_pooled (struct TokenPool* pool);
+
 /**
  * @brief Add a token to a queue
  *
+ * The token is copied into the queue's storage and then deallocated, so the
+ * queue takes ownership of it and the original pointer must not be used again.
+ *
  * @param queue Queue to add to
  * @param token Token to add
  */
 void TokenQueue_add (TokenQueue* queue, Token* token);
 
+/**
+ * @brief Create a new token directly in a queue's storage
+ *
+ * This is the same as @ref TokenQueue_add with @ref Token_new but does not
+ * allocate a separate token. The column and offset are initialized to zero.
+ *
+ * @param queue Queue to add to
+ * @param type Type of new token
+ * @param text Raw text for new token (need not be NUL-terminated)
+ * @param length Length of the text
+ * @param line Line number of new token
+ * @returns Newly-added token (owned by the queue)
+ */
+Token* TokenQueue_emplace (TokenQueue* queue, TokenType type,
+        const char* text, size_t length, int line);
+
+/**
+ * @brief Copy all remaining tokens of one queue to the end of another
+ *
+ * @param queue Queue to add to
+ * @param other Queue to copy from (not modified)
+ * @param line_delta Amount to add to the line number of each copied token
+ */
+void TokenQueue_append (TokenQueue* queue, TokenQueue* other, int line_delta);
+
 /**
  * @brief Return the next token from a queue without removing it
  * (first-in-first-out)
@@ -187,14 +411,55 @@ void TokenQueue_add (TokenQueue* queue, Token* token);
  */
 Token* TokenQueue_peek (TokenQueue* queue);
 
+/**
+ * @brief Look at a token ahead in a queue without removing anything
+ *
+ * @param queue Queue to look at
+ * @param index Position from the front of the queue (0 is the same as
+ * @ref TokenQueue_peek)
+ * @returns Token at the given position (or <tt>NULL</tt> if there is none)
+ */
+Token* TokenQueue_get (TokenQueue* queue, size_t index);
+
+/**
+ * @brief Replace a range of tokens in a queue with new (blank) slots
+ *
+ * Tokens after the range are moved so that the queue stays contiguous, so
+ * pointers to them are no longer valid afterwards.
+ *
+ * @param queue Queue to modify
+ * @param index Position of the range from the front of the queue
+ * @param removed Number of tokens to remove
+ * @param added Number of slots to insert (to be filled in by the caller)
+ * @returns First inserted slot (or @c NULL if @c added is zero)
+ */
+Token* TokenQueue_splice (TokenQueue* queue, size_t index, size_t removed,
+        size_t added);
+
 /**
  * @brief Remove a token from a queue (first-in-first-out)
  *
+ * The caller owns the returned token and must deallocate it with
+ * @ref Token_free; it remains valid after the queue is deallocated (its text
+ * still points into the source).
+ *
  * @param queue Queue to remove from
- * @returns Token removed
+ * @returns Token removed (or @c NULL if the queue is empty)
  */
 Token* TokenQueue_remove (TokenQueue* queue);
 
+/**
+ * @brief Remove a token from a queue without copying it (first-in-first-out)
+ *
+ * Faster than @ref TokenQueue_remove, but the returned token stays in the
+ * queue's storage: it must not be passed to @ref Token_free and is only valid
+ * until the queue is deallocated.
+ *
+ * @param queue Queue to remove from
+ * @returns Token removed (or @c NULL if the queue is empty)
+ */
+Token* TokenQueue_next (TokenQueue* queue);
+
 /**
  * @brief Check whether a queue is empty
  *
@@ -222,7 +487,7 @@ void TokenQueue_print (TokenQueue* queue, FILE* out);
 /**
  * @brief Deallocate a token queue
  *
- * Also deallocates any remaining tokens
+ * Also deallocates all of its tokens (including ones already removed)
  *
  * @param queue Queue to deallocate
  */
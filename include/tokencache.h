@@ -0,0 +1,97 @@
+/**
+ * @file tokencache.h
+ * @brief On-disk cache of lexed token streams
+ *
+ * Entries are token files (see tokenfile.h) named after a hash of the source
+ * text, its length, and #LEXER_VERSION, so changing either the source or the
+ * lexer automatically misses. Entries are written to a temporary file and
+ * renamed into place, so concurrent compilers (threads or processes) never
+ * see a partial entry. When the directory grows past its size limit, the
+ * least recently used entries are deleted.
+ */
+
+#ifndef __TOKENCACHE_H
+#define __TOKENCACHE_H
+
+#include <pthread.h>
+
+#include "common.h"
+#include "tokenfile.h"
+
+/**
+ * @brief Default size limit of a cache directory (in bytes)
+ */
+#define TOKENCACHE_DEFAULT_SIZE (64 * 1024 * 1024)
+
+/**
+ * @brief Token cache
+ *
+ * May be shared by several threads.
+ *
+ * Allocate with @ref TokenCache_new and de-allocate with @ref TokenCache_free.
+ *
+ * Methods:
+ * - @ref TokenCache_lookup
+ * - @ref TokenCache_store
+ * - @ref TokenCache_clear
+ */
+typedef struct TokenCache
+{
+    char* dir;              /**< @brief Cache directory */
+    size_t max_size;        /**< @brief Size limit of the directory (in bytes) */
+    size_t hits;            /**< @brief Number of successful lookups */
+    size_t misses;          /**< @brief Number of failed lookups */
+    size_t stores;          /**< @brief Number of entries written */
+    size_t evictions;       /**< @brief Number of entries deleted to save space */
+    pthread_mutex_t lock;   /**< @brief Protects the counters and eviction */
+} TokenCache;
+
+/**
+ * @brief Open (and create if needed) a cache directory
+ *
+ * @param dir Directory to use
+ * @param max_size Size limit of the directory (in bytes)
+ * @returns Newly-created cache or @c NULL if the directory cannot be used
+ */
+TokenCache* TokenCache_new (const char* dir, size_t max_size);
+
+/**
+ * @brief Look up the tokens for a source text
+ *
+ * @param cache Cache to search
+ * @param text Source text
+ * @param length Length of the source text
+ * @param file Output: memory-mapped entry (release with @ref TokenFile_close)
+ * @returns True on a hit and false on a miss
+ */
+bool TokenCache_lookup (TokenCache* cache, const char* text, size_t length,
+        TokenFile* file);
+
+/**
+ * @brief Store the tokens for a source text
+ *
+ * Errors are ignored (the cache is only an optimization).
+ *
+ * @param cache Cache to add to
+ * @param text Source text
+ * @param length Length of the source text
+ * @param tokens Tokens lexed from the text
+ */
+void TokenCache_store (TokenCache* cache, const char* text, size_t length,
+        TokenQueue* tokens);
+
+/**
+ * @brief Delete every entry in a cache
+ *
+ * @param cache Cache to clear
+ */
+void TokenCache_clear (TokenCache* cache);
+
+/**
+ * @brief Deallocate a cache (the directory is left as is)
+ *
+ * @param cache Cache to deallocate
+ */
+void TokenCache_free (TokenCache* cache);
+
+#endif
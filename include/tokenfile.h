@@ -0,0 +1,165 @@
+/**
+ * @file tokenfile.h
+ * @brief Compact binary token stream format
+ *
+ * A token file holds a whole @ref TokenQueue so that downstream tools (and the
+ * token cache) can load tokens without lexing or parsing the text listing
+ * again. The layout is:
+ *
+ * <ol>
+ * <li> a @ref TokenFileHeader </li>
+ * <li> @c token_count fixed-width @ref TokenRecord entries </li>
+ * <li> a string table of @c strings_size bytes holding the token texts (each
+ *      distinct text is stored once) </li>
+ * </ol>
+ *
+ * All fields are stored in the byte order of the machine that wrote the file;
+ * readers reject files written with a different byte order.
+ *
+ * Write with @ref TokenQueue_write_binary; read (without allocating) with
+ * @ref TokenFile_open or @ref TokenFile_init.
+ */
+
+#ifndef __TOKENFILE_H
+#define __TOKENFILE_H
+
+#include "common.h"
+#include "token.h"
+
+/**
+ * @brief Magic number at the start of every token file ("DTOK")
+ */
+#define TOKENFILE_MAGIC 0x4b4f5444u
+
+/**
+ * @brief Current version of the format
+ */
+#define TOKENFILE_VERSION 1
+
+/**
+ * @brief Value of @ref TokenFileHeader.byte_order as written
+ */
+#define TOKENFILE_BYTE_ORDER 0x01020304u
+
+/**
+ * @brief Token file header
+ */
+typedef struct TokenFileHeader
+{
+    uint32_t magic;         /**< @brief Always #TOKENFILE_MAGIC */
+    uint32_t version;       /**< @brief Always #TOKENFILE_VERSION */
+    uint32_t byte_order;    /**< @brief Always #TOKENFILE_BYTE_ORDER */
+    uint32_t token_count;   /**< @brief Number of records */
+    uint32_t strings_size;  /**< @brief Size of the string table (in bytes) */
+    uint32_t reserved;      /**< @brief Always zero */
+} TokenFileHeader;
+
+/**
+ * @brief Token file record (one per token)
+ */
+typedef struct TokenRecord
+{
+    uint32_t type;          /**< @brief Token type (@ref TokenType) */
+    uint32_t line;          /**< @brief Line number */
+    uint32_t column;        /**< @brief Column number */
+    uint32_t offset;        /**< @brief Byte offset in the source */
+    uint32_t text;          /**< @brief Offset of the text in the string table */
+    uint32_t length;        /**< @brief Length of the text (in bytes) */
+} TokenRecord;
+
+/**
+ * @brief Read-only view of a token file
+ *
+ * Points directly into the file's bytes (memory-mapped by @ref TokenFile_open
+ * or supplied by the caller to @ref TokenFile_init), so walking the tokens
+ * does not allocate anything.
+ *
+ * Methods:
+ * - @ref TokenFile_size
+ * - @ref TokenFile_get
+ * - @ref TokenFile_to_queue
+ * - @ref TokenFile_close
+ */
+typedef struct TokenFile
+{
+    const TokenFileHeader* header;  /**< @brief File header */
+    const TokenRecord* records;     /**< @brief Token records */
+    const char* strings;            /**< @brief String table */
+    void* map;                      /**< @brief Mapping to release (or @c NULL) */
+    size_t map_size;                /**< @brief Size of @c map */
+} TokenFile;
+
+/**
+ * @brief Write a queue in the binary token format
+ *
+ * Only the tokens still in the queue (not yet removed) are written.
+ *
+ * @param queue Queue to write
+ * @param out Stream to write to
+ * @returns True if and only if the whole file was written (it fails if the
+ * queue is too large for the format's 32-bit fields or on I/O errors)
+ */
+bool TokenQueue_write_binary (TokenQueue* queue, FILE* out);
+
+/**
+ * @brief View a token file that is already in memory
+ *
+ * Validates the header and every record, so that later accesses cannot go out
+ * of bounds. The data must stay valid while the view is in use.
+ *
+ * @param file View to initialize
+ * @param data Start of the file contents (must be 4-byte aligned)
+ * @param size Size of the file contents
+ * @returns True if and only if the data is a valid token file
+ */
+bool TokenFile_init (TokenFile* file, const void* data, size_t size);
+
+/**
+ * @brief Memory-map and view a token file
+ *
+ * @param file View to initialize (release with @ref TokenFile_close)
+ * @param filename Name of the file to open
+ * @returns True if and only if the file could be read and is valid
+ */
+bool TokenFile_open (TokenFile* file, const char* filename);
+
+/**
+ * @brief Get the number of tokens in a token file
+ *
+ * @param file File to check
+ * @returns Number of tokens
+ */
+size_t TokenFile_size (const TokenFile* file);
+
+/**
+ * @brief Look up a token by position
+ *
+ * Fills in a caller-provided token whose text points into the file's string
+ * table; nothing is allocated. The token's @c next field is set to @c NULL.
+ *
+ * @param file File to read from
+ * @param index Zero-based index (must be less than @ref TokenFile_size)
+ * @param token Output: the token
+ */
+void TokenFile_get (const TokenFile* file, size_t index, Token* token);
+
+/**
+ * @brief Copy all tokens of a file into a new queue
+ *
+ * Token texts point into the file's string table, so the file must stay open
+ * while the queue is in use.
+ *
+ * @param file File to read from
+ * @returns Newly-created queue of tokens
+ */
+TokenQueue* TokenFile_to_queue (const TokenFile* file);
+
+/**
+ * @brief Release a token file view (unmaps the file if it was opened with
+ * @ref TokenFile_open)
+ *
+ * @param file View to release
+ */
+void TokenFile_close (TokenFile* file);
+
+#endif
@@ -0,0 +1,128 @@
+/**
+ * @file tokenpool.h
+ * @brief Recycling pool for token storage blocks
+ *
+ * A @ref TokenQueue stores its tokens in blocks of #TOKEN_CHUNK_SIZE tokens.
+ * A queue created from a pool takes its blocks from the pool's free list and
+ * gives them back when it is freed (or shrinks), so a long-running process
+ * that lexes one program after another reuses the same memory instead of
+ * going back to the system allocator (and faulting in fresh pages) for every
+ * compilation. Each @ref Lexer owns a pool that its queues use.
+ *
+ * Free blocks are kept on an intrusive list (linked through the first token
+ * of each block) up to a limit; blocks returned past the limit are released
+ * to the system.
+ */
+
+#ifndef __TOKENPOOL_H
+#define __TOKENPOOL_H
+
+#include <pthread.h>
+
+#include "common.h"
+#include "token.h"
+
+/**
+ * @brief Default number of free blocks a pool keeps (24 MiB with 48-byte tokens)
+ */
+#define TOKENPOOL_DEFAULT_BLOCKS 1024
+
+/**
+ * @brief Pool usage counters (for sizing the pool)
+ */
+typedef struct TokenPoolStats
+{
+    size_t block_size;      /**< @brief Size of each block (in bytes) */
+    size_t allocated;       /**< @brief Blocks obtained from the system allocator */
+    size_t reused;          /**< @brief Blocks handed out again from the free list */
+    size_t released;        /**< @brief Blocks given back to the system (pool full) */
+    size_t in_use;          /**< @brief Blocks currently held by queues */
+    size_t peak_in_use;     /**< @brief Most blocks ever held by queues at once */
+    size_t free;            /**< @brief Blocks currently on the free list */
+    size_t max_free;        /**< @brief Limit on the free list */
+} TokenPoolStats;
+
+/**
+ * @brief Pool of token storage blocks
+ *
+ * May be shared by several threads. The pool is reference-counted: the
+ * creator and every queue using it hold a reference, so it stays alive until
+ * the last of them is freed, in any order.
+ *
+ * Allocate with @ref TokenPool_new and de-allocate with
+ * @ref TokenPool_release.
+ *
+ * Methods:
+ * - @ref TokenPool_take
+ * - @ref TokenPool_give
+ * - @ref TokenPool_get_stats
+ * - @ref TokenPool_set_limit
+ */
+typedef struct TokenPool
+{
+    Token* free_list;           /**< @brief First free block (or @c NULL) */
+    TokenPoolStats stats;       /**< @brief Usage counters */
+    size_t refs;                /**< @brief Number of references */
+    pthread_mutex_t lock;       /**< @brief Protects everything above */
+} TokenPool;
+
+/**
+ * @brief Allocate a new, empty pool
+ *
+ * @param max_free Maximum number of free blocks to keep
+ * @returns Newly-created pool (holding one reference)
+ */
+TokenPool* TokenPool_new (size_t max_free);
+
+/**
+ * @brief Add a reference to a pool
+ *
+ * @param pool Pool to keep alive
+ * @returns The same pool
+ */
+TokenPool* TokenPool_retain (TokenPool* pool);
+
+/**
+ * @brief Get a block of #TOKEN_CHUNK_SIZE tokens (uninitialized)
+ *
+ * @param pool Pool to take from
+ * @returns Recycled or newly-allocated block
+ */
+Token* TokenPool_take (TokenPool* pool);
+
+/**
+ * @brief Return a block obtained from @ref TokenPool_take
+ *
+ * @param pool Pool the block came from
+ * @param block Block to return
+ */
+void TokenPool_give (TokenPool* pool, Token* block);
+
+/**
+ * @brief Get a copy of a pool's usage counters
+ *
+ * @param pool Pool to inspect
+ * @param stats Output: usage counters
+ */
+void TokenPool_get_stats (TokenPool* pool, TokenPoolStats* stats);
+
+/**
+ * @brief Change the number of free blocks a pool keeps
+ *
+ * Free blocks beyond the new limit are released immediately (so a limit of
+ * zero empties the pool).
+ *
+ * @param pool Pool to configure
+ * @param max_free Maximum number of free blocks to keep
+ */
+void TokenPool_set_limit (TokenPool* pool, size_t max_free);
+
+/**
+ * @brief Drop a reference to a pool, deallocating it (and its free blocks)
+ * when it was the last one
+ *
+ * @param pool Pool to release
+ */
+void TokenPool_release (TokenPool* pool);
+
+#endif
@@ -1,3 +1,8 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <unistd.h>
+
 #include "common.h"
 
 const char* DecafType_to_string(DecafType type)
@@ -14,14 +19,126 @@ const char* DecafType_to_string(DecafType type)
 
 void print_escaped_string(const char* string, FILE* output)
 {
-    for (int i = 0; i < strlen(string); i++) {
-        /* escape special characters */
-        switch (string[i]) {
-            case '\n':  fprintf(output, "\\n");  break;
-            case '\t':  fprintf(output, "\\t");  break;
-            case '\"':  fprintf(output, "\\\""); break;
-            case '\\':  fprintf(output, "\\\\"); break;
-            default:    fprintf(output, "%c", string[i]); break;
+    /* callers interleave many short strings with other stdio output, so this
+     * goes through the stream's own buffer rather than an OutputBuffer */
+    const char* run = string;
+    for (const char* p = string; ; p++) {
+        /* escape special characters; copy everything else in runs */
+        const char* escape;
+        switch (*p) {
+            case '\n':  escape = "\\n";  break;
+            case '\t':  escape = "\\t";  break;
+            case '\"':  escape = "\\\""; break;
+            case '\\':  escape = "\\\\"; break;
+            case '\0':  escape = NULL;   break;
+            default:    continue;
+        }
+        if (p > run) {
+            fwrite(run, 1, (size_t)(p - run), output);
+        }
+        if (escape == NULL) {
+            break;
+        }
+        fwrite(escape, 1, 2, output);
+        run = p + 1;
+    }
+}
+
+/**
+ * @brief Per-thread storage shared by every @ref OutputBuffer on the thread
+ */
+static _Thread_local char output_storage[OUTPUT_BUFFER_SIZE];
+
+void OutputBuffer_init (OutputBuffer* buffer, FILE* out)
+{
+    buffer->out = out;
+    buffer->fd = fileno(out);
+    buffer->data = output_storage;
+    buffer->length = 0;
+    buffer->capacity = OUTPUT_BUFFER_SIZE;
+}
+
+void OutputBuffer_write (OutputBuffer* buffer, const char* text, size_t length)
+{
+    while (length > 0) {
+        if (buffer->length == buffer->capacity) {
+            OutputBuffer_flush(buffer);
+        }
+        size_t space = buffer->capacity - buffer->length;
+        size_t n = (length < space ? length : space);
+        memcpy(buffer->data + buffer->length, text, n);
+        buffer->length += n;
+        text += n;
+        length -= n;
+    }
+}
+
+void OutputBuffer_putc (OutputBuffer* buffer, char c)
+{
+    if (buffer->length == buffer->capacity) {
+        OutputBuffer_flush(buffer);
+    }
+    buffer->data[buffer->length++] = c;
+}
+
+void OutputBuffer_write_padded (OutputBuffer* buffer, const char* text, int width)
+{
+    size_t length = strlen(text);
+    OutputBuffer_write(buffer, text, length);
+    for (int i = (int)length; i < width; i++) {
+        OutputBuffer_putc(buffer, ' ');
+    }
+}
+
+void OutputBuffer_write_int (OutputBuffer* buffer, int value, int width)
+{
+    char digits[16];
+    int n = 0;
+    unsigned int magnitude = (value < 0 ? 0u - (unsigned int)value : (unsigned int)value);
+    do {
+        digits[n++] = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude > 0);
+
+    if (value < 0) {
+        OutputBuffer_putc(buffer, '-');
+        width--;
+    }
+    for (int i = n; i < width; i++) {
+        OutputBuffer_putc(buffer, '0');
+    }
+    while (n > 0) {
+        OutputBuffer_putc(buffer, digits[--n]);
+    }
+}
+
+void OutputBuffer_flush (OutputBuffer* buffer)
+{
+    if (buffer->length == 0) {
+        return;
+    }
+    if (buffer->fd < 0) {
+        fwrite(buffer->data, 1, buffer->length, buffer->out);
+        buffer->length = 0;
+        return;
+    }
+
+    /* anything the stream itself still holds must come out first */
+    fflush(buffer->out);
+    const char* p = buffer->data;
+    size_t left = buffer->length;
+    while (left > 0) {
+        ssize_t written = write(buffer->fd, p, left);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            /* let the stream record the error */
+            fwrite(p, 1, left, buffer->out);
+            break;
         }
+        p += written;
+        left -= (size_t)written;
     }
+    buffer->length = 0;
 }
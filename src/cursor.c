@@ -0,0 +1,100 @@
+/**
+ * @file cursor.c
+ * @brief Lazy (on-demand) token cursor over an in-memory buffer
+ */
+#include "cursor.h"
+
+LexCursor* LexCursor_new (const Lexer* lexer, const char* text, size_t length,
+        size_t lookahead)
+{
+    LexCursor* cursor = (LexCursor*)calloc(1, sizeof(LexCursor));
+    CHECK_MALLOC_PTR(cursor)
+    cursor->lexer = lexer;
+    cursor->text = text;
+    cursor->length = (text == NULL ? 0 : length);
+    cursor->lookahead = (lookahead < 1 ? 1 : lookahead);
+    ScanPosition_init(&cursor->pos);
+
+    /* one extra slot keeps the last consumed token alive while peeking */
+    size_t size = 2;
+    while (size < cursor->lookahead + 1) {
+        size *= 2;
+    }
+    cursor->window = (Token*)malloc(size * sizeof(Token));
+    CHECK_MALLOC_PTR(cursor->window)
+    cursor->mask = size - 1;
+    return cursor;
+}
+
+/**
+ * @brief Scan lexemes until one more token has been added to the window
+ *
+ * @returns True if and only if a token was added (false at the end of the
+ * input or on an invalid token)
+ */
+static bool fill (LexCursor* cursor)
+{
+    const char* end = cursor->text + cursor->length;
+    Lexeme lexeme;
+
+    while (!cursor->failed && cursor->pos.offset < cursor->length) {
+        const char* p = cursor->text + cursor->pos.offset;
+        Lexer_scan(cursor->lexer, p, end, &lexeme);
+
+        if (lexeme.kind == LEX_INVALID) {
+            snprintf(cursor->error, MAX_ERROR_LEN, "Invalid token!\n");
+            cursor->failed = true;
+            return false;
+        }
+
+        Token* token = NULL;
+        if (lexeme.kind == LEX_TOKEN) {
+            token = &cursor->window[(cursor->head + cursor->count) & cursor->mask];
+            token->type = lexeme.type;
+            token->line = cursor->pos.line;
+            token->column = (int)(cursor->pos.offset - cursor->pos.line_start) + 1;
+            token->length = (unsigned int)lexeme.length;
+            token->arena = true;    /* owned by the cursor */
+            token->offset = cursor->pos.offset;
+            token->text = p;
+            token->symbol = Lexer_intern(cursor->lexer, lexeme.type, p, lexeme.length);
+            token->next = NULL;
+            cursor->count++;
+        }
+        ScanPosition_advance(&cursor->pos, p, &lexeme);
+        if (token != NULL) {
+            return true;
+        }
+    }
+    return false;
+}
+
+Token* LexCursor_peek (LexCursor* cursor, size_t k)
+{
+    if (k >= cursor->lookahead) {
+        return NULL;
+    }
+    while (cursor->count <= k) {
+        if (!fill(cursor)) {
+            return NULL;
+        }
+    }
+    return &cursor->window[(cursor->head + k) & cursor->mask];
+}
+
+Token* LexCursor_next (LexCursor* cursor)
+{
+    if (cursor->count == 0 && !fill(cursor)) {
+        return NULL;
+    }
+    Token* token = &cursor->window[cursor->head];
+    cursor->head = (cursor->head + 1) & cursor->mask;
+    cursor->count--;
+    return token;
+}
+
+void LexCursor_free (LexCursor* cursor)
+{
+    free(cursor->window);
+    free(cursor);
+}
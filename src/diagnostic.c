@@ -0,0 +1,104 @@
+/**
+ * @file diagnostic.c
+ * @brief Positioned lexer error reports
+ */
+#include <ctype.h>
+
+#include "diagnostic.h"
+
+/**
+ * @brief Longest excerpt of the source quoted in a message
+ */
+#define EXCERPT_LEN 32
+
+void LexDiagnostics_init (LexDiagnostics* list)
+{
+    list->items = NULL;
+    list->count = 0;
+    list->capacity = 0;
+}
+
+void LexDiagnostics_add (LexDiagnostics* list, LexErrorKind kind,
+        const ScanPosition* pos, size_t length)
+{
+    if (kind == LEX_ERROR_CHARACTER && list->count > 0) {
+        LexDiagnostic* last = &list->items[list->count - 1];
+        if (last->kind == LEX_ERROR_CHARACTER &&
+                last->offset + last->length == pos->offset) {
+            last->length += length;
+            return;
+        }
+    }
+
+    if (list->count == list->capacity) {
+        list->capacity = (list->capacity == 0 ? 8 : list->capacity * 2);
+        list->items = (LexDiagnostic*)realloc(list->items,
+                list->capacity * sizeof(LexDiagnostic));
+        CHECK_MALLOC_PTR(list->items)
+    }
+    LexDiagnostic* d = &list->items[list->count++];
+    d->kind = kind;
+    d->line = pos->line;
+    d->column = (int)(pos->offset - pos->line_start) + 1;
+    d->offset = pos->offset;
+    d->length = length;
+}
+
+/**
+ * @brief Quote (part of) the offending text, escaping unprintable characters
+ */
+static void quote_excerpt (const char* text, size_t length, char* buffer, size_t size)
+{
+    size_t used = 0;
+    for (size_t i = 0; i < length && i < EXCERPT_LEN && used + 5 < size; i++) {
+        unsigned char c = (unsigned char)text[i];
+        if (isprint(c)) {
+            buffer[used++] = (char)c;
+        } else {
+            used += (size_t)snprintf(buffer + used, size - used, "\\x%02x", c);
+        }
+    }
+    if (length > EXCERPT_LEN && used + 3 < size) {
+        memcpy(buffer + used, "...", 3);
+        used += 3;
+    }
+    buffer[used] = '\0';
+}
+
+void LexDiagnostic_format (const LexDiagnostic* diagnostic, const char* text,
+        char* buffer, size_t size)
+{
+    char excerpt[4 * EXCERPT_LEN + 8];
+    quote_excerpt(text + diagnostic->offset, diagnostic->length, excerpt,
+            sizeof(excerpt));
+
+    switch (diagnostic->kind) {
+        case LEX_ERROR_CHARACTER:
+            snprintf(buffer, size, "invalid %s '%s'",
+                    diagnostic->length == 1 ? "character" : "characters", excerpt);
+            break;
+        case LEX_ERROR_RESERVED_WORD:
+            snprintf(buffer, size, "reserved word '%s'", excerpt);
+            break;
+        case LEX_ERROR_STRING:
+            snprintf(buffer, size, "invalid string literal '%s'", excerpt);
+            break;
+    }
+}
+
+void LexDiagnostics_print (const LexDiagnostics* list, const char* filename,
+        const char* text, FILE* out)
+{
+    char message[MAX_ERROR_LEN];
+    for (size_t i = 0; i < list->count; i++) {
+        const LexDiagnostic* d = &list->items[i];
+        LexDiagnostic_format(d, text, message, sizeof(message));
+        fprintf(out, "%s:%d:%d: error: %s\n", filename, d->line, d->column, message);
+    }
+}
+
+void LexDiagnostics_free (LexDiagnostics* list)
+{
+    free(list->items);
+    LexDiagnostics_init(list);
+}
@@ -0,0 +1,189 @@
+/**
+ * @file lexstats.c
+ * @brief Optional lexer profiling counters
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <time.h>
+
+#include "lexstats.h"
+
+/**
+ * @brief Process-wide totals
+ */
+static LexStats totals;
+
+/**
+ * @brief Protects @ref totals
+ */
+static pthread_mutex_t totals_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief Counts of the current thread that have not been flushed yet
+ */
+static _Thread_local LexStats local;
+
+/**
+ * @brief Display names of the rules (in @ref LexRule order)
+ */
+static const char* rule_names[LEX_RULE_COUNT] = {
+    "whitespace", "newline", "comment", "hex", "letter", "keyword",
+    "numbers", "or_equal", "grouping", "symbols", "strings"
+};
+
+/**
+ * @brief Display names of the phases (in @ref LexPhase order)
+ */
+static const char* phase_names[LEX_PHASE_COUNT] = {
+    "read", "lex", "print"
+};
+
+bool LexStats_enabled ()
+{
+#ifdef DECAF_STATS
+    return true;
+#else
+    return false;
+#endif
+}
+
+void LexStats_get (LexStats* stats)
+{
+    pthread_mutex_lock(&totals_lock);
+    *stats = totals;
+    pthread_mutex_unlock(&totals_lock);
+}
+
+void LexStats_reset ()
+{
+    pthread_mutex_lock(&totals_lock);
+    memset(&totals, 0, sizeof(totals));
+    pthread_mutex_unlock(&totals_lock);
+}
+
+uint64_t LexStats_now ()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+void LexStats_record_rule (LexRule rule, bool matched, uint64_t start)
+{
+    local.rules[rule].attempts++;
+    local.rules[rule].matches += matched;
+    local.rules[rule].nanoseconds += LexStats_now() - start;
+}
+
+void LexStats_record_dfa (const char* text, const Lexeme* lexeme, uint64_t start)
+{
+    uint64_t elapsed = LexStats_now() - start;
+    LexRule rule;
+    switch (lexeme->kind) {
+        case LEX_BLANK:
+            rule = LEX_RULE_WHITESPACE;
+            break;
+        case LEX_NEWLINE:
+            rule = LEX_RULE_NEWLINE;
+            break;
+        case LEX_COMMENT:
+            rule = LEX_RULE_COMMENT;
+            break;
+        case LEX_TOKEN:
+            switch (lexeme->type) {
+                case HEXLIT: rule = LEX_RULE_HEX;     break;
+                case DECLIT: rule = LEX_RULE_NUMBERS; break;
+                case STRLIT: rule = LEX_RULE_STRINGS; break;
+                case ID:
+                case KEY:
+                    /* every word is also looked up as a keyword */
+                    rule = LEX_RULE_LETTER;
+                    local.rules[LEX_RULE_KEYWORD].attempts++;
+                    local.rules[LEX_RULE_KEYWORD].matches += (lexeme->type == KEY);
+                    break;
+                case SYM:
+                default:
+                    if (lexeme->length == 2 && text[1] == '=') {
+                        rule = LEX_RULE_OR_EQUAL;
+                    } else if (strchr("(){}[],;", text[0]) != NULL) {
+                        rule = LEX_RULE_GROUPING;
+                    } else {
+                        rule = LEX_RULE_SYMBOLS;
+                    }
+                    break;
+            }
+            break;
+        case LEX_INVALID:
+        default:
+            return;
+    }
+    local.rules[rule].attempts++;
+    local.rules[rule].matches++;
+    local.rules[rule].nanoseconds += elapsed;
+}
+
+void LexStats_record_token (TokenType type, size_t length)
+{
+    local.tokens[type]++;
+    local.token_bytes[type] += length;
+}
+
+void LexStats_record_lexeme (size_t length)
+{
+    local.lexemes++;
+    local.bytes += length;
+}
+
+void LexStats_record_phase (LexPhase phase, uint64_t start)
+{
+    uint64_t elapsed = LexStats_now() - start;
+    pthread_mutex_lock(&totals_lock);
+    totals.phase_nanoseconds[phase] += elapsed;
+    pthread_mutex_unlock(&totals_lock);
+}
+
+void LexStats_flush ()
+{
+    pthread_mutex_lock(&totals_lock);
+    for (int i = 0; i < LEX_RULE_COUNT; i++) {
+        totals.rules[i].attempts += local.rules[i].attempts;
+        totals.rules[i].matches += local.rules[i].matches;
+        totals.rules[i].nanoseconds += local.rules[i].nanoseconds;
+    }
+    for (int i = 0; i < LEXSTATS_TOKEN_TYPES; i++) {
+        totals.tokens[i] += local.tokens[i];
+        totals.token_bytes[i] += local.token_bytes[i];
+    }
+    totals.lexemes += local.lexemes;
+    totals.bytes += local.bytes;
+    pthread_mutex_unlock(&totals_lock);
+    memset(&local, 0, sizeof(local));
+}
+
+void LexStats_print (const LexStats* stats, FILE* out)
+{
+    fprintf(out, "%-12s %12s\n", "phase", "seconds");
+    for (int i = 0; i < LEX_PHASE_COUNT; i++) {
+        fprintf(out, "%-12s %12.6f\n", phase_names[i],
+                (double)stats->phase_nanoseconds[i] / 1e9);
+    }
+
+    fprintf(out, "\n%-12s %12s %12s %12s %12s\n", "rule", "attempts", "matches",
+            "seconds", "ns/attempt");
+    for (int i = 0; i < LEX_RULE_COUNT; i++) {
+        const LexRuleStats* r = &stats->rules[i];
+        fprintf(out, "%-12s %12" PRIu64 " %12" PRIu64 " %12.6f %12.1f\n",
+                rule_names[i], r->attempts, r->matches, (double)r->nanoseconds / 1e9,
+                r->attempts > 0 ? (double)r->nanoseconds / (double)r->attempts : 0.0);
+    }
+
+    fprintf(out, "\n%-12s %12s %12s\n", "token", "count", "bytes");
+    for (int i = 0; i < LEXSTATS_TOKEN_TYPES; i++) {
+        fprintf(out, "%-12s %12" PRIu64 " %12" PRIu64 "\n",
+                TokenType_to_string((TokenType)i), stats->tokens[i],
+                stats->token_bytes[i]);
+    }
+    fprintf(out, "%-12s %12" PRIu64 " %12" PRIu64 "\n", "(lexemes)",
+            stats->lexemes, stats->bytes);
+}
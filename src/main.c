@@ -2,18 +2,26 @@
  * @file main.c
  * @brief Compiler driver
  */
+#define _POSIX_C_SOURCE 200809L
 
+#include "lexstats.h"
 #include "p1-lexer.h"
+#include "server.h"
+#include "source.h"
+#include "threadpool.h"
+#include "tokencache.h"
+#include "tokenfile.h"
 
 /**
- * @brief Error message buffer
+ * @brief Error message buffer (one per thread)
  */
-char decaf_error_msg[MAX_ERROR_LEN];
+_Thread_local char decaf_error_msg[MAX_ERROR_LEN];
 
 /**
  * @brief Data structure used by @c setjmp / @c longjmp for exception handling
+ * (one per thread, so that each worker can have its own handler)
  */
-jmp_buf decaf_error;
+_Thread_local jmp_buf decaf_error;
 
 /**
  * @brief Throw an exception with an error message using printf syntax
@@ -34,33 +42,263 @@ void Error_throw_printf (const char* format, ...)
 }
 
 /**
- * @brief Read all text data from a file
+ * @brief Work item for compiling one input file
+ */
+typedef struct FileJob
+{
+    const char* filename;       /**< @brief Name of the input file */
+    const Lexer* lexer;         /**< @brief Shared lexer */
+    TokenCache* cache;          /**< @brief Shared token cache (or @c NULL) */
+    FILE* direct;               /**< @brief Print here instead of buffering
+                                     (or @c NULL) */
+    bool binary;                /**< @brief Write the binary token format
+                                     instead of a listing */
+    bool keep_going;            /**< @brief Report every invalid token
+                                     instead of stopping */
+    char* output;               /**< @brief Buffered output */
+    size_t output_size;         /**< @brief Length of the buffered output */
+    char* report;               /**< @brief Buffered diagnostics (or @c NULL
+                                     if none) */
+    size_t report_size;         /**< @brief Length of @c report */
+    char error[MAX_ERROR_LEN];  /**< @brief Error message (if not @c ok) */
+    bool ok;                    /**< @brief True if the file compiled */
+    bool done;                  /**< @brief True once the job has finished */
+} FileJob;
+
+/**
+ * @brief Protects @c FileJob.done
+ */
+static pthread_mutex_t jobs_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief Signaled whenever a job finishes
+ */
+static pthread_cond_t job_done = PTHREAD_COND_INITIALIZER;
+
+/**
+ * @brief Compile a single file (run directly or by a worker thread)
  *
- * @param filename Name of file to read
- * @param text String buffer destination (must be #MAX_FILE_SIZE characters long)
- * @returns True if and only if the file read was successful.
+ * @param arg The @ref FileJob to run
  */
-bool read_file (const char* filename, char* text)
+static void compile_file (void* arg)
 {
-    FILE* input = fopen(filename, "r");
-    if (input == NULL) {
-        return false;
-    }
-    size_t nchars = 0;
-    char* p = text;
-    int c;
-    while (nchars < MAX_FILE_SIZE && (c = fgetc(input)) != EOF) {
-        *p++ = (char)c;
-        nchars++;
-    }
-    *p = '\0';
-    fclose(input);
-    return true;
+    FileJob* job = (FileJob*)arg;
+
+    /* read file (mapped into memory, so there is no size limit) */
+    LEXSTATS_START(read_start);
+    SourceBuffer* source = SourceBuffer_open(job->filename);
+    LEXSTATS_PHASE(LEX_PHASE_READ, read_start);
+    if (source == NULL) {
+        snprintf(job->error, MAX_ERROR_LEN, "Could not read file: %s",
+                job->filename);
+    } else {
+
+        /* PROJECT 1: lexer (skipped if the tokens are cached) */
+        LEXSTATS_START(lex_start);
+        TokenFile cached;
+        TokenQueue* tokens = NULL;
+        bool hit = job->cache != NULL && TokenCache_lookup(job->cache,
+                source->text, source->length, &cached);
+        if (hit) {
+            tokens = TokenFile_to_queue(&cached);
+        } else if (job->keep_going) {
+            LexDiagnostics diagnostics;
+            LexDiagnostics_init(&diagnostics);
+            tokens = Lexer_lex_recover(job->lexer, source->text, source->length,
+                    &diagnostics);
+            if (diagnostics.count > 0) {
+                FILE* report = open_memstream(&job->report, &job->report_size);
+                CHECK_MALLOC_PTR(report)
+                const char* name = (strcmp(job->filename, "-") == 0 ?
+                        "<stdin>" : job->filename);
+                LexDiagnostics_print(&diagnostics, name, source->text, report);
+                fclose(report);
+            } else if (job->cache != NULL) {
+                TokenCache_store(job->cache, source->text, source->length,
+                        tokens);
+            }
+            LexDiagnostics_free(&diagnostics);
+        } else {
+            tokens = Lexer_try_lex_n(job->lexer, source->text,
+                    source->length, job->error);
+            if (tokens != NULL && job->cache != NULL) {
+                TokenCache_store(job->cache, source->text, source->length,
+                        tokens);
+            }
+        }
+        LEXSTATS_PHASE(LEX_PHASE_LEX, lex_start);
+
+        /* output */
+        LEXSTATS_START(print_start);
+        if (tokens != NULL) {
+            FILE* out = job->direct;
+            if (out == NULL) {
+                out = open_memstream(&job->output, &job->output_size);
+                CHECK_MALLOC_PTR(out)
+            }
+            job->ok = true;
+            if (!job->binary) {
+                TokenQueue_print(tokens, out);
+            } else if (!TokenQueue_write_binary(tokens, out)) {
+                snprintf(job->error, MAX_ERROR_LEN,
+                        "Could not write tokens: %s", job->filename);
+                job->ok = false;
+            }
+            if (out != job->direct) {
+                fclose(out);
+            }
+            TokenQueue_free(tokens);
+        }
+        if (job->report != NULL) {
+            job->ok = false;
+        }
+        LEXSTATS_PHASE(LEX_PHASE_PRINT, print_start);
+        if (hit) {
+            TokenFile_close(&cached);
+        }
+        SourceBuffer_free(source);
+    }
+
+    pthread_mutex_lock(&jobs_lock);
+    job->done = true;
+    pthread_cond_broadcast(&job_done);
+    pthread_mutex_unlock(&jobs_lock);
+}
+
+/**
+ * @brief Get the value of a command-line option
+ *
+ * Accepts both <tt>-xVALUE</tt> and <tt>-x VALUE</tt>.
+ *
+ * @param argc Number of command-line arguments
+ * @param argv Array of command-line argument strings
+ * @param index Index of the option; moved past a separate value
+ * @returns Option value or @c NULL if it is missing
+ */
+static const char* option_value (int argc, char** argv, int* index)
+{
+    const char* value = argv[*index] + 2;
+    if (*value == '\0') {
+        value = (*index + 1 < argc ? argv[++(*index)] : NULL);
+    }
+    return value;
+}
+
+/**
+ * @brief Server run by <tt>--serve</tt> (for the signal handler)
+ */
+static LexServer* serving = NULL;
+
+/**
+ * @brief Signal handler that shuts down the server
+ */
+static void stop_serving (int signum)
+{
+    if (serving != NULL) {
+        LexServer_stop(serving);
+    }
+}
+
+/**
+ * @brief Print <tt>--stats</tt> statistics on standard error
+ *
+ * @param lexer Lexer to report on
+ */
+static void print_stats (const Lexer* lexer)
+{
+    fflush(stdout);
+    if (LexStats_enabled()) {
+        LexStats totals;
+        LexStats_get(&totals);
+        LexStats_print(&totals, stderr);
+    }
+    TokenPoolStats pool_stats;
+    TokenPool_get_stats(lexer->pool, &pool_stats);
+    fprintf(stderr, "token pool: %zu-byte blocks, %zu allocated, %zu reused, "
+            "%zu released, %zu peak in use, %zu free\n", pool_stats.block_size,
+            pool_stats.allocated, pool_stats.reused, pool_stats.released,
+            pool_stats.peak_in_use, pool_stats.free);
+}
+
+/**
+ * @brief Run <tt>decaf --serve</tt> until it is interrupted
+ *
+ * @param path Path of the socket to listen on
+ * @param nthreads Number of worker threads (0 for one per CPU)
+ * @param stats Print statistics at the end
+ * @returns @c EXIT_SUCCESS if the server ran and @c EXIT_FAILURE otherwise
+ */
+static int serve (const char* path, int nthreads, bool stats)
+{
+    char error[MAX_ERROR_LEN];
+    Lexer* lexer = Lexer_new(LEXER_DFA);
+    serving = LexServer_new(lexer, path,
+            nthreads == 0 ? ThreadPool_cpu_count() : nthreads, error);
+    if (serving == NULL) {
+        fprintf(stderr, "%s", error);
+        Lexer_free(lexer);
+        return EXIT_FAILURE;
+    }
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = stop_serving;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    LexServer_run(serving);
+
+    size_t requests = serving->requests;
+    LexServer* server = serving;
+    serving = NULL;
+    LexServer_free(server);
+    if (stats) {
+        print_stats(lexer);
+        fprintf(stderr, "server: %zu requests served\n", requests);
+    }
+    Lexer_free(lexer);
+    return EXIT_SUCCESS;
 }
 
 /**
  * @brief Compiler entry point
  *
+ * Usage:
+ * <tt>decaf [--stats] [-k] [-j threads] [-c cache-dir [-C MiB]] file...</tt>
+ * or <tt>decaf -b [-k] [-c cache-dir [-C MiB]] file</tt>
+ * or <tt>decaf [--stats] [-j threads] --serve socket</tt>
+ *
+ * With a single file, the output is exactly the token listing; a large file
+ * is split across the worker threads (see @ref Lexer_try_lex_parallel). With
+ * several files, they are compiled in parallel by a pool of worker threads,
+ * and each file's listing is printed (in the order given) after a line with
+ * its name. Errors are reported per file, and compilation continues with the
+ * others.
+ *
+ * With @c -k, lexing continues after invalid tokens (see
+ * @ref Lexer_lex_recover): the valid tokens are printed as usual, and every
+ * error is reported on standard error as <tt>file:line:column: error: ...</tt>
+ * (the exit status is still a failure).
+ *
+ * With @c -b, the tokens of a single file are written to standard output in
+ * the binary format from tokenfile.h instead of as a listing.
+ *
+ * With <tt>-c dir</tt>, lexed tokens are cached in the given directory (see
+ * tokencache.h), which is limited to <tt>-C MiB</tt> (default 64); the number
+ * of cache hits and misses is reported on standard error at the end.
+ *
+ * With <tt>--stats</tt>, token pool usage (see tokenpool.h) and per-rule and
+ * per-phase lexer statistics (see lexstats.h) are printed on standard error
+ * at the end; the lexer statistics require a build with
+ * <tt>make STATS=1</tt>.
+ *
+ * With <tt>--serve socket</tt>, no files are compiled; instead, a lexer server
+ * (see server.h) listens on the given Unix domain socket and lexes the source
+ * that clients send, using <tt>-j</tt> worker threads (default one per CPU),
+ * until it gets @c SIGINT or @c SIGTERM. With <tt>--stats</tt>, the number of
+ * requests served is also printed at the end.
+ *
  * @param argc Number of command-line arguments
  * @param argv Array of command-line argument strings
  * @returns @c EXIT_SUCCESS if the compilation succeeds and @c EXIT_FAILURE
@@ -68,44 +306,161 @@ bool read_file (const char* filename, char* text)
  */
 int main(int argc, char** argv)
 {
-    /* check for filename */
-    if (argc != 2) {
-        fprintf(stderr, "Usage: %s <decaf-filename>\n", argv[0]);
-        return EXIT_FAILURE;
+    /* parse options */
+    int nthreads = 0;
+    bool binary = false;
+    bool keep_going = false;
+    const char* cache_dir = NULL;
+    int cache_mb = TOKENCACHE_DEFAULT_SIZE / (1024 * 1024);
+    int first = 1;
+    bool stats = false;
+    const char* serve_path = NULL;
+    bool usage = false;
+    while (first < argc && argv[first][0] == '-' && argv[first][1] != '\0' &&
+            !usage) {
+        const char* value = NULL;
+        if (strcmp(argv[first], "--stats") == 0) {
+            stats = true;
+            first++;
+            continue;
+        }
+        if (strcmp(argv[first], "--serve") == 0) {
+            serve_path = (first + 1 < argc ? argv[first + 1] : NULL);
+            usage = serve_path == NULL;
+            first += 2;
+            continue;
+        }
+        switch (argv[first][1]) {
+            case 'b':
+                binary = true;
+                usage = argv[first][2] != '\0';
+                break;
+            case 'k':
+                keep_going = true;
+                usage = argv[first][2] != '\0';
+                break;
+            case 'j':
+                value = option_value(argc, argv, &first);
+                nthreads = (value != NULL ? atoi(value) : 0);
+                usage = nthreads < 1;
+                break;
+            case 'c':
+                cache_dir = option_value(argc, argv, &first);
+                usage = cache_dir == NULL;
+                break;
+            case 'C':
+                value = option_value(argc, argv, &first);
+                cache_mb = (value != NULL ? atoi(value) : 0);
+                usage = cache_mb < 1;
+                break;
+            default:
+                usage = true;
+                break;
+        }
+        first++;
     }
-    char* filename = argv[argc-1];
 
-    /* read file */
-    char text[MAX_FILE_SIZE];
-    if (!read_file(filename, text)) {
-        fprintf(stderr, "Could not read file: %s", filename);
-        exit(EXIT_FAILURE);
+    /* check for filenames (binary output only makes sense for one file) */
+    int nfiles = argc - first;
+    if (serve_path != NULL && !usage && nfiles == 0 && !binary && !keep_going &&
+            cache_dir == NULL) {
+        return serve(serve_path, nthreads, stats);
+    }
+    if (usage || nfiles < 1 || (binary && nfiles > 1) || serve_path != NULL) {
+        fprintf(stderr, "Usage: %s [--stats] [-k] [-j <threads>] "
+                        "[-c <cache-dir> [-C <MiB>]] <decaf-filename | ->...\n"
+                        "       %s -b [-k] [-c <cache-dir> [-C <MiB>]] "
+                        "<decaf-filename | ->\n"
+                        "       %s [--stats] [-j <threads>] --serve <socket>\n",
+                        argv[0], argv[0], argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (stats && !LexStats_enabled()) {
+        fprintf(stderr, "%s: built without lexer statistics "
+                "(rebuild with 'make clean; make STATS=1')\n", argv[0]);
     }
 
-    /* FRONT END */
-
-    TokenQueue* tokens = NULL;
-
-    /* fatal errors are possible in the front end, so check for them */
-    if (setjmp(decaf_error) == 0) {
+    TokenCache* cache = NULL;
+    if (cache_dir != NULL) {
+        cache = TokenCache_new(cache_dir, (size_t)cache_mb * 1024 * 1024);
+        if (cache == NULL) {
+            fprintf(stderr, "Could not use cache directory: %s\n", cache_dir);
+        }
+    }
 
-        /* PROJECT 1: lexer */
-        tokens = lex(text);
+    Lexer* lexer = Lexer_new(LEXER_DFA);
+    FileJob* jobs = (FileJob*)calloc(nfiles, sizeof(FileJob));
+    CHECK_MALLOC_PTR(jobs)
+    for (int i = 0; i < nfiles; i++) {
+        jobs[i].filename = argv[first + i];
+        jobs[i].lexer = lexer;
+        jobs[i].binary = binary;
+        jobs[i].keep_going = keep_going;
+        jobs[i].cache = cache;
+    }
 
+    ThreadPool* pool = NULL;
+    if (nfiles == 1) {
+        /* single file: print straight to stdout */
+        Lexer_set_threads(lexer,
+                nthreads == 0 ? ThreadPool_cpu_count() : nthreads);
+        jobs[0].direct = stdout;
+        compile_file(&jobs[0]);
     } else {
-
-        /* handle fatal error: print message and clean up */
-        fprintf(stderr, "%s", decaf_error_msg);
-        if (tokens != NULL) TokenQueue_free(tokens);
-        exit(EXIT_FAILURE);
+        if (nthreads == 0) {
+            nthreads = ThreadPool_cpu_count();
+        }
+        pool = ThreadPool_new(nthreads < nfiles ? nthreads : nfiles);
+        for (int i = 0; i < nfiles; i++) {
+            ThreadPool_submit(pool, compile_file, &jobs[i]);
+        }
     }
 
-    /* output */
-    TokenQueue_print(tokens, stdout);
+    /* report results in order as soon as each one is ready */
+    bool ok = true;
+    for (int i = 0; i < nfiles; i++) {
+        pthread_mutex_lock(&jobs_lock);
+        while (!jobs[i].done) {
+            pthread_cond_wait(&job_done, &jobs_lock);
+        }
+        pthread_mutex_unlock(&jobs_lock);
+
+        if (nfiles > 1) {
+            printf("%s:\n", jobs[i].filename);
+        }
+        if ((jobs[i].ok || jobs[i].report != NULL) && jobs[i].output != NULL) {
+            fwrite(jobs[i].output, 1, jobs[i].output_size, stdout);
+        }
+        if (jobs[i].report != NULL) {
+            fflush(stdout);
+            fwrite(jobs[i].report, 1, jobs[i].report_size, stderr);
+        } else if (!jobs[i].ok && nfiles > 1) {
+            fflush(stdout);
+            size_t len = strlen(jobs[i].error);
+            fprintf(stderr, "%s: %s%s", jobs[i].filename, jobs[i].error,
+                    (len > 0 && jobs[i].error[len-1] == '\n') ? "" : "\n");
+        } else if (!jobs[i].ok) {
+            fprintf(stderr, "%s", jobs[i].error);
+        }
+        ok = ok && jobs[i].ok;
+        free(jobs[i].output);
+        free(jobs[i].report);
+    }
 
     /* clean up */
-    TokenQueue_free(tokens);
-    tokens = NULL;
+    if (pool != NULL) {
+        ThreadPool_free(pool);
+    }
+    free(jobs);
+    if (cache != NULL) {
+        fprintf(stderr, "cache: %zu hits, %zu misses\n", cache->hits,
+                cache->misses);
+        TokenCache_free(cache);
+    }
+    if (stats) {
+        print_stats(lexer);
+    }
+    Lexer_free(lexer);
 
-    return EXIT_SUCCESS;
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
 }
@@ -3,91 +3,366 @@
  * @brief Compiler phase 1: lexer
  * Vivian Stewart and Katie Brasacchio
  */
+#include <ctype.h>
+#include <pthread.h>
+
+#include "lexstats.h"
 #include "p1-lexer.h"
+#include "simd.h"
 
-TokenQueue* lex (char* text)
+Lexer* Lexer_new (LexerEngine engine)
 {
-    TokenQueue* tokens = TokenQueue_new();
+    Lexer* lexer = (Lexer*)calloc(1, sizeof(Lexer));
+    CHECK_MALLOC_PTR(lexer)
+    lexer->engine = engine;
+    lexer->threads = 1;
+    lexer->pool = TokenPool_new(TOKENPOOL_DEFAULT_BLOCKS);
+    if (engine != LEXER_REGEX) {
+        return lexer;
+    }
 
     /* compile regular expressions */
-    Regex* keyword = Regex_new("^(def|if|else|while|return|break|continue|int|bool|void|true|false)\\b");
-    Regex* reserved = Regex_new("^(for|callout|class|interface|extends|implements|new|this|string|float|double|null)\\b");
-    Regex* whitespace = Regex_new("^[ \t]");
-    Regex* newline = Regex_new("^\n");
-    Regex* letter = Regex_new("^[a-zA-Z]([0-9]|[a-zA-Z]|_)*");
-    Regex* numbers = Regex_new("^(0|[1-9]+[0]*)");
-    Regex* grouping = Regex_new("^(\\(|\\)|\\{|\\}|\\[|\\]|\\,|\\;)");
-    Regex* symbols = Regex_new("^(\\+|\\*|\\=|\\-|\\%|&&|!|>|<|\\/|\\|\\|)");
-    Regex* or_equal = Regex_new("^(<|>|=|!)=");
-    Regex* strings = Regex_new("^\"([a-zA-Z]|[0-9]|\n|\t|\\\\\"|\\\\|#| |_|:)*\"");
-    Regex* hex = Regex_new("^(0x)([0-9]|[a-f])*");
-    Regex* comment = Regex_new("^(\\/\\/)");
-
-    int line_count = 1;
-    /* read and handle input */
-    char match[MAX_TOKEN_LEN];
+    lexer->whitespace = Regex_new("^[ \t]");
+    lexer->newline = Regex_new("^\n");
+    lexer->letter = Regex_new("^[a-zA-Z]([0-9]|[a-zA-Z]|_)*");
+    lexer->numbers = Regex_new("^(0|[1-9]+[0]*)");
+    lexer->grouping = Regex_new("^(\\(|\\)|\\{|\\}|\\[|\\]|\\,|\\;)");
+    lexer->symbols = Regex_new("^(\\+|\\*|\\=|\\-|\\%|&&|!|>|<|\\/|\\|\\|)");
+    lexer->or_equal = Regex_new("^(<|>|=|!)=");
+    lexer->strings = Regex_new("^\"([a-zA-Z]|[0-9]|\n|\t|\\\\\"|\\\\|#| |_|:)*\"");
+    lexer->hex = Regex_new("^(0x)([0-9]|[a-f])*");
+    lexer->comment = Regex_new("^(\\/\\/)");
+
+    return lexer;
+}
+
+/**
+ * @brief Try a single regular expression (counted if statistics are enabled)
+ */
+static bool match_rule (Regex* regex, LexRule rule, const char* text,
+        const char* end, RegexSpan* match)
+{
+    LEXSTATS_START(start);
+    bool matched = Regex_match_n(regex, text, (size_t)(end - text), match);
+    LEXSTATS_RULE(rule, matched, start);
+    return matched;
+}
+
+/**
+ * @brief Scan one lexeme by trying each regular expression in priority order
+ *
+ * @param lexer Lexer with compiled regular expressions
+ * @param text Start of the lexeme
+ * @param end End of the input
+ * @param lexeme Output: kind, type, and length of the lexeme
+ */
+static void scan_regex (const Lexer* lexer, const char* text, const char* end,
+        Lexeme* lexeme)
+{
+    /* all patterns are anchored, so matches always start at the text */
+    RegexSpan match = { 0, 0 };
 
+    lexeme->kind = LEX_TOKEN;
+    lexeme->at_end = false;
+    if (match_rule(lexer->whitespace, LEX_RULE_WHITESPACE, text, end, &match)) {
+        lexeme->kind = LEX_BLANK;
+    } else if (match_rule(lexer->newline, LEX_RULE_NEWLINE, text, end, &match)) {
+        lexeme->kind = LEX_NEWLINE;
+    } else if (match_rule(lexer->comment, LEX_RULE_COMMENT, text, end, &match)) {
+        /* comment runs up to (but not including) the end of the line */
+        const char* p = simd_find_newline(text, end);
+        lexeme->kind = LEX_COMMENT;
+        lexeme->length = (size_t)(p - text);
+        return;
+    } else if (match_rule(lexer->hex, LEX_RULE_HEX, text, end, &match)) {
+        lexeme->type = HEXLIT;
+    } else if (match_rule(lexer->letter, LEX_RULE_LETTER, text, end, &match)) {
+        /* keywords and reserved words are looked up in a perfect hash */
+        lexeme->length = match.end;
+        LEXSTATS_START(start);
+        scan_classify_word(text, lexeme);
+        LEXSTATS_RULE(LEX_RULE_KEYWORD, lexeme->type == KEY, start);
+        return;
+    } else if (match_rule(lexer->numbers, LEX_RULE_NUMBERS, text, end, &match)) {
+        lexeme->type = DECLIT;
+    } else if (match_rule(lexer->or_equal, LEX_RULE_OR_EQUAL, text, end, &match)) {
+        lexeme->type = SYM;
+    } else if (match_rule(lexer->grouping, LEX_RULE_GROUPING, text, end, &match)) {
+        lexeme->type = SYM;
+    } else if (match_rule(lexer->symbols, LEX_RULE_SYMBOLS, text, end, &match)) {
+        lexeme->type = SYM;
+    } else if (match_rule(lexer->strings, LEX_RULE_STRINGS, text, end, &match)) {
+        lexeme->type = STRLIT;
+    } else {
+        lexeme->kind = LEX_INVALID;
+    }
+    lexeme->length = match.end;
+}
+
+void Lexer_scan (const Lexer* lexer, const char* text, const char* end,
+        Lexeme* lexeme)
+{
+    if (lexer->engine == LEXER_REGEX) {
+        scan_regex(lexer, text, end, lexeme);
+        return;
+    }
+    LEXSTATS_START(start);
+    if (lexer->engine == LEXER_DFA) {
+        scan_dfa(text, end, lexeme);
+    } else {
+        scan_table(text, end, lexeme);
+    }
+    LEXSTATS_DFA(text, lexeme, start);
+}
+
+TokenQueue* Lexer_lex (const Lexer* lexer, const char* text)
+{
     if (text == NULL)
     {
         Error_throw_printf("Invalid token!\n");
     }
-    
-    while (*text != '\0') {
+    return Lexer_lex_n(lexer, text, strlen(text));
+}
 
-        if (Regex_match(whitespace, text, match)) {
-            /* ignore whitespace */
-        } else if (Regex_match(newline, text, match)) {
-            line_count++;
-        }else if (Regex_match(comment, text, match)) {
-            while (*text != '\n'){
-                text += 1;
-            }
-            text--;
-            line_count++;
-        } else if (Regex_match(reserved, text, match)) {
-            Error_throw_printf("Invalid token!\n");
-        } else if (Regex_match(hex, text, match)) {
-            TokenQueue_add(tokens, Token_new(HEXLIT, match, line_count)); 
-        } else if (Regex_match(letter, text, match)) {
-            // char* fullText = text;
-            if (Regex_match(keyword, text, match)) {
-                TokenQueue_add(tokens, Token_new(KEY, match, line_count)); 
-            } else {
-                TokenQueue_add(tokens, Token_new(ID, match, line_count)); 
-                // text += strlen(match);
+TokenQueue* Lexer_lex_n (const Lexer* lexer, const char* text, size_t length)
+{
+    char error[MAX_ERROR_LEN];
+    TokenQueue* tokens = Lexer_try_lex_n(lexer, text, length, error);
+    if (tokens == NULL) {
+        Error_throw_printf("%s", error);
+    }
+    return tokens;
+}
+
+TokenQueue* Lexer_try_lex_n (const Lexer* lexer, const char* text, size_t length,
+        char* error)
+{
+    return Lexer_try_lex_n_opts(lexer, text, length, 0, error);
+}
+
+TokenQueue* Lexer_try_lex_n_opts (const Lexer* lexer, const char* text,
+        size_t length, int options, char* error)
+{
+    if (text == NULL)
+    {
+        snprintf(error, MAX_ERROR_LEN, "Invalid token!\n");
+        return NULL;
+    }
+
+    if (lexer->threads > 1 && length >= 2 * LEXER_MIN_PARALLEL_CHUNK) {
+        return Lexer_try_lex_parallel(lexer, text, length, lexer->threads,
+                options, error);
+    }
+    return Lexer_try_lex_serial(lexer, text, length, options, error);
+}
+
+TokenQueue* Lexer_try_lex_serial (const Lexer* lexer, const char* text,
+        size_t length, int options, char* error)
+{
+    TokenQueue* tokens = TokenQueue_new_pooled(lexer->pool);
+    ScanPosition pos;
+    ScanPosition_init(&pos);
+    if (!Lexer_lex_range(lexer, text, length, length, &pos, tokens, options,
+                error)) {
+        TokenQueue_free(tokens);
+        return NULL;
+    }
+    return tokens;
+}
+
+bool Lexer_lex_range (const Lexer* lexer, const char* text, size_t length,
+        size_t stop, ScanPosition* pos, TokenQueue* tokens, int options,
+        char* error)
+{
+    const char* end = text + length;
+    Lexeme lexeme;
+
+    while (pos->offset < stop && pos->offset < length) {
+        const char* p = text + pos->offset;
+
+        Lexer_scan(lexer, p, end, &lexeme);
+
+        switch (lexeme.kind) {
+            case LEX_TOKEN: {
+                Token* token = TokenQueue_emplace(tokens, lexeme.type,
+                        p, lexeme.length, pos->line);
+                token->column = (int)(pos->offset - pos->line_start) + 1;
+                token->offset = pos->offset;
+                token->symbol = (options & LEX_NO_INTERN ? SYMBOL_NONE :
+                        Lexer_intern(lexer, lexeme.type, p, lexeme.length));
+                LEXSTATS_TOKEN(lexeme.type, lexeme.length);
+                break;
             }
-        } else if (Regex_match(numbers, text, match)) {
-            TokenQueue_add(tokens, Token_new(DECLIT, match, line_count)); 
-        } else if (Regex_match(or_equal, text, match)) {
-            TokenQueue_add(tokens, Token_new(SYM, match, line_count)); 
-        } else if ( Regex_match(grouping, text, match)) {
-            TokenQueue_add(tokens, Token_new(SYM, match, line_count)); 
-        } else if ( Regex_match(symbols, text, match)) {
-            TokenQueue_add(tokens, Token_new(SYM, match, line_count)); 
-        } else if (Regex_match(strings, text, match)) {
-            TokenQueue_add(tokens, Token_new(STRLIT, match, line_count)); 
-        } else {
-            Error_throw_printf("Invalid token!\n");
+            case LEX_BLANK:
+            case LEX_NEWLINE:
+            case LEX_COMMENT:
+                /* ignore whitespace and comments */
+                break;
+            case LEX_INVALID:
+                snprintf(error, MAX_ERROR_LEN, "Invalid token!\n");
+                LEXSTATS_FLUSH();
+                return false;
         }
- 
+
         /* skip matched text to look for next token */
-        text += strlen(match);
-    }
- 
-    /* clean up */
-    Regex_free(keyword);
-    Regex_free(reserved);
-    Regex_free(whitespace);
-    Regex_free(letter);
-    Regex_free(numbers);
-    Regex_free(symbols);
-    Regex_free(grouping);
-    Regex_free(or_equal);
-    Regex_free(strings);
-    Regex_free(hex);
-    Regex_free(comment);
-    Regex_free(newline);
- 
+        LEXSTATS_LEXEME(lexeme.length);
+        ScanPosition_advance(pos, p, &lexeme);
+    }
+
+    LEXSTATS_FLUSH();
+    return true;
+}
+
+/**
+ * @brief Decide how much text to skip after an invalid lexeme
+ *
+ * Reserved words are skipped whole, and a bad string literal is skipped up to
+ * its closing quote (or the end of its line if there is none on that line).
+ * Anything else is skipped one character at a time. The skipped text never
+ * contains a line break, so only the offset of the position has to move.
+ *
+ * @param lexer Lexer that found the invalid lexeme
+ * @param text Start of the invalid lexeme
+ * @param end End of the input
+ * @param kind Output: kind of error
+ * @returns Number of bytes to skip (at least one)
+ */
+static size_t recovery_length (const Lexer* lexer, const char* text,
+        const char* end, LexErrorKind* kind)
+{
+    Lexeme lexeme;
+    if (*text == '"') {
+        *kind = LEX_ERROR_STRING;
+        const char* p = text + 1;
+        while (p < end && *p != '"' && *p != '\n') {
+            p++;
+        }
+        return (size_t)(p - text) + (p < end && *p == '"' ? 1 : 0);
+    }
+    if (isalpha((unsigned char)*text)) {
+        Lexer_scan(lexer, text, end, &lexeme);
+        *kind = LEX_ERROR_RESERVED_WORD;
+        return lexeme.length;
+    }
+    *kind = LEX_ERROR_CHARACTER;
+    return 1;
+}
+
+TokenQueue* Lexer_lex_recover (const Lexer* lexer, const char* text, size_t length,
+        LexDiagnostics* diagnostics)
+{
+    return Lexer_lex_recover_opts(lexer, text, length, 0, diagnostics);
+}
+
+TokenQueue* Lexer_lex_recover_opts (const Lexer* lexer, const char* text,
+        size_t length, int options, LexDiagnostics* diagnostics)
+{
+    TokenQueue* tokens = TokenQueue_new_pooled(lexer->pool);
+    if (text == NULL) {
+        return tokens;
+    }
+
+    ScanPosition pos;
+    ScanPosition_init(&pos);
+    char error[MAX_ERROR_LEN];
+    while (!Lexer_lex_range(lexer, text, length, length, &pos, tokens, options,
+                error)) {
+        LexErrorKind kind;
+        size_t skip = recovery_length(lexer, text + pos.offset, text + length, &kind);
+        LexDiagnostics_add(diagnostics, kind, &pos, skip);
+        pos.offset += skip;
+    }
     return tokens;
 }
 
+Symbol Lexer_intern (const Lexer* lexer, TokenType type, const char* text,
+        size_t length)
+{
+    if (lexer->interned == NULL || (type != ID && type != STRLIT)) {
+        return SYMBOL_NONE;
+    }
+    return SymbolTable_intern(lexer->interned, text, length);
+}
+
+void Lexer_set_interning (Lexer* lexer, bool enabled)
+{
+    if (enabled && lexer->interned == NULL) {
+        lexer->interned = SymbolTable_new();
+    } else if (!enabled && lexer->interned != NULL) {
+        SymbolTable_free(lexer->interned);
+        lexer->interned = NULL;
+    }
+}
+
+void Lexer_clear_symbols (Lexer* lexer)
+{
+    if (lexer->interned != NULL) {
+        SymbolTable_clear(lexer->interned);
+    }
+}
+
+void Lexer_set_threads (Lexer* lexer, int threads)
+{
+    lexer->threads = (threads < 1 ? 1 : threads);
+}
+
+void Lexer_free (Lexer* lexer)
+{
+    TokenPool_release(lexer->pool);
+    Lexer_set_interning(lexer, false);
+    if (lexer->engine != LEXER_REGEX) {
+        free(lexer);
+        return;
+    }
+    Regex_free(lexer->whitespace);
+    Regex_free(lexer->letter);
+    Regex_free(lexer->numbers);
+    Regex_free(lexer->symbols);
+    Regex_free(lexer->grouping);
+    Regex_free(lexer->or_equal);
+    Regex_free(lexer->strings);
+    Regex_free(lexer->hex);
+    Regex_free(lexer->comment);
+    Regex_free(lexer->newline);
+    free(lexer);
+}
+
+/**
+ * @brief Process-wide lexer used by @ref lex
+ */
+static Lexer* default_lexer = NULL;
+
+/**
+ * @brief Guards one-time initialization of @ref default_lexer
+ */
+static pthread_once_t default_lexer_once = PTHREAD_ONCE_INIT;
+
+/**
+ * @brief Deallocate the process-wide lexer at exit
+ */
+static void default_lexer_free ()
+{
+    Lexer_free(default_lexer);
+    default_lexer = NULL;
+}
+
+/**
+ * @brief Compile the process-wide lexer (called exactly once)
+ */
+static void default_lexer_init ()
+{
+    default_lexer = Lexer_new(LEXER_DFA);
+    atexit(default_lexer_free);
+}
+
+TokenQueue* lex (char* text)
+{
+    pthread_once(&default_lexer_once, default_lexer_init);
+    return Lexer_lex(default_lexer, text);
+}
+
+TokenQueue* lex_n (const char* text, size_t len)
+{
+    pthread_once(&default_lexer_once, default_lexer_init);
+    return Lexer_lex_n(default_lexer, text, len);
+}
@@ -0,0 +1,153 @@
+/**
+ * @file parallel.c
+ * @brief Lexing a single large input on several threads
+ */
+#include "p1-lexer.h"
+#include "simd.h"
+#include "threadpool.h"
+
+/**
+ * @brief One piece of a parallel lexing job
+ */
+typedef struct LexChunk
+{
+    const Lexer* lexer;     /**< @brief Lexer to use */
+    int options;            /**< @brief Lexing options */
+    const char* text;       /**< @brief Start of the whole text */
+    size_t length;          /**< @brief Length of the whole text */
+    size_t start;           /**< @brief Offset of the chunk (just after a
+                                 newline and any whitespace following it) */
+    size_t line_start;      /**< @brief Offset of the line containing @c start */
+    size_t stop;            /**< @brief Offset of the next chunk */
+    ScanPosition pos;       /**< @brief Where lexing the chunk stopped */
+    TokenQueue* tokens;     /**< @brief Tokens found in the chunk (for the
+                                 first chunk, this is the final queue) */
+    bool ok;                /**< @brief False if an invalid token was found */
+    char error[MAX_ERROR_LEN];  /**< @brief Error message if not @c ok */
+} LexChunk;
+
+/**
+ * @brief Thread pool task: lex a chunk as if it started at line 1
+ */
+static void lex_chunk (void* arg)
+{
+    LexChunk* chunk = (LexChunk*)arg;
+    chunk->pos.offset = chunk->start;
+    chunk->pos.line_start = chunk->line_start;
+    chunk->pos.line = 1;
+    chunk->ok = Lexer_lex_range(chunk->lexer, chunk->text, chunk->length,
+            chunk->stop, &chunk->pos, chunk->tokens, chunk->options,
+            chunk->error);
+}
+
+TokenQueue* Lexer_try_lex_parallel (const Lexer* lexer, const char* text,
+        size_t length, int nthreads, int options, char* error)
+{
+    size_t max_chunks = length / LEXER_MIN_PARALLEL_CHUNK;
+    size_t nchunks = (size_t)(nthreads < 1 ? 1 : nthreads);
+    if (nchunks > max_chunks) {
+        nchunks = max_chunks;
+    }
+    if (nchunks < 2) {
+        return Lexer_try_lex_serial(lexer, text, length, options, error);
+    }
+
+    /*
+     * chunks are lexed without interning so the workers do not contend for the
+     * symbol table and discarded speculation leaves nothing behind; the final
+     * tokens are interned in order at the end
+     */
+    bool intern = !(options & LEX_NO_INTERN) && lexer->interned != NULL;
+
+    LexChunk* chunks = (LexChunk*)calloc(nchunks, sizeof(LexChunk));
+    CHECK_MALLOC_PTR(chunks)
+
+    /*
+     * split after a newline and the whitespace following it (where the
+     * scanner's newline lexeme ends); drop splits that would be empty
+     */
+    const char* end = text + length;
+    size_t count = 0;
+    for (size_t k = 0; k < nchunks; k++) {
+        size_t start = 0;
+        size_t line_start = 0;
+        if (k > 0) {
+            const char* nl = simd_find_newline(text + k * (length / nchunks), end);
+            if (nl == end) {
+                break;
+            }
+            const char* next = simd_skip_space(nl + 1, end);
+            const char* last = next - 1;
+            while (*last != '\n') {
+                last--;
+            }
+            start = (size_t)(next - text);
+            line_start = (size_t)(last - text) + 1;
+            if (start >= length || start <= chunks[count - 1].start) {
+                continue;
+            }
+        }
+        chunks[count].lexer = lexer;
+        chunks[count].options = options | LEX_NO_INTERN;
+        chunks[count].text = text;
+        chunks[count].length = length;
+        chunks[count].start = start;
+        chunks[count].line_start = line_start;
+        chunks[count].tokens = TokenQueue_new_pooled(lexer->pool);
+        count++;
+    }
+    for (size_t k = 0; k < count; k++) {
+        chunks[k].stop = (k + 1 < count ? chunks[k + 1].start : length);
+    }
+
+    /* lex every chunk speculatively */
+    ThreadPool* pool = ThreadPool_new((int)count);
+    for (size_t k = 0; k < count; k++) {
+        ThreadPool_submit(pool, lex_chunk, &chunks[k]);
+    }
+    ThreadPool_wait(pool);
+    ThreadPool_free(pool);
+
+    /* stitch the chunks together in order (the first one is already final) */
+    TokenQueue* tokens = chunks[0].tokens;
+    ScanPosition pos = chunks[0].pos;
+    bool ok = chunks[0].ok;
+    if (!ok) {
+        snprintf(error, MAX_ERROR_LEN, "%s", chunks[0].error);
+    }
+    for (size_t k = 1; k < count && ok; k++) {
+        LexChunk* chunk = &chunks[k];
+        if (pos.offset == chunk->start) {
+            /* previous chunk ended exactly at the split: speculation holds */
+            if (!chunk->ok) {
+                snprintf(error, MAX_ERROR_LEN, "%s", chunk->error);
+                ok = false;
+            }
+            TokenQueue_append(tokens, chunk->tokens, pos.line - 1);
+            pos.offset = chunk->pos.offset;
+            pos.line_start = chunk->pos.line_start;
+            pos.line = chunk->pos.line + pos.line - 1;
+        } else if (pos.offset < chunk->stop) {
+            /* split fell inside a lexeme (e.g., a string): redo this chunk */
+            ok = Lexer_lex_range(lexer, text, length, chunk->stop, &pos,
+                    tokens, options | LEX_NO_INTERN, error);
+        }
+        /* else the previous chunk's last lexeme covered this whole chunk */
+    }
+
+    for (size_t k = 1; k < count; k++) {
+        TokenQueue_free(chunks[k].tokens);
+    }
+    free(chunks);
+
+    if (!ok) {
+        TokenQueue_free(tokens);
+        return NULL;
+    }
+    if (intern) {
+        for (Token* t = tokens->head; t != NULL; t = t->next) {
+            t->symbol = Lexer_intern(lexer, t->type, t->text, t->length);
+        }
+    }
+    return tokens;
+}
@@ -0,0 +1,154 @@
+/**
+ * @file relex.c
+ * @brief Incremental re-lexing after an edit
+ */
+#include "p1-lexer.h"
+
+/**
+ * @brief Find the first old token that has to be lexed again
+ *
+ * A token whose end is before the edit was decided without looking at the
+ * edited text, except that a string literal whose closing quote follows a
+ * backslash keeps looking for a longer match, possibly across later tokens.
+ * Such a scan always stops at a symbol (no symbol character may appear in a
+ * string), so restarting at the last symbol before the edit is always safe.
+ *
+ * @param old Tokens from before the edit
+ * @param edit_offset Where the edit starts
+ * @returns Index of the token to restart at (0 means the start of the text)
+ */
+static size_t restart_index (TokenQueue* old, size_t edit_offset)
+{
+    /* count the tokens whose lookahead character is before the edit */
+    size_t lo = 0;
+    size_t hi = TokenQueue_size(old);
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        Token* t = TokenQueue_get(old, mid);
+        if (t->offset + t->length < edit_offset) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    while (lo > 0) {
+        lo--;
+        if (TokenQueue_get(old, lo)->type == SYM) {
+            return lo;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Shift the tokens after the edit to their place in the new text
+ *
+ * @param tokens Queue being updated
+ * @param index Index of the first token to shift
+ * @param sync New token where the streams lined up
+ * @param old_sync Copy of the old token it lined up with
+ * @param text New text
+ * @param edit The edit
+ */
+static void shift_tail (TokenQueue* tokens, size_t index, const Token* sync,
+        const Token* old_sync, const char* text, LexEdit edit)
+{
+    size_t count = TokenQueue_size(tokens);
+    int line_delta = sync->line - old_sync->line;
+    size_t old_line_start = old_sync->offset - (size_t)(old_sync->column - 1);
+    size_t new_line_start = sync->offset - (size_t)(sync->column - 1);
+
+    for (; index < count; index++) {
+        Token* t = TokenQueue_get(tokens, index);
+        size_t offset = t->offset - edit.deleted + edit.inserted;
+        if (t->offset - (size_t)(t->column - 1) == old_line_start) {
+            /* still on the edited line */
+            t->column = (int)(offset - new_line_start) + 1;
+        }
+        t->offset = offset;
+        t->text = text + offset;
+        t->line += line_delta;
+    }
+}
+
+bool Lexer_relex (const Lexer* lexer, TokenQueue* tokens, const char* text,
+        size_t length, LexEdit edit, char* error)
+{
+    if (text == NULL)
+    {
+        snprintf(error, MAX_ERROR_LEN, "Invalid token!\n");
+        return false;
+    }
+
+    size_t count = TokenQueue_size(tokens);
+    size_t restart = restart_index(tokens, edit.offset);
+    ScanPosition pos;
+    ScanPosition_init(&pos);
+    if (restart > 0) {
+        Token* t = TokenQueue_get(tokens, restart);
+        pos.offset = t->offset;
+        pos.line = t->line;
+        pos.line_start = t->offset - (size_t)(t->column - 1);
+    }
+
+    /* lex one lexeme at a time until a token lines up with an old one */
+    TokenQueue* fresh = TokenQueue_new_pooled(lexer->pool);
+    size_t edit_end = edit.offset + edit.inserted;
+    size_t sync = count;
+    size_t next = restart;
+    while (pos.offset < length && sync == count) {
+        size_t before = TokenQueue_size(fresh);
+        if (!Lexer_lex_range(lexer, text, length, pos.offset + 1, &pos,
+                    fresh, 0, error)) {
+            TokenQueue_free(fresh);
+            return false;
+        }
+        Token* t = fresh->tail;
+        if (TokenQueue_size(fresh) == before || t->offset < edit_end) {
+            continue;
+        }
+
+        size_t old_offset = t->offset - edit.inserted + edit.deleted;
+        while (next < count && TokenQueue_get(tokens, next)->offset < old_offset) {
+            next++;
+        }
+        if (next < count && TokenQueue_get(tokens, next)->offset == old_offset) {
+            sync = next;
+        }
+    }
+
+    /* tokens before the restart point only need to point into the new text */
+    Token* first = TokenQueue_peek(tokens);
+    if (first != NULL && first->text - first->offset != text) {
+        for (size_t i = 0; i < restart; i++) {
+            Token* t = TokenQueue_get(tokens, i);
+            t->text = text + t->offset;
+        }
+    }
+
+    /* swap in the re-lexed tokens (the one that lined up is kept from before) */
+    size_t added = TokenQueue_size(fresh) - (sync < count ? 1 : 0);
+    Token old_sync = { 0 };
+    if (sync < count) {
+        old_sync = *TokenQueue_get(tokens, sync);
+    }
+    TokenQueue_splice(tokens, restart, sync - restart, added);
+    Token* t = fresh->head;
+    for (size_t i = 0; i < added; i++, t = t->next) {
+        Token* slot = TokenQueue_get(tokens, restart + i);
+        slot->type = t->type;
+        slot->line = t->line;
+        slot->column = t->column;
+        slot->length = t->length;
+        slot->offset = t->offset;
+        slot->text = t->text;
+        slot->symbol = t->symbol;
+    }
+    if (sync < count) {
+        shift_tail(tokens, restart + added, fresh->tail, &old_sync, text, edit);
+    }
+
+    TokenQueue_free(fresh);
+    return true;
+}
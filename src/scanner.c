@@ -0,0 +1,301 @@
+/**
+ * @file scanner.c
+ * @brief Hand-written DFA scanner
+ *
+ * This is a direct translation of the lexer's regular expressions into a
+ * switch on the first character followed by a tight loop for the rest of the
+ * lexeme. It must stay in sync with the patterns in @ref Lexer_new.
+ *
+ * Runs of whitespace, comments, identifiers, and string literal bodies are
+ * skipped with the vector kernels from simd.h.
+ *
+ * Keywords and reserved words are only defined here (in @ref word_table); both
+ * engines use @ref scan_classify_word once an identifier has been matched.
+ */
+#include "scanner.h"
+#include "simd.h"
+
+/**
+ * @brief Entry in the keyword/reserved word table
+ */
+typedef struct WordEntry
+{
+    const char* word;   /**< @brief Text of the word (@c NULL for empty slots) */
+    size_t length;      /**< @brief Length of the word */
+    bool reserved;      /**< @brief True for reserved words, false for keywords */
+} WordEntry;
+
+/**
+ * @brief Number of slots in @ref word_table (must be a power of two)
+ */
+#define WORD_TABLE_SIZE 64
+
+/**
+ * @brief Length up to which runs are scanned inline before calling a vector
+ * kernel (the call only pays off for longer runs)
+ */
+#define SCAN_SHORT_RUN 8
+
+/**
+ * @brief Perfect hash over the keywords and reserved words
+ *
+ * The multipliers were found by brute-force search so that all 24 words land
+ * in distinct slots; re-check them whenever a word is added. Only the length
+ * and the first and last characters are used, so the hash is O(1) and a
+ * lookup costs at most one @c memcmp.
+ */
+#define WORD_HASH(TEXT, LEN) \
+    (((LEN) + 5 * (unsigned char)(TEXT)[0] + 4 * (unsigned char)(TEXT)[(LEN)-1]) \
+     & (WORD_TABLE_SIZE - 1))
+
+/**
+ * @brief Keywords and reserved words, indexed by @ref WORD_HASH
+ */
+static const WordEntry word_table[WORD_TABLE_SIZE] = {
+    [15] = { "def",        3,  false },
+    [39] = { "if",         2,  false },
+    [17] = { "else",       4,  false },
+    [44] = { "while",      5,  false },
+    [56] = { "return",     6,  false },
+    [27] = { "break",      5,  false },
+    [11] = { "continue",   8,  false },
+    [32] = { "int",        3,  false },
+    [30] = { "bool",       4,  false },
+    [34] = { "void",       4,  false },
+    [28] = { "true",       4,  false },
+    [23] = { "false",      5,  false },
+    [ 9] = { "for",        3,  true  },
+    [ 6] = { "callout",    7,  true  },
+    [ 0] = { "class",      5,  true  },
+    [42] = { "interface",  9,  true  },
+    [12] = { "extends",    7,  true  },
+    [35] = { "implements", 10, true  },
+    [ 5] = { "new",        3,  true  },
+    [20] = { "this",       4,  true  },
+    [33] = { "string",     6,  true  },
+    [19] = { "float",      5,  true  },
+    [14] = { "double",     6,  true  },
+    [26] = { "null",       4,  true  },
+};
+
+static inline bool is_letter (char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+static inline bool is_digit (char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+static inline bool is_word (char c)
+{
+    return is_letter(c) || is_digit(c) || c == '_';
+}
+
+static inline bool is_hex_digit (char c)
+{
+    return is_digit(c) || (c >= 'a' && c <= 'f');
+}
+
+/**
+ * @brief Scan a string literal
+ *
+ * The @c strings regex allows a backslash on its own as well as a
+ * backslash-quote pair, so a quote that follows a backslash might either close
+ * the literal or be part of it. POSIX regexes pick the longest match, so we
+ * remember the last place the literal could have ended and keep going.
+ *
+ * @param at_end Output: set if the scan ran into the end of the input
+ * @returns Length of the literal, or zero if there is no valid literal
+ */
+static size_t scan_string (const char* text, const char* end, bool* at_end)
+{
+    const char* p = text + 1;       /* skip opening quote */
+    size_t accept = 0;
+    bool escaped = false;           /* previous character was a backslash */
+    while (p < end) {
+        const char* run = simd_skip_string_chars(p, end);
+        if (run != p) {
+            escaped = false;
+            p = run;
+            if (p >= end) {
+                break;
+            }
+        }
+        char c = *p++;
+        if (c == '"') {
+            accept = (size_t)(p - text);
+            if (!escaped) {
+                break;              /* unescaped quote always ends the literal */
+            }
+            escaped = false;        /* ... but an escaped one might not */
+        } else if (c == '\\') {
+            escaped = true;
+        } else {
+            break;
+        }
+    }
+    *at_end = (p >= end);
+    return accept;
+}
+
+void scan_classify_word (const char* text, Lexeme* lexeme)
+{
+    const WordEntry* entry = &word_table[WORD_HASH(text, lexeme->length)];
+
+    lexeme->kind = LEX_TOKEN;
+    lexeme->type = ID;
+    if (entry->length == lexeme->length &&
+            memcmp(entry->word, text, lexeme->length) == 0) {
+        if (entry->reserved) {
+            lexeme->kind = LEX_INVALID;
+        } else {
+            lexeme->type = KEY;
+        }
+    }
+}
+
+void scan_dfa (const char* text, const char* end, Lexeme* lexeme)
+{
+    const char* p = text;
+    char next = (text + 1 < end ? text[1] : '\0');
+
+    lexeme->kind = LEX_TOKEN;
+    lexeme->type = SYM;
+    lexeme->length = 1;
+    lexeme->at_end = false;
+
+    switch (*p) {
+        case ' ': case '\t':
+            lexeme->kind = LEX_BLANK;
+            if (next == ' ' || next == '\t') {
+                lexeme->length = (size_t)(simd_skip_blanks(text + 2, end) - text);
+            }
+            break;
+
+        case '\n':
+            /* the line break plus any blank lines and indentation after it */
+            lexeme->kind = LEX_NEWLINE;
+            if (next == ' ' || next == '\t' || next == '\n') {
+                lexeme->length = (size_t)(simd_skip_space(text + 2, end) - text);
+            }
+            break;
+
+        case '/':
+            lexeme->at_end = (text + 1 >= end);
+            if (next == '/') {
+                lexeme->kind = LEX_COMMENT;
+                p = simd_find_newline(p, end);
+                lexeme->length = (size_t)(p - text);
+                lexeme->at_end = (p >= end);
+            }
+            break;
+
+        case '0':
+            lexeme->type = DECLIT;
+            lexeme->at_end = (text + 1 >= end);
+            if (next == 'x') {
+                lexeme->type = HEXLIT;
+                p += 2;
+                while (p < end && is_hex_digit(*p)) {
+                    p++;
+                }
+                lexeme->length = (size_t)(p - text);
+                lexeme->at_end = (p >= end);
+            }
+            break;
+
+        case '1': case '2': case '3': case '4': case '5':
+        case '6': case '7': case '8': case '9':
+            /* ^(0|[1-9]+[0]*) */
+            lexeme->type = DECLIT;
+            while (p < end && *p >= '1' && *p <= '9') {
+                p++;
+            }
+            while (p < end && *p == '0') {
+                p++;
+            }
+            lexeme->length = (size_t)(p - text);
+            lexeme->at_end = (p >= end);
+            break;
+
+        case '<': case '>': case '=': case '!':
+            lexeme->at_end = (text + 1 >= end);
+            if (next == '=') {
+                lexeme->length = 2;
+            }
+            break;
+
+        case '(': case ')': case '{': case '}': case '[': case ']':
+        case ',': case ';': case '+': case '*': case '-': case '%':
+            break;
+
+        case '&': case '|':
+            lexeme->at_end = (text + 1 >= end);
+            if (next == *p) {
+                lexeme->length = 2;
+            } else {
+                lexeme->kind = LEX_INVALID;
+            }
+            break;
+
+        case '"':
+            lexeme->type = STRLIT;
+            lexeme->length = scan_string(text, end, &lexeme->at_end);
+            if (lexeme->length == 0) {
+                lexeme->kind = LEX_INVALID;
+                lexeme->length = 1;
+            }
+            break;
+
+        default:
+            if (!is_letter(*p)) {
+                lexeme->kind = LEX_INVALID;
+                break;
+            }
+            /* most words are short: only hand long ones to the kernel */
+            p++;
+            while (p < end && p < text + SCAN_SHORT_RUN && is_word(*p)) {
+                p++;
+            }
+            if (p < end && is_word(*p)) {
+                p = simd_skip_word(p, end);
+            }
+            lexeme->length = (size_t)(p - text);
+            lexeme->at_end = (p >= end);
+            scan_classify_word(text, lexeme);
+            break;
+    }
+}
+
+void ScanPosition_init (ScanPosition* pos)
+{
+    pos->offset = 0;
+    pos->line_start = 0;
+    pos->line = 1;
+}
+
+void ScanPosition_advance (ScanPosition* pos, const char* text,
+        const Lexeme* lexeme)
+{
+    if (lexeme->kind == LEX_NEWLINE) {
+        /* may span several lines (see scan_dfa) */
+        size_t last = lexeme->length - 1;
+        while (text[last] != '\n') {
+            last--;
+        }
+        pos->line += (int)simd_count_newlines(text, text + last + 1);
+        pos->line_start = pos->offset + last + 1;
+    } else if (lexeme->kind == LEX_TOKEN && lexeme->type == STRLIT) {
+        /* string literals may contain line breaks too */
+        for (size_t i = lexeme->length - 1; i > 0; i--) {
+            if (text[i] == '\n') {
+                pos->line += (int)simd_count_newlines(text, text + i + 1);
+                pos->line_start = pos->offset + i + 1;
+                break;
+            }
+        }
+    }
+    pos->offset += lexeme->length;
+}
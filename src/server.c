@@ -0,0 +1,519 @@
+/**
+ * @file server.c
+ * @brief Long-running lexer server over a Unix domain socket
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "server.h"
+#include "tokenfile.h"
+
+/**
+ * @brief Fill in the address of a socket path
+ *
+ * @returns True if and only if the path fits in the address
+ */
+static bool socket_address (const char* path, struct sockaddr_un* address)
+{
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address->sun_path)) {
+        return false;
+    }
+    strcpy(address->sun_path, path);
+    return true;
+}
+
+/**
+ * @brief Read exactly @c length bytes from a blocking socket (retrying after
+ * signals; used by clients)
+ *
+ * @returns True if and only if all bytes were read (false on end of file and
+ * errors)
+ */
+static bool read_full (int fd, void* data, size_t length)
+{
+    char* p = (char*)data;
+    while (length > 0) {
+        ssize_t n = recv(fd, p, length, 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        length -= (size_t)n;
+    }
+    return true;
+}
+
+/**
+ * @brief Write exactly @c length bytes (retrying after signals)
+ *
+ * Works on blocking and non-blocking sockets alike; on a non-blocking socket,
+ * waits up to #LEXSERVER_TIMEOUT seconds whenever the peer is not reading.
+ * Never raises @c SIGPIPE if the peer has gone away.
+ *
+ * @returns True if and only if all bytes were written
+ */
+static bool write_full (int fd, const void* data, size_t length)
+{
+    const char* p = (const char*)data;
+    while (length > 0) {
+        ssize_t n = send(fd, p, length, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            struct pollfd ready = { fd, POLLOUT, 0 };
+            if (poll(&ready, 1, LEXSERVER_TIMEOUT * 1000) > 0) {
+                continue;
+            }
+            return false;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        length -= (size_t)n;
+    }
+    return true;
+}
+
+/**
+ * @brief Send a response
+ *
+ * @returns True if and only if the whole response was sent
+ */
+static bool send_response (int fd, uint32_t status, const char* tokens,
+        size_t tokens_length, const char* errors, size_t errors_length)
+{
+    uint32_t header[3] = { htonl(status), htonl((uint32_t)tokens_length),
+                           htonl((uint32_t)errors_length) };
+    return write_full(fd, header, sizeof(header)) &&
+           write_full(fd, tokens, tokens_length) &&
+           write_full(fd, errors, errors_length);
+}
+
+/**
+ * @brief Lex a request and send the response
+ *
+ * @param server Server with the shared lexer
+ * @param fd Client socket
+ * @param flags Request flags
+ * @param text Source to lex
+ * @param length Length of the source
+ * @returns True if and only if the response was sent
+ */
+static bool answer (LexServer* server, int fd, uint32_t flags, const char* text,
+        size_t length)
+{
+    uint32_t status = LEXSERVER_OK;
+    char* errors = NULL;
+    size_t errors_length = 0;
+    TokenQueue* tokens = NULL;
+
+    if (flags & LEXSERVER_KEEP_GOING) {
+        LexDiagnostics diagnostics;
+        LexDiagnostics_init(&diagnostics);
+        tokens = Lexer_lex_recover_opts(server->lexer, text, length,
+                LEX_NO_INTERN, &diagnostics);
+        if (diagnostics.count > 0) {
+            status = LEXSERVER_LEX_ERROR;
+            FILE* report = open_memstream(&errors, &errors_length);
+            CHECK_MALLOC_PTR(report)
+            LexDiagnostics_print(&diagnostics, "<input>", text, report);
+            fclose(report);
+        }
+        LexDiagnostics_free(&diagnostics);
+    } else {
+        char error[MAX_ERROR_LEN];
+        tokens = Lexer_try_lex_n_opts(server->lexer, text, length,
+                LEX_NO_INTERN, error);
+        if (tokens == NULL) {
+            status = LEXSERVER_LEX_ERROR;
+            errors = strdup(error);
+            CHECK_MALLOC_PTR(errors)
+            errors_length = strlen(errors);
+        }
+    }
+
+    char* listing = NULL;
+    size_t listing_length = 0;
+    if (tokens != NULL) {
+        FILE* out = open_memstream(&listing, &listing_length);
+        CHECK_MALLOC_PTR(out)
+        if (flags & LEXSERVER_BINARY) {
+            TokenQueue_write_binary(tokens, out);
+        } else {
+            TokenQueue_print(tokens, out);
+        }
+        fclose(out);
+        TokenQueue_free(tokens);
+    }
+
+    bool sent = send_response(fd, status, listing, listing_length, errors,
+            errors_length);
+    free(listing);
+    free(errors);
+    return sent;
+}
+
+/**
+ * @brief Wake up the main loop
+ */
+static void wake (LexServer* server)
+{
+    char byte = 0;
+    if (write(server->wake[1], &byte, 1) < 0) {
+        /* the pipe is full, so the loop will wake up anyway */
+    }
+}
+
+/**
+ * @brief Thread pool task: answer the complete request received on a
+ * connection
+ *
+ * @param arg The @ref LexConnection to serve
+ */
+static void serve_request (void* arg)
+{
+    LexConnection* connection = (LexConnection*)arg;
+    LexServer* server = connection->server;
+    bool keep = false;
+
+    if (connection->length > LEXSERVER_MAX_REQUEST) {
+        const char* message = "Request too large\n";
+        send_response(connection->fd, LEXSERVER_BAD_REQUEST, NULL, 0,
+                message, strlen(message));
+    } else {
+        connection->buffer[connection->length] = '\0';
+        keep = answer(server, connection->fd, connection->flags,
+                connection->buffer, connection->length);
+    }
+    connection->received = 0;
+
+    pthread_mutex_lock(&server->lock);
+    connection->busy = false;
+    connection->closed = !keep;
+    server->requests += (keep ? 1 : 0);
+    pthread_mutex_unlock(&server->lock);
+    wake(server);
+}
+
+/**
+ * @brief Check whether a whole request has been received on a connection
+ * (including a header whose length is too large, which is answered without
+ * reading the source)
+ */
+static bool request_ready (const LexConnection* connection)
+{
+    return connection->received >= LEXSERVER_HEADER_SIZE &&
+           (connection->length > LEXSERVER_MAX_REQUEST ||
+            connection->received - LEXSERVER_HEADER_SIZE == connection->length);
+}
+
+/**
+ * @brief Read whatever has arrived on a readable connection without blocking
+ * (called by the main loop)
+ *
+ * @returns False if the connection was closed by the client or failed
+ */
+static bool receive (LexConnection* connection)
+{
+    while (!request_ready(connection)) {
+        char* dest;
+        size_t wanted;
+        if (connection->received < LEXSERVER_HEADER_SIZE) {
+            dest = (char*)connection->header + connection->received;
+            wanted = LEXSERVER_HEADER_SIZE - connection->received;
+        } else {
+            size_t done = connection->received - LEXSERVER_HEADER_SIZE;
+            dest = connection->buffer + done;
+            wanted = connection->length - done;
+        }
+
+        ssize_t n = recv(connection->fd, dest, wanted, 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return true;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        if (connection->received == 0) {
+            connection->started = time(NULL);
+        }
+        connection->received += (size_t)n;
+
+        if (connection->received == LEXSERVER_HEADER_SIZE) {
+            connection->flags = ntohl(connection->header[0]);
+            connection->length = ntohl(connection->header[1]);
+            if (connection->length <= LEXSERVER_MAX_REQUEST &&
+                    connection->length + 1 > connection->capacity) {
+                connection->capacity = connection->length + 1;
+                connection->buffer = (char*)realloc(connection->buffer,
+                        connection->capacity);
+                CHECK_MALLOC_PTR(connection->buffer)
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Accept a new client (called by the main loop)
+ */
+static void accept_client (LexServer* server)
+{
+    int fd = accept(server->listen_fd, NULL, NULL);
+    if (fd < 0) {
+        return;
+    }
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+
+    LexConnection* connection = (LexConnection*)calloc(1, sizeof(LexConnection));
+    CHECK_MALLOC_PTR(connection)
+    connection->server = server;
+    connection->fd = fd;
+
+    if (server->count == server->capacity) {
+        server->capacity = (server->capacity == 0 ? 16 : server->capacity * 2);
+        server->connections = (LexConnection**)realloc(server->connections,
+                server->capacity * sizeof(LexConnection*));
+        CHECK_MALLOC_PTR(server->connections)
+    }
+    server->connections[server->count++] = connection;
+}
+
+/**
+ * @brief Close a connection and deallocate it
+ */
+static void close_connection (LexConnection* connection)
+{
+    close(connection->fd);
+    free(connection->buffer);
+    free(connection);
+}
+
+LexServer* LexServer_new (const Lexer* lexer, const char* path, int nthreads,
+        char* error)
+{
+    struct sockaddr_un address;
+    if (!socket_address(path, &address)) {
+        snprintf(error, MAX_ERROR_LEN, "Socket path too long: %s\n", path);
+        return NULL;
+    }
+
+    /* replace a stale socket, but never one that a server is listening on */
+    int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (probe >= 0) {
+        if (connect(probe, (struct sockaddr*)&address, sizeof(address)) == 0) {
+            close(probe);
+            snprintf(error, MAX_ERROR_LEN, "Socket already in use: %s\n", path);
+            return NULL;
+        }
+        if (errno == ECONNREFUSED) {
+            unlink(path);
+        }
+        close(probe);
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || bind(fd, (struct sockaddr*)&address, sizeof(address)) != 0 ||
+            listen(fd, SOMAXCONN) != 0) {
+        snprintf(error, MAX_ERROR_LEN, "Could not listen on %s: %s\n", path,
+                strerror(errno));
+        if (fd >= 0) {
+            close(fd);
+        }
+        return NULL;
+    }
+
+    LexServer* server = (LexServer*)calloc(1, sizeof(LexServer));
+    CHECK_MALLOC_PTR(server)
+    server->lexer = lexer;
+    server->path = strdup(path);
+    CHECK_MALLOC_PTR(server->path)
+    server->listen_fd = fd;
+    if (pipe(server->wake) != 0) {
+        snprintf(error, MAX_ERROR_LEN, "Could not create pipe: %s\n", strerror(errno));
+        close(fd);
+        unlink(path);
+        free(server->path);
+        free(server);
+        return NULL;
+    }
+    fcntl(server->wake[0], F_SETFL, O_NONBLOCK);
+    fcntl(server->wake[1], F_SETFL, O_NONBLOCK);
+    server->pool = ThreadPool_new(nthreads < 1 ? 1 : nthreads);
+    pthread_mutex_init(&server->lock, NULL);
+    return server;
+}
+
+void LexServer_run (LexServer* server)
+{
+    struct pollfd* fds = NULL;
+    LexConnection** polled = NULL;
+    size_t size = 0;
+
+    while (!server->stopping) {
+        /* drop finished connections and wait on the idle ones */
+        if (server->count + 2 > size) {
+            size = server->count + 2;
+            fds = (struct pollfd*)realloc(fds, size * sizeof(struct pollfd));
+            polled = (LexConnection**)realloc(polled, size * sizeof(LexConnection*));
+            CHECK_MALLOC_PTR(fds)
+            CHECK_MALLOC_PTR(polled)
+        }
+        fds[0] = (struct pollfd){ server->listen_fd, POLLIN, 0 };
+        fds[1] = (struct pollfd){ server->wake[0], POLLIN, 0 };
+        size_t nfds = 2;
+        size_t kept = 0;
+        int timeout = -1;
+        pthread_mutex_lock(&server->lock);
+        for (size_t i = 0; i < server->count; i++) {
+            LexConnection* connection = server->connections[i];
+            if (connection->closed && !connection->busy) {
+                close_connection(connection);
+                continue;
+            }
+            server->connections[kept++] = connection;
+            if (!connection->busy) {
+                fds[nfds] = (struct pollfd){ connection->fd, POLLIN, 0 };
+                polled[nfds++] = connection;
+                if (connection->received > 0) {
+                    timeout = 1000;     /* check for stalled requests */
+                }
+            }
+        }
+        server->count = kept;
+        pthread_mutex_unlock(&server->lock);
+
+        if (poll(fds, (nfds_t)nfds, timeout) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+
+        if (fds[1].revents != 0) {
+            char drain[64];
+            while (read(server->wake[0], drain, sizeof(drain)) > 0) {
+                /* just empty the pipe */
+            }
+        }
+        time_t now = time(NULL);
+        for (size_t i = 2; i < nfds; i++) {
+            LexConnection* connection = polled[i];
+            bool open = (fds[i].revents == 0 || receive(connection));
+            if (open && connection->received > 0 && !request_ready(connection) &&
+                    now - connection->started >= LEXSERVER_TIMEOUT) {
+                open = false;   /* the rest of the request never came */
+            }
+            bool ready = open && request_ready(connection);
+            pthread_mutex_lock(&server->lock);
+            connection->closed = !open;
+            connection->busy = ready;
+            pthread_mutex_unlock(&server->lock);
+            if (ready) {
+                ThreadPool_submit(server->pool, serve_request, connection);
+            }
+        }
+        if (fds[0].revents & POLLIN) {
+            accept_client(server);
+        }
+    }
+
+    /* answer the requests already handed to workers before returning */
+    ThreadPool_wait(server->pool);
+    free(polled);
+    free(fds);
+}
+
+void LexServer_stop (LexServer* server)
+{
+    server->stopping = 1;
+    wake(server);
+}
+
+void LexServer_free (LexServer* server)
+{
+    /* finish the requests being served before closing their connections */
+    ThreadPool_free(server->pool);
+    for (size_t i = 0; i < server->count; i++) {
+        close_connection(server->connections[i]);
+    }
+    free(server->connections);
+    close(server->listen_fd);
+    unlink(server->path);
+    close(server->wake[0]);
+    close(server->wake[1]);
+    pthread_mutex_destroy(&server->lock);
+    free(server->path);
+    free(server);
+}
+
+int LexServer_connect (const char* path)
+{
+    struct sockaddr_un address;
+    if (!socket_address(path, &address)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd >= 0 && connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+        close(fd);
+        fd = -1;
+    }
+    return fd;
+}
+
+/**
+ * @brief Read one section of a response into a new NUL-terminated buffer
+ */
+static bool read_section (int fd, size_t length, char** section)
+{
+    *section = (char*)malloc(length + 1);
+    CHECK_MALLOC_PTR(*section)
+    (*section)[length] = '\0';
+    return read_full(fd, *section, length);
+}
+
+bool LexServer_request (int fd, uint32_t flags, const char* text, size_t length,
+        LexResponse* response)
+{
+    memset(response, 0, sizeof(*response));
+    uint32_t request[2] = { htonl(flags), htonl((uint32_t)length) };
+    if (!write_full(fd, request, sizeof(request)) || !write_full(fd, text, length)) {
+        return false;
+    }
+
+    uint32_t header[3];
+    if (!read_full(fd, header, sizeof(header))) {
+        return false;
+    }
+    response->status = ntohl(header[0]);
+    response->tokens_length = ntohl(header[1]);
+    response->errors_length = ntohl(header[2]);
+    return read_section(fd, response->tokens_length, &response->tokens) &&
+           read_section(fd, response->errors_length, &response->errors);
+}
+
+void LexResponse_free (LexResponse* response)
+{
+    free(response->tokens);
+    free(response->errors);
+    response->tokens = NULL;
+    response->errors = NULL;
+}
@@ -0,0 +1,391 @@
+/**
+ * @file simd.c
+ * @brief Vectorized character-class kernels with runtime dispatch
+ *
+ * Every vector kernel works on full 16- or 32-byte blocks (unaligned loads)
+ * and hands the remaining tail to the scalar kernel, so nothing past the end
+ * of the input is ever read. The vector code is compiled with per-function
+ * @c target attributes, so the rest of the program does not need to be built
+ * with @c -mavx2 and still runs on CPUs without it.
+ */
+#include "simd.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+/**
+ * @brief Table of kernel implementations
+ */
+typedef struct SimdKernels
+{
+    SimdLevel level;
+    const char* (*skip_blanks) (const char* text, const char* end);
+    const char* (*skip_space) (const char* text, const char* end);
+    const char* (*find_newline) (const char* text, const char* end);
+    size_t (*count_newlines) (const char* text, const char* end);
+    const char* (*skip_word) (const char* text, const char* end);
+    const char* (*skip_string_chars) (const char* text, const char* end);
+} SimdKernels;
+
+/*
+ * scalar kernels
+ */
+
+static inline bool is_word_char (char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+           (c >= '0' && c <= '9') || c == '_';
+}
+
+static inline bool is_plain_string_char (char c)
+{
+    return is_word_char(c) || c == '\n' || c == '\t' || c == '#' ||
+           c == ' ' || c == ':';
+}
+
+static const char* scalar_skip_blanks (const char* text, const char* end)
+{
+    while (text < end && (*text == ' ' || *text == '\t')) {
+        text++;
+    }
+    return text;
+}
+
+static const char* scalar_skip_space (const char* text, const char* end)
+{
+    while (text < end && (*text == ' ' || *text == '\t' || *text == '\n')) {
+        text++;
+    }
+    return text;
+}
+
+static const char* scalar_find_newline (const char* text, const char* end)
+{
+    const char* nl = memchr(text, '\n', (size_t)(end - text));
+    return (nl != NULL ? nl : end);
+}
+
+static size_t scalar_count_newlines (const char* text, const char* end)
+{
+    size_t count = 0;
+    for (; text < end; text++) {
+        count += (*text == '\n');
+    }
+    return count;
+}
+
+static const char* scalar_skip_word (const char* text, const char* end)
+{
+    while (text < end && is_word_char(*text)) {
+        text++;
+    }
+    return text;
+}
+
+static const char* scalar_skip_string_chars (const char* text, const char* end)
+{
+    while (text < end && is_plain_string_char(*text)) {
+        text++;
+    }
+    return text;
+}
+
+static const SimdKernels scalar_kernels = {
+    SIMD_SCALAR,
+    scalar_skip_blanks, scalar_skip_space, scalar_find_newline,
+    scalar_count_newlines, scalar_skip_word, scalar_skip_string_chars
+};
+
+#ifdef SIMD_X86
+
+/**
+ * @brief Define a kernel that returns the first position whose bit is set in
+ * a block's "stop" mask (or falls back to the scalar kernel for the tail)
+ */
+#define STOP_KERNEL(NAME, ATTR, WIDTH, STOP, SCALAR) \
+ATTR static const char* NAME (const char* text, const char* end) \
+{ \
+    while (end - text >= WIDTH) { \
+        uint32_t stop = STOP(text); \
+        if (stop != 0) { \
+            return text + __builtin_ctz(stop); \
+        } \
+        text += WIDTH; \
+    } \
+    return SCALAR(text, end); \
+}
+
+/**
+ * @brief Define a kernel that counts the bits set in each block's mask
+ */
+#define COUNT_KERNEL(NAME, ATTR, WIDTH, MATCH, SCALAR) \
+ATTR static size_t NAME (const char* text, const char* end) \
+{ \
+    size_t count = 0; \
+    while (end - text >= WIDTH) { \
+        count += (size_t)__builtin_popcount(MATCH(text)); \
+        text += WIDTH; \
+    } \
+    return count + SCALAR(text, end); \
+}
+
+/*
+ * SSE2 kernels (16 bytes per block)
+ */
+
+#define SSE2 __attribute__((target("sse2")))
+
+/**
+ * @brief Bytes of @c v in <tt>[lo, hi]</tt> (unsigned compare via saturating
+ * minimum, which SSE2 lacks otherwise)
+ */
+SSE2 static inline __m128i sse2_in_range (__m128i v, char lo, char hi)
+{
+    __m128i d = _mm_sub_epi8(v, _mm_set1_epi8(lo));
+    return _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8((char)(hi - lo))), d);
+}
+
+SSE2 static inline __m128i sse2_eq (__m128i v, char c)
+{
+    return _mm_cmpeq_epi8(v, _mm_set1_epi8(c));
+}
+
+SSE2 static inline __m128i sse2_word (__m128i v)
+{
+    __m128i letter = sse2_in_range(_mm_or_si128(v, _mm_set1_epi8(0x20)), 'a', 'z');
+    __m128i digit = sse2_in_range(v, '0', '9');
+    return _mm_or_si128(_mm_or_si128(letter, digit), sse2_eq(v, '_'));
+}
+
+SSE2 static inline __m128i sse2_load (const char* text)
+{
+    return _mm_loadu_si128((const __m128i*)text);
+}
+
+SSE2 static inline uint32_t sse2_stop_blanks (const char* text)
+{
+    __m128i v = sse2_load(text);
+    __m128i in = _mm_or_si128(sse2_eq(v, ' '), sse2_eq(v, '\t'));
+    return ~(uint32_t)_mm_movemask_epi8(in) & 0xffff;
+}
+
+SSE2 static inline uint32_t sse2_stop_space (const char* text)
+{
+    __m128i v = sse2_load(text);
+    __m128i in = _mm_or_si128(_mm_or_si128(sse2_eq(v, ' '), sse2_eq(v, '\t')),
+            sse2_eq(v, '\n'));
+    return ~(uint32_t)_mm_movemask_epi8(in) & 0xffff;
+}
+
+SSE2 static inline uint32_t sse2_newlines (const char* text)
+{
+    return (uint32_t)_mm_movemask_epi8(sse2_eq(sse2_load(text), '\n'));
+}
+
+SSE2 static inline uint32_t sse2_stop_word (const char* text)
+{
+    return ~(uint32_t)_mm_movemask_epi8(sse2_word(sse2_load(text))) & 0xffff;
+}
+
+SSE2 static inline uint32_t sse2_stop_string (const char* text)
+{
+    __m128i v = sse2_load(text);
+    __m128i in = _mm_or_si128(
+            _mm_or_si128(_mm_or_si128(sse2_word(v), sse2_eq(v, '\n')),
+                         _mm_or_si128(sse2_eq(v, '\t'), sse2_eq(v, '#'))),
+            _mm_or_si128(sse2_eq(v, ' '), sse2_eq(v, ':')));
+    return ~(uint32_t)_mm_movemask_epi8(in) & 0xffff;
+}
+
+STOP_KERNEL(sse2_skip_blanks, SSE2, 16, sse2_stop_blanks, scalar_skip_blanks)
+STOP_KERNEL(sse2_skip_space, SSE2, 16, sse2_stop_space, scalar_skip_space)
+STOP_KERNEL(sse2_find_newline, SSE2, 16, sse2_newlines, scalar_find_newline)
+COUNT_KERNEL(sse2_count_newlines, SSE2, 16, sse2_newlines, scalar_count_newlines)
+STOP_KERNEL(sse2_skip_word, SSE2, 16, sse2_stop_word, scalar_skip_word)
+STOP_KERNEL(sse2_skip_string_chars, SSE2, 16, sse2_stop_string, scalar_skip_string_chars)
+
+static const SimdKernels sse2_kernels = {
+    SIMD_SSE2,
+    sse2_skip_blanks, sse2_skip_space, sse2_find_newline,
+    sse2_count_newlines, sse2_skip_word, sse2_skip_string_chars
+};
+
+/*
+ * AVX2 kernels (32 bytes per block)
+ */
+
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 static inline __m256i avx2_in_range (__m256i v, char lo, char hi)
+{
+    __m256i d = _mm256_sub_epi8(v, _mm256_set1_epi8(lo));
+    return _mm256_cmpeq_epi8(_mm256_min_epu8(d, _mm256_set1_epi8((char)(hi - lo))), d);
+}
+
+AVX2 static inline __m256i avx2_eq (__m256i v, char c)
+{
+    return _mm256_cmpeq_epi8(v, _mm256_set1_epi8(c));
+}
+
+AVX2 static inline __m256i avx2_word (__m256i v)
+{
+    __m256i letter = avx2_in_range(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), 'a', 'z');
+    __m256i digit = avx2_in_range(v, '0', '9');
+    return _mm256_or_si256(_mm256_or_si256(letter, digit), avx2_eq(v, '_'));
+}
+
+AVX2 static inline __m256i avx2_load (const char* text)
+{
+    return _mm256_loadu_si256((const __m256i*)text);
+}
+
+AVX2 static inline uint32_t avx2_stop_blanks (const char* text)
+{
+    __m256i v = avx2_load(text);
+    __m256i in = _mm256_or_si256(avx2_eq(v, ' '), avx2_eq(v, '\t'));
+    return ~(uint32_t)_mm256_movemask_epi8(in);
+}
+
+AVX2 static inline uint32_t avx2_stop_space (const char* text)
+{
+    __m256i v = avx2_load(text);
+    __m256i in = _mm256_or_si256(_mm256_or_si256(avx2_eq(v, ' '), avx2_eq(v, '\t')),
+            avx2_eq(v, '\n'));
+    return ~(uint32_t)_mm256_movemask_epi8(in);
+}
+
+AVX2 static inline uint32_t avx2_newlines (const char* text)
+{
+    return (uint32_t)_mm256_movemask_epi8(avx2_eq(avx2_load(text), '\n'));
+}
+
+AVX2 static inline uint32_t avx2_stop_word (const char* text)
+{
+    return ~(uint32_t)_mm256_movemask_epi8(avx2_word(avx2_load(text)));
+}
+
+AVX2 static inline uint32_t avx2_stop_string (const char* text)
+{
+    __m256i v = avx2_load(text);
+    __m256i in = _mm256_or_si256(
+            _mm256_or_si256(_mm256_or_si256(avx2_word(v), avx2_eq(v, '\n')),
+                            _mm256_or_si256(avx2_eq(v, '\t'), avx2_eq(v, '#'))),
+            _mm256_or_si256(avx2_eq(v, ' '), avx2_eq(v, ':')));
+    return ~(uint32_t)_mm256_movemask_epi8(in);
+}
+
+STOP_KERNEL(avx2_skip_blanks, AVX2, 32, avx2_stop_blanks, sse2_skip_blanks)
+STOP_KERNEL(avx2_skip_space, AVX2, 32, avx2_stop_space, sse2_skip_space)
+STOP_KERNEL(avx2_find_newline, AVX2, 32, avx2_newlines, sse2_find_newline)
+COUNT_KERNEL(avx2_count_newlines, AVX2, 32, avx2_newlines, sse2_count_newlines)
+STOP_KERNEL(avx2_skip_word, AVX2, 32, avx2_stop_word, sse2_skip_word)
+STOP_KERNEL(avx2_skip_string_chars, AVX2, 32, avx2_stop_string, sse2_skip_string_chars)
+
+static const SimdKernels avx2_kernels = {
+    SIMD_AVX2,
+    avx2_skip_blanks, avx2_skip_space, avx2_find_newline,
+    avx2_count_newlines, avx2_skip_word, avx2_skip_string_chars
+};
+
+#endif
+
+/**
+ * @brief Kernels currently in use
+ */
+static const SimdKernels* kernels = &scalar_kernels;
+
+bool simd_supported (SimdLevel level)
+{
+    switch (level) {
+        case SIMD_SCALAR:
+            return true;
+#ifdef SIMD_X86
+        case SIMD_SSE2:
+            return __builtin_cpu_supports("sse2");
+        case SIMD_AVX2:
+            return __builtin_cpu_supports("avx2");
+#endif
+        default:
+            return false;
+    }
+}
+
+bool simd_set_level (SimdLevel level)
+{
+    if (!simd_supported(level)) {
+        return false;
+    }
+#ifdef SIMD_X86
+    if (level == SIMD_AVX2) {
+        kernels = &avx2_kernels;
+        return true;
+    } else if (level == SIMD_SSE2) {
+        kernels = &sse2_kernels;
+        return true;
+    }
+#endif
+    kernels = &scalar_kernels;
+    return true;
+}
+
+SimdLevel simd_level ()
+{
+    return kernels->level;
+}
+
+#ifdef SIMD_X86
+/**
+ * @brief Pick the fastest supported kernels before @c main runs (and so
+ * before any threads exist)
+ */
+__attribute__((constructor)) static void simd_init ()
+{
+    __builtin_cpu_init();
+
+    SimdLevel limit = SIMD_AVX2;
+    const char* env = getenv("DECAF_SIMD");
+    if (env != NULL && strcmp(env, "scalar") == 0) {
+        limit = SIMD_SCALAR;
+    } else if (env != NULL && strcmp(env, "sse2") == 0) {
+        limit = SIMD_SSE2;
+    }
+
+    for (int level = (int)limit; level > SIMD_SCALAR; level--) {
+        if (simd_set_level((SimdLevel)level)) {
+            return;
+        }
+    }
+}
+#endif
+
+const char* simd_skip_blanks (const char* text, const char* end)
+{
+    return kernels->skip_blanks(text, end);
+}
+
+const char* simd_skip_space (const char* text, const char* end)
+{
+    return kernels->skip_space(text, end);
+}
+
+const char* simd_find_newline (const char* text, const char* end)
+{
+    return kernels->find_newline(text, end);
+}
+
+size_t simd_count_newlines (const char* text, const char* end)
+{
+    return kernels->count_newlines(text, end);
+}
+
+const char* simd_skip_word (const char* text, const char* end)
+{
+    return kernels->skip_word(text, end);
+}
+
+const char* simd_skip_string_chars (const char* text, const char* end)
+{
+    return kernels->skip_string_chars(text, end);
+}
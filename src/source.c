@@ -0,0 +1,122 @@
+/**
+ * @file source.c
+ * @brief Reading source files into memory
+ */
+#define _DEFAULT_SOURCE
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "source.h"
+
+/**
+ * @brief Size of each read() call when a file cannot be mapped
+ */
+#define READ_BLOCK_SIZE 65536
+
+/**
+ * @brief Map a regular file into memory, followed by a zero page
+ *
+ * We first reserve an anonymous (zero-filled) mapping one page larger than
+ * the file and then map the file over the start of it. This guarantees that
+ * the byte after the last character is a readable NUL even when the file size
+ * is an exact multiple of the page size.
+ *
+ * @returns True if and only if the mapping succeeded
+ */
+static bool map_file (int fd, size_t length, SourceBuffer* source)
+{
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t size = (length / page + 1) * page;
+
+    char* region = mmap(NULL, size, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (region == MAP_FAILED) {
+        return false;
+    }
+    if (mmap(region, length, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        munmap(region, size);
+        return false;
+    }
+    source->text = region;
+    source->length = length;
+    source->mapped_size = size;
+    return true;
+}
+
+/**
+ * @brief Read everything from a file descriptor into a heap buffer
+ *
+ * @returns True if and only if the read succeeded
+ */
+static bool read_fd (int fd, SourceBuffer* source)
+{
+    size_t capacity = READ_BLOCK_SIZE;
+    size_t length = 0;
+    char* text = (char*)malloc(capacity + 1);
+    CHECK_MALLOC_PTR(text)
+
+    while (true) {
+        if (length == capacity) {
+            capacity *= 2;
+            text = (char*)realloc(text, capacity + 1);
+            CHECK_MALLOC_PTR(text)
+        }
+        ssize_t n = read(fd, text + length, capacity - length);
+        if (n == 0) {
+            break;
+        } else if (n < 0) {
+            free(text);
+            return false;
+        }
+        length += (size_t)n;
+    }
+    text[length] = '\0';
+
+    source->text = text;
+    source->length = length;
+    source->mapped_size = 0;
+    return true;
+}
+
+SourceBuffer* SourceBuffer_open (const char* filename)
+{
+    bool use_stdin = (strcmp(filename, "-") == 0);
+    int fd = use_stdin ? STDIN_FILENO : open(filename, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    SourceBuffer* source = (SourceBuffer*)calloc(1, sizeof(SourceBuffer));
+    CHECK_MALLOC_PTR(source)
+
+    /* map regular (non-empty) files; read everything else */
+    struct stat info;
+    bool ok = false;
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+        ok = map_file(fd, (size_t)info.st_size, source);
+    }
+    if (!ok) {
+        ok = read_fd(fd, source);
+    }
+
+    if (!use_stdin) {
+        close(fd);
+    }
+    if (!ok) {
+        free(source);
+        return NULL;
+    }
+    return source;
+}
+
+void SourceBuffer_free (SourceBuffer* source)
+{
+    if (source->mapped_size > 0) {
+        munmap((void*)source->text, source->mapped_size);
+    } else {
+        free((void*)source->text);
+    }
+    free(source);
+}
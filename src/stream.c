@@ -0,0 +1,92 @@
+/**
+ * @file stream.c
+ * @brief Streaming (pull-based) lexer over chunked input
+ */
+#include "stream.h"
+
+LexStream* LexStream_new (const Lexer* lexer)
+{
+    LexStream* stream = (LexStream*)calloc(1, sizeof(LexStream));
+    CHECK_MALLOC_PTR(stream)
+    stream->lexer = lexer;
+    ScanPosition_init(&stream->pos);
+    return stream;
+}
+
+void LexStream_feed (LexStream* stream, const char* chunk, size_t length)
+{
+    /* drop consumed input so the buffer only holds the unfinished lexeme */
+    size_t pending = stream->length - stream->start;
+    if (pending > 0 && stream->start > 0) {
+        memmove(stream->buffer, stream->buffer + stream->start, pending);
+    }
+    stream->start = 0;
+    stream->length = pending;
+
+    if (stream->length + length > stream->capacity) {
+        stream->capacity = stream->length + length;
+        stream->buffer = (char*)realloc(stream->buffer, stream->capacity);
+        CHECK_MALLOC_PTR(stream->buffer)
+    }
+    memcpy(stream->buffer + stream->length, chunk, length);
+    stream->length += length;
+}
+
+void LexStream_finish (LexStream* stream)
+{
+    stream->finished = true;
+}
+
+LexStreamStatus LexStream_next (LexStream* stream, Token** token)
+{
+    Lexeme lexeme;
+
+    while (!stream->failed) {
+        if (stream->start == stream->length) {
+            return stream->finished ? LEXSTREAM_END : LEXSTREAM_NEED_INPUT;
+        }
+
+        const char* p = stream->buffer + stream->start;
+        if (stream->lexer->engine == LEXER_TABLE) {
+            scan_table(p, stream->buffer + stream->length, &lexeme);
+        } else {
+            scan_dfa(p, stream->buffer + stream->length, &lexeme);
+        }
+        if (lexeme.at_end && !stream->finished) {
+            /* the rest of the lexeme might be in the next chunk */
+            return LEXSTREAM_NEED_INPUT;
+        }
+
+        if (lexeme.kind == LEX_INVALID) {
+            stream->failed = true;
+            break;
+        }
+
+        Token* t = &stream->token;
+        if (lexeme.kind == LEX_TOKEN) {
+            t->type = lexeme.type;
+            t->line = stream->pos.line;
+            t->column = (int)(stream->pos.offset - stream->pos.line_start) + 1;
+            t->length = (unsigned int)lexeme.length;
+            t->arena = true;    /* owned by the stream */
+            t->offset = stream->pos.offset;
+            t->text = p;
+            t->symbol = Lexer_intern(stream->lexer, lexeme.type, p, lexeme.length);
+            t->next = NULL;
+        }
+        ScanPosition_advance(&stream->pos, p, &lexeme);
+        stream->start += lexeme.length;
+
+        if (lexeme.kind == LEX_TOKEN) {
+            *token = t;
+            return LEXSTREAM_TOKEN;
+        }
+    }
+    return LEXSTREAM_ERROR;
+}
+
+void LexStream_free (LexStream* stream)
+{
+    free(stream->buffer);
+    free(stream);
+}
@@ -0,0 +1,178 @@
+/**
+ * @file symtab.c
+ * @brief Interned token text
+ */
+#include "symtab.h"
+
+/**
+ * @brief Initial number of hash slots (a power of two)
+ */
+#define SYMTAB_INITIAL_SLOTS 1024
+
+/**
+ * @brief Hash some text (32-bit FNV-1a)
+ */
+static uint32_t hash_text (const char* text, size_t length)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (unsigned char)text[i]) * 16777619u;
+    }
+    return hash;
+}
+
+SymbolTable* SymbolTable_new ()
+{
+    SymbolTable* table = (SymbolTable*)calloc(1, sizeof(SymbolTable));
+    CHECK_MALLOC_PTR(table)
+    table->slots = (Symbol*)calloc(SYMTAB_INITIAL_SLOTS, sizeof(Symbol));
+    CHECK_MALLOC_PTR(table->slots)
+    table->mask = SYMTAB_INITIAL_SLOTS - 1;
+
+    /* entry 0 stands for SYMBOL_NONE */
+    table->capacity = SYMTAB_INITIAL_SLOTS / 2;
+    table->entries = (SymbolEntry*)calloc(table->capacity, sizeof(SymbolEntry));
+    CHECK_MALLOC_PTR(table->entries)
+    table->count = 0;
+    pthread_mutex_init(&table->lock, NULL);
+    return table;
+}
+
+/**
+ * @brief Copy text into the arena, NUL-terminated (must be called with the
+ * lock held)
+ */
+static const char* store_text (SymbolTable* table, const char* text, size_t length)
+{
+    SymbolBlock* block = table->blocks;
+    if (block == NULL || block->used + length + 1 > block->size) {
+        size_t size = (length + 1 > SYMTAB_BLOCK_SIZE ? length + 1 : SYMTAB_BLOCK_SIZE);
+        block = (SymbolBlock*)malloc(sizeof(SymbolBlock) + size);
+        CHECK_MALLOC_PTR(block)
+        block->used = 0;
+        block->size = size;
+        block->next = table->blocks;
+        table->blocks = block;
+    }
+    char* copy = block->data + block->used;
+    memcpy(copy, text, length);
+    copy[length] = '\0';
+    block->used += length + 1;
+    table->bytes += length;
+    return copy;
+}
+
+/**
+ * @brief Double the number of hash slots (must be called with the lock held)
+ */
+static void grow_slots (SymbolTable* table)
+{
+    size_t size = 2 * (table->mask + 1);
+    Symbol* slots = (Symbol*)calloc(size, sizeof(Symbol));
+    CHECK_MALLOC_PTR(slots)
+    for (Symbol s = 1; s <= table->count; s++) {
+        size_t i = table->entries[s].hash & (size - 1);
+        while (slots[i] != SYMBOL_NONE) {
+            i = (i + 1) & (size - 1);
+        }
+        slots[i] = s;
+    }
+    free(table->slots);
+    table->slots = slots;
+    table->mask = size - 1;
+}
+
+Symbol SymbolTable_intern (SymbolTable* table, const char* text, size_t length)
+{
+    uint32_t hash = hash_text(text, length);
+
+    pthread_mutex_lock(&table->lock);
+    size_t i = hash & table->mask;
+    while (table->slots[i] != SYMBOL_NONE) {
+        const SymbolEntry* entry = &table->entries[table->slots[i]];
+        if (entry->hash == hash && entry->length == length &&
+                memcmp(entry->text, text, length) == 0) {
+            Symbol found = table->slots[i];
+            pthread_mutex_unlock(&table->lock);
+            return found;
+        }
+        i = (i + 1) & table->mask;
+    }
+
+    /* new text: add an entry and claim the empty slot */
+    if (table->count + 1 == table->capacity) {
+        table->capacity *= 2;
+        table->entries = (SymbolEntry*)realloc(table->entries,
+                table->capacity * sizeof(SymbolEntry));
+        CHECK_MALLOC_PTR(table->entries)
+    }
+    Symbol symbol = (Symbol)++table->count;
+    SymbolEntry* entry = &table->entries[symbol];
+    entry->text = store_text(table, text, length);
+    entry->length = (uint32_t)length;
+    entry->hash = hash;
+    table->slots[i] = symbol;
+    if (2 * table->count > table->mask) {
+        grow_slots(table);
+    }
+    pthread_mutex_unlock(&table->lock);
+    return symbol;
+}
+
+const char* SymbolTable_text (SymbolTable* table, Symbol symbol, size_t* length)
+{
+    const char* text = NULL;
+    pthread_mutex_lock(&table->lock);
+    if (symbol != SYMBOL_NONE && symbol <= table->count) {
+        text = table->entries[symbol].text;
+        if (length != NULL) {
+            *length = table->entries[symbol].length;
+        }
+    }
+    pthread_mutex_unlock(&table->lock);
+    return text;
+}
+
+size_t SymbolTable_size (SymbolTable* table, size_t* bytes)
+{
+    pthread_mutex_lock(&table->lock);
+    size_t count = table->count;
+    if (bytes != NULL) {
+        *bytes = table->bytes;
+    }
+    pthread_mutex_unlock(&table->lock);
+    return count;
+}
+
+/**
+ * @brief Free the text arena (must be called with the lock held)
+ */
+static void free_blocks (SymbolTable* table)
+{
+    SymbolBlock* block = table->blocks;
+    while (block != NULL) {
+        SymbolBlock* next = block->next;
+        free(block);
+        block = next;
+    }
+    table->blocks = NULL;
+    table->bytes = 0;
+}
+
+void SymbolTable_clear (SymbolTable* table)
+{
+    pthread_mutex_lock(&table->lock);
+    free_blocks(table);
+    memset(table->slots, 0, (table->mask + 1) * sizeof(Symbol));
+    table->count = 0;
+    pthread_mutex_unlock(&table->lock);
+}
+
+void SymbolTable_free (SymbolTable* table)
+{
+    free_blocks(table);
+    pthread_mutex_destroy(&table->lock);
+    free(table->entries);
+    free(table->slots);
+    free(table);
+}
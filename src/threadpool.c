@@ -0,0 +1,116 @@
+/**
+ * @file threadpool.c
+ * @brief Fixed-size pool of worker threads
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <unistd.h>
+
+#include "threadpool.h"
+
+/**
+ * @brief Worker thread main loop: run tasks until the pool stops
+ */
+static void* ThreadPool_worker (void* arg)
+{
+    ThreadPool* pool = (ThreadPool*)arg;
+
+    pthread_mutex_lock(&pool->lock);
+    while (true) {
+        while (pool->head == NULL && !pool->stopping) {
+            pthread_cond_wait(&pool->work, &pool->lock);
+        }
+        if (pool->head == NULL) {
+            break;      /* stopping and nothing left to do */
+        }
+
+        ThreadPoolJob* job = pool->head;
+        pool->head = job->next;
+        if (pool->head == NULL) {
+            pool->tail = NULL;
+        }
+        pool->active++;
+        pthread_mutex_unlock(&pool->lock);
+
+        job->task(job->arg);
+        free(job);
+
+        pthread_mutex_lock(&pool->lock);
+        pool->active--;
+        if (pool->head == NULL && pool->active == 0) {
+            pthread_cond_broadcast(&pool->idle);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+ThreadPool* ThreadPool_new (int nthreads)
+{
+    ThreadPool* pool = (ThreadPool*)calloc(1, sizeof(ThreadPool));
+    CHECK_MALLOC_PTR(pool)
+    pool->nthreads = (nthreads < 1 ? 1 : nthreads);
+    pool->threads = (pthread_t*)calloc(pool->nthreads, sizeof(pthread_t));
+    CHECK_MALLOC_PTR(pool->threads)
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work, NULL);
+    pthread_cond_init(&pool->idle, NULL);
+
+    for (int i = 0; i < pool->nthreads; i++) {
+        if (pthread_create(&pool->threads[i], NULL, ThreadPool_worker, pool) != 0) {
+            printf("Could not create thread!\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    return pool;
+}
+
+void ThreadPool_submit (ThreadPool* pool, ThreadPoolTask task, void* arg)
+{
+    ThreadPoolJob* job = (ThreadPoolJob*)calloc(1, sizeof(ThreadPoolJob));
+    CHECK_MALLOC_PTR(job)
+    job->task = task;
+    job->arg = arg;
+
+    pthread_mutex_lock(&pool->lock);
+    if (pool->tail == NULL) {
+        pool->head = job;
+    } else {
+        pool->tail->next = job;
+    }
+    pool->tail = job;
+    pthread_cond_signal(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void ThreadPool_wait (ThreadPool* pool)
+{
+    pthread_mutex_lock(&pool->lock);
+    while (pool->head != NULL || pool->active > 0) {
+        pthread_cond_wait(&pool->idle, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void ThreadPool_free (ThreadPool* pool)
+{
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = true;
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->nthreads; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->work);
+    pthread_cond_destroy(&pool->idle);
+    free(pool->threads);
+    free(pool);
+}
+
+int ThreadPool_cpu_count ()
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return (n < 1 ? 1 : (int)n);
+}
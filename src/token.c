@@ -1,4 +1,5 @@
 #include "token.h"
+#include "tokenpool.h"
 
 Regex* Regex_new (const char* regex)
 {
@@ -10,18 +11,58 @@ Regex* Regex_new (const char* regex)
 }
 
 bool Regex_match (Regex *regex, const char *text, char *match)
+{
+    RegexSpan span;
+    if (Regex_match_span(regex, text, &span)) {
+
+        /* save the match into the given string buffer (truncated to fit) */
+        size_t length = span.end - span.start;
+        if (length > MAX_TOKEN_LEN - 1) {
+            length = MAX_TOKEN_LEN - 1;
+        }
+        memcpy(match, text + span.start, length);
+        match[length] = '\0';
+        return true;
+    }
+    return false;
+}
+
+bool Regex_match_span (Regex* regex, const char* text, RegexSpan* span)
 {
     /* only save one element becase, we only care about the whole-regex match */
     regmatch_t matches[1];
     if (regexec(regex, text, 1, matches, 0) == 0) {
-
-        /* save the match into the given string buffer */
-        snprintf(match, matches[0].rm_eo+1, "%s", text);
+        span->start = (size_t)matches[0].rm_so;
+        span->end = (size_t)matches[0].rm_eo;
         return true;
     }
     return false;
 }
 
+bool Regex_match_n (Regex* regex, const char* text, size_t length, RegexSpan* span)
+{
+    regmatch_t matches[1];
+#ifdef REG_STARTEND
+    /* the search range is passed in (and the match returned in) matches[0] */
+    matches[0].rm_so = 0;
+    matches[0].rm_eo = (regoff_t)length;
+    bool matched = regexec(regex, text, 1, matches, REG_STARTEND) == 0;
+#else
+    /* no way to bound regexec, so match against a terminated copy */
+    char* copy = (char*)malloc(length + 1);
+    CHECK_MALLOC_PTR(copy)
+    memcpy(copy, text, length);
+    copy[length] = '\0';
+    bool matched = regexec(regex, copy, 1, matches, 0) == 0;
+    free(copy);
+#endif
+    if (matched) {
+        span->start = (size_t)matches[0].rm_so;
+        span->end = (size_t)matches[0].rm_eo;
+    }
+    return matched;
+}
+
 void Regex_free (Regex* regex)
 {
     regfree(regex); /* clean up regex_t structure */
@@ -46,20 +87,58 @@ bool token_str_eq (const char* str1, const char* str2)
     return strncmp(str1, str2, MAX_TOKEN_LEN) == 0;
 }
 
-Token* Token_new (TokenType type, const char* text, int line)
+Token* Token_new (TokenType type, const char* text, size_t length, int line)
 {
     Token* token = (Token*)calloc(1, sizeof(Token));
     CHECK_MALLOC_PTR(token)
     token->type = type;
-    snprintf(token->text, MAX_TOKEN_LEN, "%s", text);
+    token->text = text;
+    token->length = (unsigned int)length;
     token->line = line;
     token->next = NULL;
     return token;
 }
 
+char* Token_text (const Token* token, char* buffer, size_t size)
+{
+    size_t length = token->length < size ? token->length : size - 1;
+    memcpy(buffer, token->text, length);
+    buffer[length] = '\0';
+    return buffer;
+}
+
+bool Token_text_eq (const Token* token, const char* str)
+{
+    return strncmp(token->text, str, token->length) == 0 &&
+           str[token->length] == '\0';
+}
+
+void Token_end (const Token* token, int* line, int* column)
+{
+    *line = token->line;
+    *column = token->column + (int)token->length;
+    for (unsigned int i = 0; i < token->length; i++) {
+        if (token->text[i] == '\n') {
+            (*line)++;
+            *column = (int)(token->length - i);
+        }
+    }
+}
+
+bool Token_same_text (const Token* token1, const Token* token2)
+{
+    if (token1->symbol != SYMBOL_NONE && token2->symbol != SYMBOL_NONE) {
+        return token1->symbol == token2->symbol;
+    }
+    return token1->length == token2->length &&
+           memcmp(token1->text, token2->text, token1->length) == 0;
+}
+
 void Token_free (Token* token)
 {
-    free(token);
+    if (!token->arena) {
+        free(token);
+    }
 }
 
 TokenQueue* TokenQueue_new ()
@@ -69,8 +148,53 @@ TokenQueue* TokenQueue_new ()
     return queue;
 }
 
-void TokenQueue_add (TokenQueue* queue, Token* token)
+TokenQueue* TokenQueue_new_pooled (TokenPool* pool)
+{
+    TokenQueue* queue = TokenQueue_new();
+    queue->pool = TokenPool_retain(pool);
+    return queue;
+}
+
+/**
+ * @brief Return a storage block to wherever it came from
+ */
+static void TokenQueue_free_block (TokenQueue* queue, Token* block)
 {
+    if (queue->pool != NULL) {
+        TokenPool_give(queue->pool, block);
+    } else {
+        free(block);
+    }
+}
+
+/**
+ * @brief Reserve storage for a new token at the back of a queue and link it in
+ */
+static Token* TokenQueue_alloc (TokenQueue* queue)
+{
+    size_t slot = queue->count % TOKEN_CHUNK_SIZE;
+    if (slot == 0) {
+        /* current block is full (or there isn't one yet) */
+        if (queue->chunk_count == queue->chunk_capacity) {
+            queue->chunk_capacity = (queue->chunk_capacity == 0 ? 8 : queue->chunk_capacity * 2);
+            queue->chunks = (Token**)realloc(queue->chunks,
+                    queue->chunk_capacity * sizeof(Token*));
+            CHECK_MALLOC_PTR(queue->chunks)
+        }
+        if (queue->pool != NULL) {
+            queue->chunks[queue->chunk_count] = TokenPool_take(queue->pool);
+        } else {
+            queue->chunks[queue->chunk_count] =
+                (Token*)malloc(TOKEN_CHUNK_SIZE * sizeof(Token));
+            CHECK_MALLOC_PTR(queue->chunks[queue->chunk_count])
+        }
+        queue->chunk_count++;
+    }
+    Token* token = &queue->chunks[queue->count / TOKEN_CHUNK_SIZE][slot];
+    queue->count++;
+
+    token->arena = true;
+    token->next = NULL;
     if (queue->head == NULL) {
         /* empty list: new token is both head and tail */
         queue->head = token;
@@ -80,6 +204,48 @@ void TokenQueue_add (TokenQueue* queue, Token* token)
         queue->tail->next = token;
         queue->tail = token;
     }
+    return token;
+}
+
+void TokenQueue_add (TokenQueue* queue, Token* token)
+{
+    Token* copy = TokenQueue_alloc(queue);
+    copy->type = token->type;
+    copy->line = token->line;
+    copy->column = token->column;
+    copy->length = token->length;
+    copy->offset = token->offset;
+    copy->text = token->text;
+    copy->symbol = token->symbol;
+    Token_free(token);
+}
+
+Token* TokenQueue_emplace (TokenQueue* queue, TokenType type,
+        const char* text, size_t length, int line)
+{
+    Token* token = TokenQueue_alloc(queue);
+    token->type = type;
+    token->line = line;
+    token->column = 0;
+    token->length = (unsigned int)length;
+    token->offset = 0;
+    token->text = text;
+    token->symbol = SYMBOL_NONE;
+    return token;
+}
+
+void TokenQueue_append (TokenQueue* queue, TokenQueue* other, int line_delta)
+{
+    for (Token* token = other->head; token != NULL; token = token->next) {
+        Token* copy = TokenQueue_alloc(queue);
+        copy->type = token->type;
+        copy->line = token->line + line_delta;
+        copy->column = token->column;
+        copy->length = token->length;
+        copy->offset = token->offset;
+        copy->text = token->text;
+        copy->symbol = token->symbol;
+    }
 }
 
 Token* TokenQueue_peek (TokenQueue* queue)
@@ -87,7 +253,62 @@ Token* TokenQueue_peek (TokenQueue* queue)
     return queue->head;
 }
 
-Token* TokenQueue_remove (TokenQueue* queue)
+Token* TokenQueue_get (TokenQueue* queue, size_t index)
+{
+    if (index >= queue->count - queue->first) {
+        return NULL;
+    }
+    index += queue->first;
+    return &queue->chunks[index / TOKEN_CHUNK_SIZE][index % TOKEN_CHUNK_SIZE];
+}
+
+Token* TokenQueue_splice (TokenQueue* queue, size_t index, size_t removed,
+        size_t added)
+{
+    size_t size = queue->count - queue->first;
+    size_t after = size - index - removed;     /* tokens after the range */
+
+    if (added > removed) {
+        /* make room at the end, then move the later tokens back */
+        for (size_t i = removed; i < added; i++) {
+            TokenQueue_alloc(queue);
+        }
+        for (size_t i = after; i > 0; i--) {
+            *TokenQueue_get(queue, index + added + i - 1) =
+                *TokenQueue_get(queue, index + removed + i - 1);
+        }
+    } else if (removed > added) {
+        /* move the later tokens forward, then drop blocks no longer used */
+        for (size_t i = 0; i < after; i++) {
+            *TokenQueue_get(queue, index + added + i) =
+                *TokenQueue_get(queue, index + removed + i);
+        }
+        queue->count -= removed - added;
+        size_t needed = (queue->count + TOKEN_CHUNK_SIZE - 1) / TOKEN_CHUNK_SIZE;
+        while (queue->chunk_count > needed) {
+            TokenQueue_free_block(queue, queue->chunks[--queue->chunk_count]);
+        }
+    }
+
+    /* relink from the token before the range to the last one that moved */
+    size = size - removed + added;
+    if (size == 0) {
+        queue->head = NULL;
+        queue->tail = NULL;
+        return NULL;
+    }
+    size_t last = (added == removed ? index + added + 1 : size);
+    for (size_t i = (index > 0 ? index - 1 : 0); i < last && i < size; i++) {
+        Token* token = TokenQueue_get(queue, i);
+        token->arena = true;
+        token->next = (i + 1 < size ? TokenQueue_get(queue, i + 1) : NULL);
+    }
+    queue->head = TokenQueue_get(queue, 0);
+    queue->tail = TokenQueue_get(queue, size - 1);
+    return (added > 0 ? TokenQueue_get(queue, index) : NULL);
+}
+
+Token* TokenQueue_next (TokenQueue* queue)
 {
     if (queue->head == NULL) {
         /* queue is empty: return NULL */
@@ -96,6 +317,7 @@ Token* TokenQueue_remove (TokenQueue* queue)
         /* queue is non-empty: remove a token from head and return it */
         Token* tmp = queue->head;
         queue->head = queue->head->next;
+        queue->first++;
         if (queue->head == NULL) {
             queue->tail = NULL;    /* just removed the last item */
         }
@@ -103,6 +325,21 @@ Token* TokenQueue_remove (TokenQueue* queue)
     }
 }
 
+Token* TokenQueue_remove (TokenQueue* queue)
+{
+    Token* token = TokenQueue_next(queue);
+    if (token == NULL) {
+        return NULL;
+    }
+
+    /* hand the caller a copy that does not live in the queue's blocks */
+    Token* copy = Token_new(token->type, token->text, token->length, token->line);
+    copy->column = token->column;
+    copy->offset = token->offset;
+    copy->symbol = token->symbol;
+    return copy;
+}
+
 bool TokenQueue_is_empty (TokenQueue* queue)
 {
     return queue->head == NULL;
@@ -110,27 +347,34 @@ bool TokenQueue_is_empty (TokenQueue* queue)
 
 size_t TokenQueue_size (TokenQueue* queue)
 {
-    size_t size = 0;
-    for (Token* cur = queue->head; cur != NULL; cur = cur->next) {
-        size++;
-    }
-    return size;
+    return queue->count - queue->first;
 }
 
 void TokenQueue_print (TokenQueue* queue, FILE* out)
 {
+    /* same output as "%-8s [line %03d]  %.*s\n" for each token */
+    OutputBuffer buffer;
+    OutputBuffer_init(&buffer, out);
     for (Token* t = queue->head; t != NULL; t = t->next) {
-        fprintf(out, "%-8s [line %03d]  %s\n",
-                TokenType_to_string(t->type),
-                t->line, t->text);
+        OutputBuffer_write_padded(&buffer, TokenType_to_string(t->type), 8);
+        OutputBuffer_write(&buffer, " [line ", 7);
+        OutputBuffer_write_int(&buffer, t->line, 3);
+        OutputBuffer_write(&buffer, "]  ", 3);
+        OutputBuffer_write(&buffer, t->text, t->length);
+        OutputBuffer_putc(&buffer, '\n');
     }
+    OutputBuffer_flush(&buffer);
 }
 
 void TokenQueue_free (TokenQueue* queue)
 {
-    /* clean up any remaining tokens */
-    while (!TokenQueue_is_empty(queue)) {
-        Token_free(TokenQueue_remove(queue));
+    /* tokens live in the blocks, so there is nothing to free one at a time */
+    for (size_t i = 0; i < queue->chunk_count; i++) {
+        TokenQueue_free_block(queue, queue->chunks[i]);
+    }
+    if (queue->pool != NULL) {
+        TokenPool_release(queue->pool);
     }
+    free(queue->chunks);
     free(queue);
 }
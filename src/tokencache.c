@@ -0,0 +1,227 @@
+/**
+ * @file tokencache.c
+ * @brief On-disk cache of lexed token streams
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "p1-lexer.h"
+#include "tokencache.h"
+
+/**
+ * @brief Maximum length of a path inside the cache directory
+ */
+#define CACHE_PATH_LEN 4096
+
+/**
+ * @brief Cache entry found while looking for entries to evict
+ */
+typedef struct CacheEntry
+{
+    char name[256];         /**< @brief File name (inside the directory) */
+    size_t size;            /**< @brief File size */
+    struct timespec used;   /**< @brief Last use (modification time) */
+} CacheEntry;
+
+/**
+ * @brief Fast (non-cryptographic) 64-bit hash of a source text
+ *
+ * Mixes eight bytes at a time; good enough to tell apart the versions of the
+ * files being compiled, which is all a cache key needs.
+ */
+static uint64_t hash_source (const char* text, size_t length)
+{
+    uint64_t hash = 0x9e3779b97f4a7c15ull ^ (uint64_t)length;
+    size_t i = 0;
+    for (; i + 8 <= length; i += 8) {
+        uint64_t word;
+        memcpy(&word, text + i, 8);
+        hash = (hash ^ word) * 0xff51afd7ed558ccdull;
+        hash ^= hash >> 32;
+    }
+    uint64_t tail = 0;
+    memcpy(&tail, text + i, length - i);
+    hash = (hash ^ tail) * 0xc4ceb9fe1a85ec53ull;
+    hash ^= hash >> 29;
+    return hash;
+}
+
+/**
+ * @brief Build the path of the entry for a source text
+ */
+static void entry_path (const TokenCache* cache, const char* text, size_t length,
+        char* path)
+{
+    snprintf(path, CACHE_PATH_LEN, "%s/%016" PRIx64 "-%zx-v%d.tok", cache->dir,
+            hash_source(text, length), length, LEXER_VERSION);
+}
+
+/**
+ * @brief Check whether a directory entry is a cache entry
+ */
+static bool is_entry_name (const char* name)
+{
+    size_t len = strlen(name);
+    return name[0] != '.' && len > 4 && strcmp(name + len - 4, ".tok") == 0;
+}
+
+/**
+ * @brief Order cache entries from least to most recently used
+ */
+static int compare_used (const void* a, const void* b)
+{
+    const struct timespec* t1 = &((const CacheEntry*)a)->used;
+    const struct timespec* t2 = &((const CacheEntry*)b)->used;
+    if (t1->tv_sec != t2->tv_sec) {
+        return (t1->tv_sec < t2->tv_sec ? -1 : 1);
+    }
+    return (t1->tv_nsec < t2->tv_nsec ? -1 : (t1->tv_nsec > t2->tv_nsec));
+}
+
+/**
+ * @brief Delete least recently used entries until the directory fits in its
+ * size limit (must be called with the lock held)
+ */
+static void evict (TokenCache* cache)
+{
+    DIR* dir = opendir(cache->dir);
+    if (dir == NULL) {
+        return;
+    }
+
+    CacheEntry* entries = NULL;
+    size_t count = 0, capacity = 0, total = 0;
+    char path[CACHE_PATH_LEN];
+    struct dirent* d;
+    while ((d = readdir(dir)) != NULL) {
+        struct stat info;
+        snprintf(path, CACHE_PATH_LEN, "%s/%s", cache->dir, d->d_name);
+        if (!is_entry_name(d->d_name) || strlen(d->d_name) >= sizeof(entries->name) ||
+                stat(path, &info) != 0) {
+            continue;
+        }
+        if (count == capacity) {
+            capacity = (capacity == 0 ? 64 : capacity * 2);
+            entries = (CacheEntry*)realloc(entries, capacity * sizeof(CacheEntry));
+            CHECK_MALLOC_PTR(entries)
+        }
+        snprintf(entries[count].name, sizeof(entries->name), "%s", d->d_name);
+        entries[count].size = (size_t)info.st_size;
+        entries[count].used = info.st_mtim;
+        total += entries[count].size;
+        count++;
+    }
+    closedir(dir);
+
+    if (total > cache->max_size) {
+        qsort(entries, count, sizeof(CacheEntry), compare_used);
+        for (size_t i = 0; i < count && total > cache->max_size; i++) {
+            snprintf(path, CACHE_PATH_LEN, "%s/%s", cache->dir, entries[i].name);
+            if (unlink(path) == 0 || errno == ENOENT) {
+                total -= entries[i].size;
+                cache->evictions++;
+            }
+        }
+    }
+    free(entries);
+}
+
+TokenCache* TokenCache_new (const char* dir, size_t max_size)
+{
+    struct stat info;
+    if (mkdir(dir, 0777) != 0 && errno != EEXIST) {
+        return NULL;
+    }
+    if (stat(dir, &info) != 0 || !S_ISDIR(info.st_mode) ||
+            strlen(dir) > CACHE_PATH_LEN / 2) {
+        return NULL;
+    }
+
+    TokenCache* cache = (TokenCache*)calloc(1, sizeof(TokenCache));
+    CHECK_MALLOC_PTR(cache)
+    cache->dir = (char*)malloc(strlen(dir) + 1);
+    CHECK_MALLOC_PTR(cache->dir)
+    strcpy(cache->dir, dir);
+    cache->max_size = max_size;
+    pthread_mutex_init(&cache->lock, NULL);
+    return cache;
+}
+
+bool TokenCache_lookup (TokenCache* cache, const char* text, size_t length,
+        TokenFile* file)
+{
+    char path[CACHE_PATH_LEN];
+    entry_path(cache, text, length, path);
+
+    bool hit = TokenFile_open(file, path);
+    if (hit) {
+        utimensat(AT_FDCWD, path, NULL, 0);     /* mark as recently used */
+    } else if (access(path, F_OK) == 0) {
+        unlink(path);                           /* damaged entry */
+    }
+
+    pthread_mutex_lock(&cache->lock);
+    if (hit) {
+        cache->hits++;
+    } else {
+        cache->misses++;
+    }
+    pthread_mutex_unlock(&cache->lock);
+    return hit;
+}
+
+void TokenCache_store (TokenCache* cache, const char* text, size_t length,
+        TokenQueue* tokens)
+{
+    char path[CACHE_PATH_LEN];
+    char tmp[CACHE_PATH_LEN];
+    entry_path(cache, text, length, path);
+    snprintf(tmp, CACHE_PATH_LEN, "%s/.tmp-XXXXXX", cache->dir);
+
+    /* write to a private file and then atomically move it into place */
+    int fd = mkstemp(tmp);
+    if (fd < 0) {
+        return;
+    }
+    FILE* out = fdopen(fd, "wb");
+    if (out == NULL) {
+        close(fd);
+        unlink(tmp);
+        return;
+    }
+    bool ok = TokenQueue_write_binary(tokens, out);
+    ok = (fclose(out) == 0) && ok;
+    if (!ok || rename(tmp, path) != 0) {
+        unlink(tmp);
+        return;
+    }
+
+    pthread_mutex_lock(&cache->lock);
+    cache->stores++;
+    evict(cache);
+    pthread_mutex_unlock(&cache->lock);
+}
+
+void TokenCache_clear (TokenCache* cache)
+{
+    pthread_mutex_lock(&cache->lock);
+    size_t max_size = cache->max_size;
+    size_t evictions = cache->evictions;
+    cache->max_size = 0;
+    evict(cache);
+    cache->max_size = max_size;
+    cache->evictions = evictions;
+    pthread_mutex_unlock(&cache->lock);
+}
+
+void TokenCache_free (TokenCache* cache)
+{
+    pthread_mutex_destroy(&cache->lock);
+    free(cache->dir);
+    free(cache);
+}
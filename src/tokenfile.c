@@ -0,0 +1,227 @@
+/**
+ * @file tokenfile.c
+ * @brief Compact binary token stream format
+ */
+#define _DEFAULT_SOURCE
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "tokenfile.h"
+
+/**
+ * @brief Slot in the string table's deduplication hash
+ */
+typedef struct StringSlot
+{
+    uint32_t text;      /**< @brief Offset in the string table */
+    uint32_t length;    /**< @brief Length of the string */
+    bool used;          /**< @brief False for empty slots */
+} StringSlot;
+
+/**
+ * @brief String table under construction
+ */
+typedef struct StringTable
+{
+    char* data;         /**< @brief Table contents */
+    size_t size;        /**< @brief Bytes used */
+    size_t capacity;    /**< @brief Bytes allocated */
+    StringSlot* slots;  /**< @brief Open-addressing hash of the strings */
+    size_t mask;        /**< @brief Number of slots minus one */
+} StringTable;
+
+/**
+ * @brief FNV-1a hash of a token text
+ */
+static uint32_t hash_text (const char* text, size_t length)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (unsigned char)text[i]) * 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * @brief Add a string to the table (once) and return its offset
+ */
+static size_t StringTable_add (StringTable* table, const char* text, size_t length)
+{
+    size_t i = hash_text(text, length) & table->mask;
+    while (table->slots[i].used) {
+        StringSlot* slot = &table->slots[i];
+        if (slot->length == length &&
+                memcmp(table->data + slot->text, text, length) == 0) {
+            return slot->text;
+        }
+        i = (i + 1) & table->mask;
+    }
+
+    if (table->size + length > table->capacity) {
+        while (table->size + length > table->capacity) {
+            table->capacity = (table->capacity == 0 ? 4096 : table->capacity * 2);
+        }
+        table->data = (char*)realloc(table->data, table->capacity);
+        CHECK_MALLOC_PTR(table->data)
+    }
+    size_t offset = table->size;
+    memcpy(table->data + offset, text, length);
+    table->size += length;
+
+    table->slots[i].text = (uint32_t)offset;
+    table->slots[i].length = (uint32_t)length;
+    table->slots[i].used = true;
+    return offset;
+}
+
+bool TokenQueue_write_binary (TokenQueue* queue, FILE* out)
+{
+    size_t count = TokenQueue_size(queue);
+    if (count > UINT32_MAX) {
+        return false;
+    }
+
+    /* at most half full, so probes stay short */
+    StringTable table = { NULL, 0, 0, NULL, 0 };
+    size_t nslots = 64;
+    while (nslots < 2 * count) {
+        nslots *= 2;
+    }
+    table.slots = (StringSlot*)calloc(nslots, sizeof(StringSlot));
+    CHECK_MALLOC_PTR(table.slots)
+    table.mask = nslots - 1;
+
+    TokenRecord* records = (TokenRecord*)malloc((count > 0 ? count : 1) * sizeof(TokenRecord));
+    CHECK_MALLOC_PTR(records)
+
+    bool ok = true;
+    size_t i = 0;
+    for (Token* t = queue->head; t != NULL && ok; t = t->next, i++) {
+        size_t text = StringTable_add(&table, t->text, t->length);
+        ok = table.size <= UINT32_MAX && t->offset <= UINT32_MAX;
+        records[i].type = (uint32_t)t->type;
+        records[i].line = (uint32_t)t->line;
+        records[i].column = (uint32_t)t->column;
+        records[i].offset = (uint32_t)t->offset;
+        records[i].text = (uint32_t)text;
+        records[i].length = t->length;
+    }
+
+    if (ok) {
+        TokenFileHeader header = { TOKENFILE_MAGIC, TOKENFILE_VERSION,
+            TOKENFILE_BYTE_ORDER, (uint32_t)count, (uint32_t)table.size, 0 };
+        ok = fwrite(&header, sizeof(header), 1, out) == 1 &&
+             fwrite(records, sizeof(TokenRecord), count, out) == count &&
+             fwrite(table.data, 1, table.size, out) == table.size &&
+             fflush(out) == 0;
+    }
+
+    free(records);
+    free(table.slots);
+    free(table.data);
+    return ok;
+}
+
+bool TokenFile_init (TokenFile* file, const void* data, size_t size)
+{
+    const TokenFileHeader* header = (const TokenFileHeader*)data;
+    if (size < sizeof(TokenFileHeader) || header->magic != TOKENFILE_MAGIC ||
+            header->version != TOKENFILE_VERSION ||
+            header->byte_order != TOKENFILE_BYTE_ORDER) {
+        return false;
+    }
+    uint64_t expected = sizeof(TokenFileHeader) +
+        (uint64_t)header->token_count * sizeof(TokenRecord) + header->strings_size;
+    if (expected != size) {
+        return false;
+    }
+
+    const TokenRecord* records = (const TokenRecord*)(header + 1);
+    for (size_t i = 0; i < header->token_count; i++) {
+        if (records[i].type > SYM ||
+                (uint64_t)records[i].text + records[i].length > header->strings_size) {
+            return false;
+        }
+    }
+
+    file->header = header;
+    file->records = records;
+    file->strings = (const char*)(records + header->token_count);
+    file->map = NULL;
+    file->map_size = 0;
+    return true;
+}
+
+bool TokenFile_open (TokenFile* file, const char* filename)
+{
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) || info.st_size == 0) {
+        close(fd);
+        return false;
+    }
+
+    size_t size = (size_t)info.st_size;
+    void* map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+    if (!TokenFile_init(file, map, size)) {
+        munmap(map, size);
+        return false;
+    }
+    file->map = map;
+    file->map_size = size;
+    return true;
+}
+
+size_t TokenFile_size (const TokenFile* file)
+{
+    return file->header->token_count;
+}
+
+void TokenFile_get (const TokenFile* file, size_t index, Token* token)
+{
+    const TokenRecord* record = &file->records[index];
+    token->type = (TokenType)record->type;
+    token->line = (int)record->line;
+    token->column = (int)record->column;
+    token->length = record->length;
+    token->arena = false;
+    token->offset = record->offset;
+    token->text = file->strings + record->text;
+    token->symbol = SYMBOL_NONE;
+    token->next = NULL;
+}
+
+TokenQueue* TokenFile_to_queue (const TokenFile* file)
+{
+    TokenQueue* queue = TokenQueue_new();
+    size_t count = TokenFile_size(file);
+    for (size_t i = 0; i < count; i++) {
+        const TokenRecord* record = &file->records[i];
+        Token* token = TokenQueue_emplace(queue, (TokenType)record->type,
+                file->strings + record->text, record->length, (int)record->line);
+        token->column = (int)record->column;
+        token->offset = record->offset;
+    }
+    return queue;
+}
+
+void TokenFile_close (TokenFile* file)
+{
+    if (file->map != NULL) {
+        munmap(file->map, file->map_size);
+    }
+    file->map = NULL;
+    file->header = NULL;
+    file->records = NULL;
+    file->strings = NULL;
+}
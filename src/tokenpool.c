@@ -0,0 +1,104 @@
+/**
+ * @file tokenpool.c
+ * @brief Recycling pool for token storage blocks
+ */
+#include "tokenpool.h"
+
+/**
+ * @brief Release free blocks until the free list fits in its limit (must be
+ * called with the lock held)
+ */
+static void trim (TokenPool* pool)
+{
+    while (pool->stats.free > pool->stats.max_free) {
+        Token* block = pool->free_list;
+        pool->free_list = block->next;
+        pool->stats.free--;
+        pool->stats.released++;
+        free(block);
+    }
+}
+
+TokenPool* TokenPool_new (size_t max_free)
+{
+    TokenPool* pool = (TokenPool*)calloc(1, sizeof(TokenPool));
+    CHECK_MALLOC_PTR(pool)
+    pool->stats.block_size = TOKEN_CHUNK_SIZE * sizeof(Token);
+    pool->stats.max_free = max_free;
+    pool->refs = 1;
+    pthread_mutex_init(&pool->lock, NULL);
+    return pool;
+}
+
+TokenPool* TokenPool_retain (TokenPool* pool)
+{
+    pthread_mutex_lock(&pool->lock);
+    pool->refs++;
+    pthread_mutex_unlock(&pool->lock);
+    return pool;
+}
+
+Token* TokenPool_take (TokenPool* pool)
+{
+    pthread_mutex_lock(&pool->lock);
+    Token* block = pool->free_list;
+    if (block != NULL) {
+        pool->free_list = block->next;
+        pool->stats.free--;
+        pool->stats.reused++;
+    } else {
+        pool->stats.allocated++;
+    }
+    pool->stats.in_use++;
+    if (pool->stats.in_use > pool->stats.peak_in_use) {
+        pool->stats.peak_in_use = pool->stats.in_use;
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    if (block == NULL) {
+        block = (Token*)malloc(TOKEN_CHUNK_SIZE * sizeof(Token));
+        CHECK_MALLOC_PTR(block)
+    }
+    return block;
+}
+
+void TokenPool_give (TokenPool* pool, Token* block)
+{
+    pthread_mutex_lock(&pool->lock);
+    block->next = pool->free_list;
+    pool->free_list = block;
+    pool->stats.free++;
+    pool->stats.in_use--;
+    trim(pool);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void TokenPool_get_stats (TokenPool* pool, TokenPoolStats* stats)
+{
+    pthread_mutex_lock(&pool->lock);
+    *stats = pool->stats;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void TokenPool_set_limit (TokenPool* pool, size_t max_free)
+{
+    pthread_mutex_lock(&pool->lock);
+    pool->stats.max_free = max_free;
+    trim(pool);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void TokenPool_release (TokenPool* pool)
+{
+    pthread_mutex_lock(&pool->lock);
+    size_t refs = --pool->refs;
+    pthread_mutex_unlock(&pool->lock);
+    if (refs > 0) {
+        return;
+    }
+
+    pool->stats.max_free = 0;
+    trim(pool);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool);
+}
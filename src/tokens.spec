@@ -0,0 +1,39 @@
+#
+# Decaf token grammar
+#
+# Read by tools/lexgen at build time to generate the table-driven scanner in
+# src/lextables.c (see scan_table in include/scanner.h). Each rule is a line of
+#
+#   name  priority  action  pattern
+#
+# The scanner takes the longest prefix of the input matched by any pattern;
+# if several rules match that prefix, the one with the lowest priority number
+# wins. The pattern is the rest of the line (so it may contain spaces) in POSIX
+# extended syntax: literals, \-escapes (\n, \t, \xHH, or a quoted character),
+# [classes] with ranges and ^, ., grouping, |, *, +, and ?. A pattern may not
+# match the empty string.
+#
+# Actions:
+#   skip      spaces and tabs (LEX_BLANK)
+#   newline   line breaks and the whitespace after them (LEX_NEWLINE)
+#   comment   a line comment (LEX_COMMENT)
+#   word      identifier, keyword, or reserved word (see scan_classify_word)
+#   error     an invalid lexeme (LEX_INVALID)
+#   ID, DECLIT, HEXLIT, STRLIT, KEY, SYM
+#             a token of that type
+#
+# Text not matched by any rule is an invalid character. The priorities are
+# those of the regular expressions in Lexer_new, which remain the reference
+# implementation; keep the two in sync.
+#
+
+whitespace  1   skip     [ \t]+
+newline     2   newline  \n[ \t\n]*
+comment     3   comment  //[^\n]*
+hex         4   HEXLIT   0x[0-9a-f]*
+letter      5   word     [a-zA-Z][a-zA-Z0-9_]*
+numbers     6   DECLIT   0|[1-9]+0*
+or_equal    7   SYM      [<>=!]=
+grouping    8   SYM      [(){}\[\],;]
+symbols     9   SYM      \+|\*|=|-|%|&&|!|>|<|/|\|\|
+strings     10  STRLIT   "([a-zA-Z0-9\n\t #_:]|\\"|\\)*"
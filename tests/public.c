@@ -6,7 +6,16 @@
  * tests.
  */
 
+#include <arpa/inet.h>
+#include <unistd.h>
+
 #include "testsuite.h"
+#include "lexstats.h"
+#include "server.h"
+#include "simd.h"
+#include "source.h"
+#include "tokencache.h"
+#include "tokenfile.h"
 
 #ifndef SKIP_IN_DOXYGEN
 
@@ -43,10 +52,981 @@ Token multi_tokens2[] = { { .type = KEY, .text = "def", .line = 1 },
 
 TEST_TOKENS (B_multi_tokens2, "def foo;", 3, multi_tokens2)
 
+Token positions[] = { { .type = ID,     .text = "a",      .line = 1, .column = 1 },
+                      { .type = SYM,    .text = "=",      .line = 1, .column = 3 },
+                      { .type = DECLIT, .text = "1",      .line = 1, .column = 5 },
+                      { .type = KEY,    .text = "return", .line = 2, .column = 2 },
+                      { .type = ID,     .text = "b",      .line = 2, .column = 9 } };
+
+TEST_TOKENS (A_positions, "a = 1 // c\n\treturn b", 5, positions)
+
+START_TEST (A_token_text)
+{
+    char buffer[4];
+    TokenQueue* tokens = run_lexer("abcdef + x");
+    ck_assert (tokens != NULL);
+    ck_assert (tokens->head->offset == 0 && tokens->head->length == 6);
+    ck_assert (strcmp(Token_text(tokens->head, buffer, sizeof(buffer)), "abc") == 0);
+    ck_assert (tokens->tail->offset == 9);
+    ck_assert (strcmp(Token_text(tokens->tail, buffer, sizeof(buffer)), "x") == 0);
+    TokenQueue_free(tokens);
+}
+END_TEST
+
+START_TEST (A_queue_random_access)
+{
+    TokenQueue* queue = TokenQueue_new();
+    for (int i = 0; i < 3 * TOKEN_CHUNK_SIZE; i++) {
+        Token* token = TokenQueue_emplace(queue, DECLIT, "1", 1, 1);
+        token->offset = (size_t)i;
+    }
+    TokenQueue_add(queue, Token_new(ID, "x", 1, 7));
+    ck_assert (TokenQueue_size(queue) == 3 * TOKEN_CHUNK_SIZE + 1);
+
+    /* tokens taken with TokenQueue_next stay in the queue's storage */
+    Token* kept = NULL;
+    for (int i = 0; i < TOKEN_CHUNK_SIZE + 5; i++) {
+        Token* token = (i == 0 ? TokenQueue_remove(queue) : TokenQueue_next(queue));
+        ck_assert (token->offset == (size_t)i);
+        ck_assert (token->arena == (i != 0));
+        if (i == 0) {
+            kept = token;
+        }
+    }
+    ck_assert (TokenQueue_size(queue) == 2 * TOKEN_CHUNK_SIZE - 4);
+    ck_assert (TokenQueue_peek(queue) == TokenQueue_get(queue, 0));
+    ck_assert (TokenQueue_get(queue, 10)->offset == TOKEN_CHUNK_SIZE + 15);
+    ck_assert (TokenQueue_get(queue, 2 * TOKEN_CHUNK_SIZE - 5)->type == ID);
+    ck_assert (TokenQueue_get(queue, 2 * TOKEN_CHUNK_SIZE - 4) == NULL);
+
+    size_t n = 0;
+    FOR_EACH (Token*, t, queue) {
+        n++;
+    }
+    ck_assert (n == TokenQueue_size(queue));
+    TokenQueue_free(queue);
+
+    /* a token from TokenQueue_remove belongs to the caller and outlives it */
+    ck_assert (kept->type == DECLIT && kept->offset == 0 && kept->next == NULL);
+    ck_assert (Token_text_eq(kept, "1"));
+    Token_free(kept);
+}
+END_TEST
+
+START_TEST (A_source_large_file)
+{
+    /* bigger than the old 64 KiB limit and an exact multiple of the page size */
+    const char* filename = "source-test.tmp";
+    size_t nlines = 32768;
+    FILE* out = fopen(filename, "w");
+    ck_assert (out != NULL);
+    for (size_t i = 0; i < nlines; i++) {
+        fputs("a;/\n", out);
+    }
+    fclose(out);
+
+    SourceBuffer* source = SourceBuffer_open(filename);
+    remove(filename);
+    ck_assert (source != NULL);
+    ck_assert (source->length == 4 * nlines);
+    ck_assert (source->text[source->length] == '\0');
+
+    Lexer* lexer = Lexer_new(LEXER_DFA);
+    TokenQueue* tokens = Lexer_lex_n(lexer, source->text, source->length);
+    ck_assert (TokenQueue_size(tokens) == 3 * nlines);
+    ck_assert (tokens->tail->line == (int)nlines);
+    TokenQueue_free(tokens);
+    Lexer_free(lexer);
+    SourceBuffer_free(source);
+}
+END_TEST
+
+START_TEST (A_lex_n_bounded)
+{
+    /* slices of a larger buffer end at their length with both engines */
+    const char buffer[] = "abc def// xyz\n\"str\" 0x1f";
+    char error[MAX_ERROR_LEN];
+    for (int engine = LEXER_REGEX; engine <= LEXER_TABLE; engine++) {
+        Lexer* lexer = Lexer_new((LexerEngine)engine);
+        TokenQueue* tokens = Lexer_lex_n(lexer, buffer, 5);
+        ck_assert (TokenQueue_size(tokens) == 2);
+        ck_assert (Token_text_eq(tokens->tail, "d"));
+        TokenQueue_free(tokens);
+
+        tokens = Lexer_lex_n(lexer, buffer, 11);        /* inside the comment */
+        ck_assert (TokenQueue_size(tokens) == 2);
+        TokenQueue_free(tokens);
+
+        tokens = Lexer_lex_n(lexer, buffer + 4, 18);    /* inside the hex */
+        ck_assert (TokenQueue_size(tokens) == 3);
+        ck_assert (Token_text_eq(tokens->tail, "0x"));
+        TokenQueue_free(tokens);
+
+        ck_assert (Lexer_try_lex_n(lexer, buffer + 14, 3, error) == NULL);
+        ck_assert (Lexer_try_lex_n(lexer, "a\0b", 3, error) == NULL);
+        Lexer_free(lexer);
+    }
+
+    TokenQueue* tokens = lex_n(buffer + 14, 5);
+    ck_assert (TokenQueue_size(tokens) == 1);
+    ck_assert (tokens->head->type == STRLIT);
+    TokenQueue_free(tokens);
+}
+END_TEST
+
+/**
+ * @brief Build a program big enough to be split across threads
+ *
+ * Every fourth block is one long multi-line string, so that some of the splits
+ * fall inside a string literal; an invalid token can be placed near the end.
+ */
+static char* parallel_program (size_t* length, bool invalid)
+{
+    const char* code = "def int f(int x) {\n\tif (x <= 0x1f) { return x; } // c\n"
+                       "\ts = \"multi\nline\\\" str\";\n}\n";
+    size_t size = 6 * LEXER_MIN_PARALLEL_CHUNK;
+    char* text = (char*)malloc(size + 1);
+    size_t used = 0;
+    for (size_t block = 0; used + 4096 < size; block++) {
+        if (block % 4 == 3) {
+            text[used++] = '"';
+            while (used % 1024 != 1000) {
+                text[used] = (used % 8 == 0 ? '\n' : 'a');
+                used++;
+            }
+            text[used++] = '"';
+            text[used++] = ';';
+        } else {
+            for (int i = 0; i < 32; i++) {
+                memcpy(text + used, code, strlen(code));
+                used += strlen(code);
+            }
+        }
+    }
+    if (invalid) {
+        memcpy(text + used - 8, " & ", 3);
+    }
+    text[used] = '\0';
+    *length = used;
+    return text;
+}
+
+START_TEST (A_parallel_program)
+{
+    size_t length;
+    char* text = parallel_program(&length, false);
+    ck_assert (parallel_agrees(text, length));
+    free(text);
+}
+END_TEST
+
+START_TEST (A_parallel_invalid)
+{
+    size_t length;
+    char* text = parallel_program(&length, true);
+    ck_assert (parallel_agrees(text, length));
+    free(text);
+}
+END_TEST
+
+START_TEST (A_parallel_small)
+{
+    /* too small to split: falls back to a single thread */
+    ck_assert (parallel_agrees("a\nb\n\"c\nd\"\n", 11));
+}
+END_TEST
+
+/**
+ * @brief Read back everything written to a temporary file
+ */
+static char* read_back (FILE* file, size_t* length)
+{
+    fflush(file);
+    *length = (size_t)ftell(file);
+    char* text = (char*)malloc(*length + 1);
+    rewind(file);
+    ck_assert (fread(text, 1, *length, file) == *length);
+    text[*length] = '\0';
+    return text;
+}
+
+START_TEST (A_print_tokens)
+{
+    /* more than one buffer's worth of output, with a wide range of lines */
+    size_t length;
+    char* text = parallel_program(&length, false);
+    Lexer* lexer = Lexer_new(LEXER_DFA);
+    TokenQueue* tokens = Lexer_lex_n(lexer, text, length);
+    Token* big = TokenQueue_emplace(tokens, ID, "x", 1, 1234567);
+    big->column = 1;
+
+    FILE* expected = tmpfile();
+    FILE* actual = tmpfile();
+    fprintf(expected, "before\n");
+    fprintf(actual, "before\n");
+    for (Token* t = tokens->head; t != NULL; t = t->next) {
+        fprintf(expected, "%-8s [line %03d]  %.*s\n",
+                TokenType_to_string(t->type),
+                t->line, (int)t->length, t->text);
+    }
+    TokenQueue_print(tokens, actual);
+
+    size_t expected_len, actual_len;
+    char* want = read_back(expected, &expected_len);
+    char* got = read_back(actual, &actual_len);
+    ck_assert (expected_len > OUTPUT_BUFFER_SIZE);
+    ck_assert (expected_len == actual_len && memcmp(want, got, actual_len) == 0);
+
+    free(want);
+    free(got);
+    fclose(expected);
+    fclose(actual);
+    TokenQueue_free(tokens);
+    Lexer_free(lexer);
+    free(text);
+}
+END_TEST
+
+START_TEST (A_print_escaped)
+{
+    const char* pieces[] = { "plain ", "\n", "\t", "\"", "\\", "x\\\"y" };
+    size_t size = 3 * OUTPUT_BUFFER_SIZE;
+    char* string = (char*)malloc(size + 1);
+    size_t used = 0;
+    for (int i = 0; used + 8 < size; i++) {
+        const char* piece = pieces[i % 6];
+        memcpy(string + used, piece, strlen(piece));
+        used += strlen(piece);
+    }
+    string[used] = '\0';
+
+    FILE* expected = tmpfile();
+    FILE* actual = tmpfile();
+    for (size_t i = 0; i < used; i++) {
+        switch (string[i]) {
+            case '\n':  fprintf(expected, "\\n");  break;
+            case '\t':  fprintf(expected, "\\t");  break;
+            case '\"':  fprintf(expected, "\\\""); break;
+            case '\\':  fprintf(expected, "\\\\"); break;
+            default:    fprintf(expected, "%c", string[i]); break;
+        }
+    }
+    print_escaped_string(string, actual);
+    print_escaped_string("", actual);
+
+    size_t expected_len, actual_len;
+    char* want = read_back(expected, &expected_len);
+    char* got = read_back(actual, &actual_len);
+    ck_assert (expected_len == actual_len && memcmp(want, got, actual_len) == 0);
+
+    free(want);
+    free(got);
+    fclose(expected);
+    fclose(actual);
+    free(string);
+}
+END_TEST
+
+START_TEST (A_tokenfile_roundtrip)
+{
+    const char* filename = "tokenfile-test.tmp";
+    char* text = "def int main() {\n\tint a; a = 0x1f + 105;\n"
+                 "\tprint_str(\"a\\\" b\nc\");\n\treturn a && a;\n}\n";
+    TokenQueue* tokens = run_lexer(text);
+    ck_assert (tokens != NULL);
+    TokenQueue_next(tokens);        /* only remaining tokens are written */
+
+    FILE* out = fopen(filename, "wb");
+    ck_assert (out != NULL);
+    ck_assert (TokenQueue_write_binary(tokens, out));
+    fclose(out);
+
+    TokenFile file;
+    ck_assert (TokenFile_open(&file, filename));
+    remove(filename);
+    ck_assert (TokenFile_size(&file) == TokenQueue_size(tokens));
+    ck_assert (file.header->strings_size < strlen(text));   /* "a" stored once */
+
+    Token token;
+    size_t i = 0;
+    for (Token* t = tokens->head; t != NULL; t = t->next, i++) {
+        TokenFile_get(&file, i, &token);
+        ck_assert (token.type == t->type && token.line == t->line);
+        ck_assert (token.column == t->column && token.offset == t->offset);
+        ck_assert (token.length == t->length);
+        ck_assert (memcmp(token.text, t->text, t->length) == 0);
+    }
+
+    TokenQueue* copy = TokenFile_to_queue(&file);
+    ck_assert (TokenQueue_size(copy) == TokenQueue_size(tokens));
+    ck_assert (Token_text_eq(copy->tail, "}") && copy->tail->line == 6);
+    TokenQueue_free(copy);
+    TokenFile_close(&file);
+    TokenQueue_free(tokens);
+}
+END_TEST
+
+START_TEST (A_tokenfile_invalid)
+{
+    size_t size;
+    FILE* out = tmpfile();
+    TokenQueue* tokens = run_lexer("a = b;");
+    ck_assert (TokenQueue_write_binary(tokens, out));
+    char* data = read_back(out, &size);
+    fclose(out);
+
+    TokenFile file;
+    ck_assert (TokenFile_init(&file, data, size));
+    ck_assert (TokenFile_size(&file) == 4);
+    ck_assert (!TokenFile_init(&file, data, size - 1));     /* truncated */
+    ck_assert (!TokenFile_init(&file, data, 3));
+    TokenRecord* records = (TokenRecord*)(data + sizeof(TokenFileHeader));
+    records[2].length = 1000;                               /* out of bounds */
+    ck_assert (!TokenFile_init(&file, data, size));
+    data[0] = 'X';
+    ck_assert (!TokenFile_init(&file, data, size));
+
+    free(data);
+    TokenQueue_free(tokens);
+}
+END_TEST
+
+START_TEST (A_tokencache)
+{
+    const char* dir = "tokencache-test.tmp";
+    char* text = "def int main() { return 0x1f; }\n";
+    TokenCache* cache = TokenCache_new(dir, 1024 * 1024);
+    ck_assert (cache != NULL);
+    TokenCache_clear(cache);
+
+    TokenFile file;
+    TokenQueue* tokens = run_lexer(text);
+    ck_assert (!TokenCache_lookup(cache, text, strlen(text), &file));
+    TokenCache_store(cache, text, strlen(text), tokens);
+    ck_assert (TokenCache_lookup(cache, text, strlen(text), &file));
+    ck_assert (TokenFile_size(&file) == TokenQueue_size(tokens));
+    TokenQueue* cached = TokenFile_to_queue(&file);
+    ck_assert (Token_text_eq(cached->tail, "}") && cached->tail->column == 31);
+    TokenQueue_free(cached);
+    TokenFile_close(&file);
+
+    /* a different text (even a prefix) misses */
+    ck_assert (!TokenCache_lookup(cache, text, strlen(text) - 1, &file));
+    ck_assert (cache->hits == 1 && cache->misses == 2 && cache->stores == 1);
+
+    /* room for only one entry: storing more evicts the older ones */
+    cache->max_size = 300;
+    TokenCache_store(cache, text, strlen(text) - 1, tokens);
+    TokenCache_store(cache, text, strlen(text) - 2, tokens);
+    ck_assert (cache->evictions == 2);
+    ck_assert (!TokenCache_lookup(cache, text, strlen(text), &file));
+    ck_assert (TokenCache_lookup(cache, text, strlen(text) - 2, &file));
+    TokenFile_close(&file);
+
+    TokenCache_clear(cache);
+    TokenCache_free(cache);
+    ck_assert (remove(dir) == 0);
+    TokenQueue_free(tokens);
+}
+END_TEST
+
+TEST_RELEX(A_relex_extend_word, "int abc = 1;\nx = abc;\n", 7, 0, "d")
+TEST_RELEX(A_relex_join_lines,  "a = 1;\n\nb = 2; // c\nd = 3;\n", 6, 2, " ")
+TEST_RELEX(A_relex_add_lines,   "a = 1; b = 2;\nc = 3;\n", 6, 1, "\n\n// x\n")
+TEST_RELEX(A_relex_open_string, "a = b; c = d; \"x\" e;", 4, 0, "\"")
+TEST_RELEX(A_relex_escaped,     "x = \"a\\\" b c = \"d\";\n", 13, 1, "\"")
+TEST_RELEX(A_relex_invalid,     "a = b;\nc = d;\n", 8, 1, "&")
+TEST_RELEX(A_relex_at_end,      "a = b;\nc", 8, 0, "de")
+TEST_RELEX(A_relex_at_start,    "abc = d;\n", 0, 1, "")
+
+START_TEST (A_relex_random)
+{
+    /* random small edits of a program; each valid result becomes the next text */
+    const char* snippets[] = { "", "a", "1", "0x", " ", "\n", "\t", ";", "(",
+        "=", "<", "\"", "\\", "//", "if", "&", "\"s p\"", "\n\n  " };
+    size_t nsnippets = sizeof(snippets) / sizeof(snippets[0]);
+    char text[4096] = "def int f(int x) {\n\tif (x <= 0x1f) { return x; } // c\n"
+        "\ts = \"multi\nline\\\" str\";\n\twhile (a && b) { c = c + 1; }\n}\n";
+    Lexer* lexer = Lexer_new(LEXER_DFA);
+    char error[MAX_ERROR_LEN];
+    TokenQueue* tokens = Lexer_try_lex_n(lexer, text, strlen(text), error);
+
+    srand(7);
+    for (int i = 0; i < 2000; i++) {
+        size_t length = strlen(text);
+        size_t offset = (size_t)rand() % (length + 1);
+        size_t deleted = (size_t)rand() % 4;
+        if (offset + deleted > length) {
+            deleted = length - offset;
+        }
+        const char* inserted = snippets[rand() % nsnippets];
+        if (length - deleted + strlen(inserted) >= sizeof(text)) {
+            continue;
+        }
+        ck_assert (relex_agrees(text, offset, deleted, inserted));
+
+        /* keep the edit (made in place) if the result is still valid */
+        char edited[sizeof(text)];
+        memcpy(edited, text, offset);
+        strcpy(edited + offset, inserted);
+        strcat(edited, text + offset + deleted);
+        TokenQueue* expected = Lexer_try_lex_n(lexer, edited, strlen(edited), error);
+        if (expected != NULL) {
+            strcpy(text, edited);
+            LexEdit edit = { offset, deleted, strlen(inserted) };
+            ck_assert (Lexer_relex(lexer, tokens, text, strlen(text), edit, error));
+            ck_assert (TokenQueue_size(tokens) == TokenQueue_size(expected));
+            for (Token* t1 = tokens->head, *t2 = expected->head; t1 != NULL;
+                    t1 = t1->next, t2 = t2->next) {
+                ck_assert (t1->type == t2->type && t1->line == t2->line);
+                ck_assert (t1->column == t2->column && t1->offset == t2->offset);
+                ck_assert (t1->text == text + t1->offset && t1->length == t2->length);
+            }
+            ck_assert (tokens->tail == TokenQueue_get(tokens, TokenQueue_size(tokens) - 1));
+            TokenQueue_free(expected);
+        }
+    }
+    TokenQueue_free(tokens);
+    Lexer_free(lexer);
+}
+END_TEST
+
+START_TEST (A_simd_kernels)
+{
+    /* every supported implementation must match the scalar one exactly */
+    const char alphabet[] = " \t\n_aqzAZ09#:\"\\x@{`[/\x80";
+    char text[300];
+    srand(42);
+    for (size_t i = 0; i < sizeof(text); i++) {
+        text[i] = alphabet[rand() % (sizeof(alphabet) - 1)];
+    }
+    for (size_t i = 0; i < sizeof(text); i += 37) {
+        memset(text + i, (i % 2 ? ' ' : 'w'), 20);     /* some long runs */
+    }
+
+    SimdLevel original = simd_level();
+    for (int level = SIMD_SSE2; level <= SIMD_AVX2; level++) {
+        if (!simd_set_level((SimdLevel)level)) {
+            continue;
+        }
+        for (size_t start = 0; start < 64; start++) {
+            for (size_t len = 0; start + len <= sizeof(text); len += 7) {
+                const char* p = text + start;
+                const char* e = p + len;
+                const char* v[5] = { simd_skip_blanks(p, e), simd_skip_space(p, e),
+                    simd_find_newline(p, e), simd_skip_word(p, e),
+                    simd_skip_string_chars(p, e) };
+                size_t lines = simd_count_newlines(p, e);
+                simd_set_level(SIMD_SCALAR);
+                ck_assert (v[0] == simd_skip_blanks(p, e));
+                ck_assert (v[1] == simd_skip_space(p, e));
+                ck_assert (v[2] == simd_find_newline(p, e));
+                ck_assert (v[3] == simd_skip_word(p, e));
+                ck_assert (v[4] == simd_skip_string_chars(p, e));
+                ck_assert (lines == simd_count_newlines(p, e));
+                simd_set_level((SimdLevel)level);
+            }
+        }
+    }
+    simd_set_level(original);
+}
+END_TEST
+
+START_TEST (A_cursor_tokens)
+{
+    /* a cursor returns exactly the tokens of Lexer_lex, with every engine */
+    char* text = "def int main()\n{\n\tint a; // x\n\ta = 0x1f + 5;\n"
+                 "\treturn \"s\nt\";\n}\n";
+    for (int engine = LEXER_REGEX; engine <= LEXER_TABLE; engine++) {
+        Lexer* lexer = Lexer_new((LexerEngine)engine);
+        TokenQueue* tokens = Lexer_lex(lexer, text);
+        LexCursor* cursor = LexCursor_new(lexer, text, strlen(text), 3);
+        for (Token* expected = tokens->head; expected != NULL; expected = expected->next) {
+            Token* peeked = LexCursor_peek(cursor, 0);
+            Token* actual = LexCursor_next(cursor);
+            ck_assert (peeked == actual);
+            ck_assert (actual != NULL);
+            ck_assert (actual->type == expected->type);
+            ck_assert (actual->line == expected->line);
+            ck_assert (actual->column == expected->column);
+            ck_assert (actual->offset == expected->offset);
+            ck_assert (actual->length == expected->length);
+        }
+        ck_assert (LexCursor_next(cursor) == NULL);
+        ck_assert (!cursor->failed);
+        LexCursor_free(cursor);
+        TokenQueue_free(tokens);
+        Lexer_free(lexer);
+    }
+}
+END_TEST
+
+START_TEST (A_cursor_lookahead)
+{
+    Lexer* lexer = Lexer_new(LEXER_DFA);
+    char* text = "a = b + c ; $";
+    LexCursor* cursor = LexCursor_new(lexer, text, strlen(text), 2);
+
+    /* peeking scans only as far as asked, and never past the window */
+    Token* second = LexCursor_peek(cursor, 1);
+    ck_assert (second != NULL && second->text[0] == '=');
+    ck_assert (cursor->count == 2);
+    ck_assert (LexCursor_peek(cursor, 2) == NULL);
+    Token* first = LexCursor_next(cursor);
+    ck_assert (first->text[0] == 'a');
+    ck_assert (LexCursor_peek(cursor, 0) == second);
+    ck_assert (LexCursor_peek(cursor, 1)->text[0] == 'b');
+    ck_assert (first->text[0] == 'a');      /* still valid after peeking */
+
+    /* the tokens before an invalid character are all returned first */
+    int count = 1;
+    while (LexCursor_next(cursor) != NULL) {
+        count++;
+    }
+    ck_assert_int_eq (count, 6);
+    ck_assert (cursor->failed);
+    ck_assert_int_eq (cursor->pos.offset, 12);
+    ck_assert (LexCursor_next(cursor) == NULL);
+
+    LexCursor_free(cursor);
+    Lexer_free(lexer);
+}
+END_TEST
+
+START_TEST (A_multiline_positions)
+{
+    /* line breaks in strings and after comments are counted exactly once */
+    char* text = "a // one\n\"two\nthree\nfour\" b\n  // five\n\tc";
+    for (int engine = LEXER_REGEX; engine <= LEXER_TABLE; engine++) {
+        Lexer* lexer = Lexer_new((LexerEngine)engine);
+        TokenQueue* tokens = Lexer_lex(lexer, text);
+        ck_assert_int_eq (TokenQueue_size(tokens), 4);
+
+        Token* s = TokenQueue_get(tokens, 1);
+        Token* b = TokenQueue_get(tokens, 2);
+        Token* c = TokenQueue_get(tokens, 3);
+        ck_assert (s->line == 2 && s->column == 1 && s->offset == 9);
+        ck_assert (b->line == 4 && b->column == 7 && b->offset == 26);
+        ck_assert (c->line == 6 && c->column == 2 && c->offset == 39);
+
+        int line, column;
+        Token_end(s, &line, &column);
+        ck_assert (line == 4 && column == 6);
+        Token_end(b, &line, &column);
+        ck_assert (line == 4 && column == 8);
+
+        TokenQueue_free(tokens);
+        Lexer_free(lexer);
+    }
+}
+END_TEST
+
+/**
+ * @brief Thread that runs a server until it is stopped
+ */
+static void* run_server (void* arg)
+{
+    LexServer_run((LexServer*)arg);
+    return NULL;
+}
+
+START_TEST (A_server)
+{
+    const char* path = "server-test.sock";
+    char error[MAX_ERROR_LEN];
+    Lexer* lexer = Lexer_new(LEXER_DFA);
+    Lexer_set_interning(lexer, true);
+    LexServer* server = LexServer_new(lexer, path, 1, error);
+    ck_assert (server != NULL);
+    ck_assert (LexServer_new(lexer, path, 1, error) == NULL);   /* in use */
+    pthread_t thread;
+    pthread_create(&thread, NULL, run_server, server);
+
+    /* a client that stops in the middle of a request holds up nobody (the
+     * server has a single worker) */
+    int stalled = LexServer_connect(path);
+    ck_assert (stalled >= 0);
+    const char* slow = "x y z";
+    uint32_t partial[2] = { htonl(0), htonl(5) };
+    ck_assert (write(stalled, partial, sizeof(partial)) == sizeof(partial));
+    ck_assert (write(stalled, slow, 2) == 2);
+    time_t start = time(NULL);
+
+    /* two more clients at once, with several requests on the first one */
+    int first = LexServer_connect(path);
+    int second = LexServer_connect(path);
+    ck_assert (first >= 0 && second >= 0);
+
+    const char* program = "def int main() {\n  return \"hi\" + 42;\n}\n";
+    FILE* expected = tmpfile();
+    TokenQueue* tokens = Lexer_lex(lexer, program);
+    TokenQueue_print(tokens, expected);
+    TokenQueue_free(tokens);
+    size_t expected_len;
+    char* want = read_back(expected, &expected_len);
+    size_t interned = SymbolTable_size(lexer->interned, NULL);
+
+    LexResponse response;
+    ck_assert (LexServer_request(first, 0, program, strlen(program), &response));
+    ck_assert_int_eq (response.status, LEXSERVER_OK);
+    ck_assert (response.tokens_length == expected_len &&
+               memcmp(response.tokens, want, expected_len) == 0);
+    ck_assert (response.errors_length == 0);
+    LexResponse_free(&response);
+
+    ck_assert (LexServer_request(second, 0, "a ^ b", 5, &response));
+    ck_assert_int_eq (response.status, LEXSERVER_LEX_ERROR);
+    ck_assert (response.tokens_length == 0);
+    ck_assert (strcmp(response.errors, "Invalid token!\n") == 0);
+    LexResponse_free(&response);
+
+    ck_assert (LexServer_request(first, LEXSERVER_KEEP_GOING, "a ^ b", 5, &response));
+    ck_assert_int_eq (response.status, LEXSERVER_LEX_ERROR);
+    ck_assert (strstr(response.tokens, "ID") != NULL);
+    ck_assert (strncmp(response.errors, "<input>:1:3: error:", 19) == 0);
+    LexResponse_free(&response);
+
+    ck_assert (LexServer_request(first, LEXSERVER_BINARY, program, strlen(program),
+                &response));
+    ck_assert_int_eq (response.status, LEXSERVER_OK);
+    ck_assert (response.tokens_length > 0);
+    LexResponse_free(&response);
+
+    /* a request that is too long is refused and the connection closed */
+    uint32_t header[2] = { htonl(0), htonl(LEXSERVER_MAX_REQUEST + 1) };
+    ck_assert (write(second, header, sizeof(header)) == sizeof(header));
+    uint32_t reply[3];
+    ck_assert (read(second, reply, sizeof(reply)) == sizeof(reply));
+    ck_assert_int_eq (ntohl(reply[0]), LEXSERVER_BAD_REQUEST);
+    char rest[64];
+    ck_assert (read(second, rest, sizeof(rest)) == (ssize_t)ntohl(reply[2]));
+    ck_assert (read(second, rest, sizeof(rest)) == 0);
+    ck_assert (time(NULL) - start < LEXSERVER_TIMEOUT);
+
+    /* the stalled request is answered once the rest of it arrives */
+    ck_assert (write(stalled, slow + 2, 3) == 3);
+    ck_assert (read(stalled, reply, sizeof(reply)) == sizeof(reply));
+    ck_assert_int_eq (ntohl(reply[0]), LEXSERVER_OK);
+    ck_assert_int_eq (ntohl(reply[2]), 0);
+
+    /* requests are never interned into the shared lexer */
+    ck_assert_int_eq (SymbolTable_size(lexer->interned, NULL), interned);
+
+    close(first);
+    close(second);
+    close(stalled);
+    LexServer_stop(server);
+    pthread_join(thread, NULL);
+    ck_assert (server->requests == 5);
+    LexServer_free(server);
+    ck_assert (access(path, F_OK) != 0);    /* socket removed */
+
+    free(want);
+    fclose(expected);
+    Lexer_free(lexer);
+}
+END_TEST
+
+START_TEST (A_symbols)
+{
+    Lexer* lexer = Lexer_new(LEXER_DFA);
+    char* text = "int foo; foo = bar + foo; \"foo\" == \"foo\"; if bar";
+    TokenQueue* tokens = Lexer_lex(lexer, text);
+
+    /* nothing is interned unless asked for */
+    ck_assert (lexer->interned == NULL);
+    ck_assert (tokens->head->next->symbol == SYMBOL_NONE);
+    TokenQueue_free(tokens);
+    Lexer_set_interning(lexer, true);
+    tokens = Lexer_lex(lexer, text);
+
+    /* equal names share a symbol; keywords and symbols are not interned */
+    Token* t[16];
+    size_t n = 0;
+    for (Token* token = tokens->head; token != NULL && n < 16; token = token->next) {
+        t[n++] = token;
+    }
+    ck_assert_int_eq (n, 15);
+    ck_assert (t[0]->symbol == SYMBOL_NONE);            /* int */
+    ck_assert (t[1]->symbol != SYMBOL_NONE);            /* foo */
+    ck_assert (t[3]->symbol == t[1]->symbol);
+    ck_assert (t[7]->symbol == t[1]->symbol);
+    ck_assert (t[5]->symbol != t[1]->symbol);           /* bar */
+    ck_assert (t[14]->symbol == t[5]->symbol);
+    ck_assert (t[9]->symbol == t[11]->symbol);          /* "foo" */
+    ck_assert (t[9]->symbol != t[1]->symbol);
+    ck_assert (t[2]->symbol == SYMBOL_NONE);            /* ; */
+    ck_assert (Token_same_text(t[1], t[7]));
+    ck_assert (!Token_same_text(t[1], t[5]));
+
+    /* the table holds each distinct text once and outlives the program */
+    size_t bytes;
+    ck_assert_int_eq (SymbolTable_size(lexer->interned, &bytes), 3);
+    ck_assert_int_eq (bytes, 3 + 3 + 5);
+    size_t length;
+    ck_assert (strcmp(SymbolTable_text(lexer->interned, t[9]->symbol, &length),
+                "\"foo\"") == 0);
+    ck_assert_int_eq (length, 5);
+    ck_assert (SymbolTable_text(lexer->interned, SYMBOL_NONE, NULL) == NULL);
+    Symbol foo = t[1]->symbol;
+    TokenQueue_free(tokens);
+    tokens = Lexer_lex(lexer, "bool foo;");
+    ck_assert (tokens->head->next->symbol == foo);
+    TokenQueue_free(tokens);
+
+    /* callers may opt out per call */
+    char error[MAX_ERROR_LEN];
+    tokens = Lexer_try_lex_n_opts(lexer, "bool qux;", 9, LEX_NO_INTERN, error);
+    ck_assert (tokens->head->next->symbol == SYMBOL_NONE);
+    TokenQueue_free(tokens);
+    ck_assert_int_eq (SymbolTable_size(lexer->interned, NULL), 3);
+
+    /* clearing forgets everything and numbering starts over */
+    Lexer_clear_symbols(lexer);
+    ck_assert_int_eq (SymbolTable_size(lexer->interned, &bytes), 0);
+    ck_assert_int_eq (bytes, 0);
+    tokens = Lexer_lex(lexer, "bool baz;");
+    ck_assert_int_eq (tokens->head->next->symbol, 1);
+    ck_assert (strcmp(SymbolTable_text(lexer->interned, 1, NULL), "baz") == 0);
+    TokenQueue_free(tokens);
+    Lexer_free(lexer);
+}
+END_TEST
+
+START_TEST (A_symbol_table_growth)
+{
+    /* many distinct names, interned twice each */
+    SymbolTable* table = SymbolTable_new();
+    char name[32];
+    for (int round = 0; round < 2; round++) {
+        for (int i = 0; i < 5000; i++) {
+            int length = snprintf(name, sizeof(name), "name%d", i);
+            ck_assert_int_eq (SymbolTable_intern(table, name, (size_t)length),
+                    (Symbol)(i + 1));
+        }
+    }
+    ck_assert_int_eq (SymbolTable_size(table, NULL), 5000);
+    ck_assert (strcmp(SymbolTable_text(table, 4321, NULL), "name4320") == 0);
+    SymbolTable_free(table);
+}
+END_TEST
+
+START_TEST (A_table_scanner)
+{
+    /* the generated tables scan exactly like the hand-written DFA everywhere
+     * (except at_end, which the DFA never sets for whitespace and sets a
+     * little too eagerly after string literals) */
+    const char alphabet[] = " \t\n_aqzAZ09x#:\"\\/<=!&|+-*%(){}[],;@\x80";
+    char text[400];
+    srand(21);
+    for (size_t i = 0; i < sizeof(text); i++) {
+        text[i] = alphabet[rand() % (sizeof(alphabet) - 1)];
+    }
+    const char sample[] = "\"ok \\\" str\" 0x1f 100 if callout // c\n";
+    memcpy(text + 100, sample, sizeof(sample) - 1);
+
+    for (size_t start = 0; start < sizeof(text); start++) {
+        for (size_t end = start + 1; end <= sizeof(text); end += 13) {
+            Lexeme expected, actual;
+            scan_dfa(text + start, text + end, &expected);
+            scan_table(text + start, text + end, &actual);
+            ck_assert (expected.kind == actual.kind);
+            ck_assert (expected.length == actual.length);
+            ck_assert (expected.kind != LEX_TOKEN || expected.type == actual.type);
+        }
+    }
+}
+END_TEST
+
+TEST_STREAM(A_stream_program,  "def int main()\n{\n\tint a;\n\ta = 4 + 5;\n\treturn a;\n}\n")
+TEST_STREAM(A_stream_spans,    "a && b || c <= 105 0x1f foo_bar // done\nx")
+TEST_STREAM(A_stream_strings,  "\"multi\nline\" \"a\\\"b\" \"x\\\\\" z")
+TEST_STREAM(A_stream_trailing, "abc // no newline")
+TEST_STREAM(A_stream_spacing,  "a  \t b\n\n  \t\n   c\t\t\n")
+TEST_STREAM(A_stream_invalid,  "a b & c")
+
 TEST_0TOKENS(A_comments,         "// test")
 TEST_1TOKEN (A_keyword_id,       "int3",    ID,     "int3")
 TEST_2TOKENS(A_multi_dec_dec,    "0123",    DECLIT, "0", DECLIT, "123")
 
+START_TEST (A_long_tokens)
+{
+    /* tokens longer than MAX_TOKEN_LEN are kept whole by both engines */
+    char text[1200];
+    size_t used = 0;
+    text[used++] = 'w';
+    memset(text + used, 'a', 400);
+    used += 400;
+    text[used++] = ' ';
+    text[used++] = '"';
+    memset(text + used, 'b', 500);
+    used += 500;
+    strcpy(text + used, "\" ;");
+
+    for (int engine = LEXER_REGEX; engine <= LEXER_TABLE; engine++) {
+        Lexer* lexer = Lexer_new((LexerEngine)engine);
+        TokenQueue* tokens = Lexer_lex(lexer, text);
+        ck_assert_int_eq (TokenQueue_size(tokens), 3);
+        Token* t = TokenQueue_get(tokens, 0);
+        ck_assert (t->type == ID && t->length == 401);
+        t = TokenQueue_get(tokens, 1);
+        ck_assert (t->type == STRLIT && t->length == 502 && t->offset == 402);
+        t = TokenQueue_get(tokens, 2);
+        ck_assert (t->type == SYM && t->offset == 905);
+        TokenQueue_free(tokens);
+        Lexer_free(lexer);
+    }
+}
+END_TEST
+
+START_TEST (A_lex_recover)
+{
+    /* every error is reported with its position and lexing carries on */
+    const char text[] = "int $$ a; class b = \"ab$c\" x & y;\n\"open\nz";
+    for (int engine = LEXER_REGEX; engine <= LEXER_TABLE; engine++) {
+        Lexer* lexer = Lexer_new((LexerEngine)engine);
+        LexDiagnostics diagnostics;
+        LexDiagnostics_init(&diagnostics);
+        TokenQueue* tokens = Lexer_lex_recover(lexer, text, strlen(text), &diagnostics);
+
+        ck_assert_int_eq (TokenQueue_size(tokens), 9);
+        ck_assert (Token_text_eq(TokenQueue_get(tokens, 3), "b"));
+        ck_assert (Token_text_eq(tokens->tail, "z") && tokens->tail->line == 3);
+
+        ck_assert_int_eq (diagnostics.count, 5);
+        LexDiagnostic* d = diagnostics.items;
+        ck_assert (d[0].kind == LEX_ERROR_CHARACTER && d[0].column == 5 && d[0].length == 2);
+        ck_assert (d[1].kind == LEX_ERROR_RESERVED_WORD && d[1].column == 11);
+        ck_assert (d[2].kind == LEX_ERROR_STRING && d[2].column == 21 && d[2].length == 6);
+        ck_assert (d[3].kind == LEX_ERROR_CHARACTER && d[3].column == 30);
+        ck_assert (d[4].kind == LEX_ERROR_STRING && d[4].line == 2 && d[4].column == 1);
+
+        char message[MAX_ERROR_LEN];
+        LexDiagnostic_format(&d[1], text, message, sizeof(message));
+        ck_assert (strcmp(message, "reserved word 'class'") == 0);
+
+        LexDiagnostics_free(&diagnostics);
+        TokenQueue_free(tokens);
+        Lexer_free(lexer);
+    }
+}
+END_TEST
+
+START_TEST (A_token_pool)
+{
+    /* the second program reuses the storage freed by the first one */
+    char text[4001];
+    for (int i = 0; i < 1000; i++) {
+        memcpy(text + 4 * i, "a+1 ", 4);
+    }
+    text[4000] = '\0';
+
+    Lexer* lexer = Lexer_new(LEXER_DFA);
+    TokenPoolStats stats;
+    TokenQueue_free(Lexer_lex(lexer, text));
+    TokenPool_get_stats(lexer->pool, &stats);
+    size_t blocks = stats.allocated;
+    ck_assert (blocks == (3000 + TOKEN_CHUNK_SIZE - 1) / TOKEN_CHUNK_SIZE);
+    ck_assert (stats.free == blocks && stats.in_use == 0);
+
+    TokenQueue* tokens = Lexer_lex(lexer, text);
+    TokenPool_get_stats(lexer->pool, &stats);
+    ck_assert (stats.allocated == blocks && stats.reused == blocks);
+    ck_assert (stats.in_use == blocks && stats.peak_in_use == blocks);
+
+    /* queues may outlive their lexer */
+    Lexer_free(lexer);
+    ck_assert_int_eq (TokenQueue_size(tokens), 3000);
+    ck_assert (Token_text_eq(tokens->tail, "1"));
+    TokenQueue_free(tokens);
+
+    /* blocks past the limit go back to the system */
+    TokenPool* pool = TokenPool_new(1);
+    TokenQueue* queue = TokenQueue_new_pooled(pool);
+    for (int i = 0; i < 3 * TOKEN_CHUNK_SIZE; i++) {
+        TokenQueue_emplace(queue, ID, text, 1, 1);
+    }
+    TokenQueue_free(queue);
+    TokenPool_get_stats(pool, &stats);
+    ck_assert (stats.free == 1 && stats.released == 2);
+    TokenPool_set_limit(pool, 0);
+    TokenPool_get_stats(pool, &stats);
+    ck_assert (stats.free == 0 && stats.released == 3);
+    TokenPool_release(pool);
+}
+END_TEST
+
+START_TEST (A_lexstats)
+{
+    /* both engines count the same rules (counters stay zero when disabled) */
+    char text[] = "def int f() { return 0x1f <= a1; } // done\n";
+    for (int engine = LEXER_REGEX; engine <= LEXER_TABLE; engine++) {
+        Lexer* lexer = Lexer_new((LexerEngine)engine);
+        LexStats stats;
+        LexStats_reset();
+        TokenQueue_free(Lexer_lex(lexer, text));
+        LexStats_get(&stats);
+        uint64_t expected = (LexStats_enabled() ? 1 : 0);
+        ck_assert_int_eq (stats.rules[LEX_RULE_HEX].matches, expected);
+        ck_assert_int_eq (stats.rules[LEX_RULE_OR_EQUAL].matches, expected);
+        ck_assert_int_eq (stats.rules[LEX_RULE_COMMENT].matches, expected);
+        ck_assert_int_eq (stats.rules[LEX_RULE_LETTER].matches, 5 * expected);
+        ck_assert_int_eq (stats.rules[LEX_RULE_KEYWORD].attempts, 5 * expected);
+        ck_assert_int_eq (stats.rules[LEX_RULE_KEYWORD].matches, 3 * expected);
+        ck_assert_int_eq (stats.rules[LEX_RULE_GROUPING].matches, 5 * expected);
+        ck_assert_int_eq (stats.tokens[SYM], 6 * expected);
+        ck_assert_int_eq (stats.bytes, strlen(text) * expected);
+        Lexer_free(lexer);
+    }
+}
+END_TEST
+
+START_TEST (A_lexer_reuse)
+{
+    Lexer* lexer = Lexer_new(LEXER_REGEX);
+    for (int i = 0; i < 3; i++) {
+        TokenQueue* tokens = Lexer_lex(lexer, "def foo;");
+        ck_assert (TokenQueue_size(tokens) == 3);
+        TokenQueue_free(tokens);
+    }
+    Lexer_free(lexer);
+}
+END_TEST
+
+START_TEST (A_all_keywords)
+{
+    char* words[] = { "def", "if", "else", "while", "return", "break",
+                      "continue", "int", "bool", "void", "true", "false" };
+    for (int i = 0; i < sizeof(words) / sizeof(words[0]); i++) {
+        ck_assert (valid_1token(words[i], KEY, words[i]));
+    }
+}
+END_TEST
+
+START_TEST (A_all_reserved)
+{
+    char* words[] = { "for", "callout", "class", "interface", "extends",
+                      "implements", "new", "this", "string", "float",
+                      "double", "null" };
+    for (int i = 0; i < sizeof(words) / sizeof(words[0]); i++) {
+        ck_assert (invalid_tokens(words[i]));
+    }
+}
+END_TEST
+
+TEST_2TOKENS(A_keyword_prefix,   "ifx elsewhere", ID, "ifx", ID, "elsewhere")
+
+TEST_ENGINES_AGREE(A_dfa_program,  "def int main()\n{\n\tint a;\n\ta = 4 + 5;\n\treturn a;\n}\n")
+TEST_ENGINES_AGREE(A_dfa_numbers,  "0123 105 100 0x 0xAb 0x1f9 7")
+TEST_ENGINES_AGREE(A_dfa_words,    "int3 if_ _if forx for_x voids null1 true false")
+TEST_ENGINES_AGREE(A_dfa_reserved, "a = callout;")
+TEST_ENGINES_AGREE(A_dfa_symbols,  "<= >= == != < > = ! && || + - * / % ( ) { } [ ] , ;")
+TEST_ENGINES_AGREE(A_dfa_and,      "a & b")
+TEST_ENGINES_AGREE(A_dfa_strings,  "\"a\\\"b\" \"\\\" \"x\\\\\" \"tab\there\nnext: #_\"")
+TEST_ENGINES_AGREE(A_dfa_bad_str,  "\"no end")
+TEST_ENGINES_AGREE(A_dfa_comments, "a // b c\n// d\ne /")
+TEST_ENGINES_AGREE(A_dfa_spacing,  "\n\n\t\t  a \t\t b\n  \n\t\n    c // x\n\n\"s\n  t\"   d\n")
+
 #endif
 
 /**
@@ -80,9 +1060,63 @@ void public_tests (Suite *s)
     TEST(B_symbol_equal);
     TEST(B_multi_tokens1);
     TEST(B_multi_tokens2);
+    TEST(A_positions);
+    TEST(A_token_text);
+    TEST(A_queue_random_access);
+    TEST(A_source_large_file);
+    TEST(A_lex_n_bounded);
+    TEST(A_parallel_program);
+    TEST(A_parallel_invalid);
+    TEST(A_parallel_small);
+    TEST(A_relex_extend_word);
+    TEST(A_relex_join_lines);
+    TEST(A_relex_add_lines);
+    TEST(A_relex_open_string);
+    TEST(A_relex_escaped);
+    TEST(A_relex_invalid);
+    TEST(A_relex_at_end);
+    TEST(A_relex_at_start);
+    TEST(A_relex_random);
+    TEST(A_simd_kernels);
+    TEST(A_table_scanner);
+    TEST(A_multiline_positions);
+    TEST(A_server);
+    TEST(A_symbols);
+    TEST(A_symbol_table_growth);
+    TEST(A_cursor_tokens);
+    TEST(A_cursor_lookahead);
+    TEST(A_lex_recover);
+    TEST(A_token_pool);
+    TEST(A_lexstats);
+    TEST(A_long_tokens);
+    TEST(A_print_tokens);
+    TEST(A_print_escaped);
+    TEST(A_tokenfile_roundtrip);
+    TEST(A_tokenfile_invalid);
+    TEST(A_tokencache);
+    TEST(A_stream_program);
+    TEST(A_stream_spans);
+    TEST(A_stream_strings);
+    TEST(A_stream_trailing);
+    TEST(A_stream_spacing);
+    TEST(A_stream_invalid);
     TEST(A_comments);
     TEST(A_keyword_id);
     TEST(A_multi_dec_dec);
+    TEST(A_lexer_reuse);
+    TEST(A_all_keywords);
+    TEST(A_all_reserved);
+    TEST(A_keyword_prefix);
+    TEST(A_dfa_program);
+    TEST(A_dfa_numbers);
+    TEST(A_dfa_words);
+    TEST(A_dfa_reserved);
+    TEST(A_dfa_symbols);
+    TEST(A_dfa_and);
+    TEST(A_dfa_strings);
+    TEST(A_dfa_bad_str);
+    TEST(A_dfa_comments);
+    TEST(A_dfa_spacing);
     suite_add_tcase (s, tc);
 }
 
@@ -18,6 +18,17 @@ TokenQueue* run_lexer (char* text)
     }
 }
 
+TokenQueue* run_lexer_engine (LexerEngine engine, char* text)
+{
+    Lexer* lexer = Lexer_new(engine);
+    TokenQueue* tokens = NULL;
+    if (setjmp(decaf_error) == 0) {
+        tokens = Lexer_lex(lexer, text);
+    }
+    Lexer_free(lexer);
+    return tokens;
+}
+
 TokenQueue* run_lexer_check_size (char* text, size_t expected_length)
 {
     TokenQueue* tokens = run_lexer(text);
@@ -54,7 +65,7 @@ bool valid_1token (char* text, TokenType expected_type, const char* expected_tex
         { return false; }
     if (tokens->head->type != expected_type)            /* first token */
         { TokenQueue_free(tokens); return false; }
-    if (strncmp(tokens->head->text, expected_text, MAX_TOKEN_LEN) != 0)
+    if (!Token_text_eq(tokens->head, expected_text))
         { TokenQueue_free(tokens); return false; }
     TokenQueue_free(tokens);
     return true;
@@ -68,11 +79,11 @@ bool valid_2tokens (char* text, TokenType expected_type1, const char* expected_t
         { return false; }
     if (tokens->head->type != expected_type1)           /* first token */
         { TokenQueue_free(tokens); return false; }
-    if (strncmp(tokens->head->text, expected_text1, MAX_TOKEN_LEN) != 0)
+    if (!Token_text_eq(tokens->head, expected_text1))
         { TokenQueue_free(tokens); return false; }
     if (tokens->head->next->type != expected_type2)     /* second token */
         { TokenQueue_free(tokens); return false; }
-    if (strncmp(tokens->head->next->text, expected_text2, MAX_TOKEN_LEN) != 0)
+    if (!Token_text_eq(tokens->head->next, expected_text2))
         { TokenQueue_free(tokens); return false; }
     TokenQueue_free(tokens);
     return true;
@@ -84,18 +95,163 @@ bool valid_tokens(char* text, size_t ntokens, Token expected_tokens[])
     if (tokens == NULL)
         { return false; }
     for (size_t i = 0; i < ntokens; i++) {
-        Token* token = TokenQueue_remove(tokens);
+        Token* token = TokenQueue_next(tokens);
         if (token->type != expected_tokens[i].type)
             { TokenQueue_free(tokens); return false; }
-        if (strncmp(token->text, expected_tokens[i].text, MAX_TOKEN_LEN) != 0)
+        if (!Token_text_eq(token, expected_tokens[i].text))
             { TokenQueue_free(tokens); return false; }
         if (token->line != expected_tokens[i].line)
             { TokenQueue_free(tokens); return false; }
+        if (expected_tokens[i].column != 0 &&
+                token->column != expected_tokens[i].column)
+            { TokenQueue_free(tokens); return false; }
     }
     TokenQueue_free(tokens);
     return true;
 }
 
+/**
+ * @brief Compare two token queues (either may be @c NULL for a lexing error)
+ */
+static bool same_tokens (TokenQueue* expected, TokenQueue* actual)
+{
+    bool same = (expected == NULL) == (actual == NULL);
+    if (expected != NULL && actual != NULL) {
+        Token* t1 = expected->head;
+        Token* t2 = actual->head;
+        while (same && t1 != NULL && t2 != NULL) {
+            same = t1->type == t2->type && t1->line == t2->line &&
+                   t1->column == t2->column && t1->offset == t2->offset &&
+                   t1->length == t2->length && t1->symbol == t2->symbol &&
+                   memcmp(t1->text, t2->text, t1->length) == 0;
+            t1 = t1->next;
+            t2 = t2->next;
+        }
+        same = same && t1 == NULL && t2 == NULL;
+    }
+    return same;
+}
+
+bool engines_agree (char* text)
+{
+    TokenQueue* expected = run_lexer_engine(LEXER_REGEX, text);
+    TokenQueue* actual = run_lexer_engine(LEXER_DFA, text);
+    TokenQueue* table = run_lexer_engine(LEXER_TABLE, text);
+    bool same = same_tokens(expected, actual) && same_tokens(expected, table);
+    if (expected != NULL) TokenQueue_free(expected);
+    if (actual != NULL)   TokenQueue_free(actual);
+    if (table != NULL)    TokenQueue_free(table);
+    return same;
+}
+
+bool parallel_agrees (const char* text, size_t length)
+{
+    Lexer* lexer = Lexer_new(LEXER_DFA);
+    Lexer_set_interning(lexer, true);
+    char error[MAX_ERROR_LEN];
+    TokenQueue* expected = Lexer_try_lex_n(lexer, text, length, error);
+    bool same = true;
+    for (int nthreads = 2; nthreads <= 8 && same; nthreads++) {
+        TokenQueue* actual = Lexer_try_lex_parallel(lexer, text, length,
+                nthreads, 0, error);
+        same = same_tokens(expected, actual);
+        if (actual != NULL) TokenQueue_free(actual);
+    }
+    if (expected != NULL) TokenQueue_free(expected);
+    Lexer_free(lexer);
+    return same;
+}
+
+bool relex_agrees (const char* text, size_t offset, size_t deleted,
+        const char* inserted)
+{
+    Lexer* lexer = Lexer_new(LEXER_DFA);
+    char error[MAX_ERROR_LEN];
+    size_t length = strlen(text);
+    size_t inserted_len = strlen(inserted);
+    TokenQueue* old = Lexer_try_lex_n(lexer, text, length, error);
+    if (old == NULL) {
+        Lexer_free(lexer);
+        return false;       /* the old text must be valid */
+    }
+
+    size_t new_len = length - deleted + inserted_len;
+    char* edited = (char*)malloc(new_len + 1);
+    memcpy(edited, text, offset);
+    memcpy(edited + offset, inserted, inserted_len);
+    memcpy(edited + offset + inserted_len, text + offset + deleted,
+            length - offset - deleted);
+    edited[new_len] = '\0';
+
+    LexEdit edit = { offset, deleted, inserted_len };
+    TokenQueue* expected = Lexer_try_lex_n(lexer, edited, new_len, error);
+    bool ok = Lexer_relex(lexer, old, edited, new_len, edit, error);
+    bool same = same_tokens(expected, ok ? old : NULL);
+
+    if (expected != NULL) TokenQueue_free(expected);
+    TokenQueue_free(old);
+    free(edited);
+    Lexer_free(lexer);
+    return same;
+}
+
+/**
+ * @brief Stream text in chunks of the given size and compare with a queue
+ */
+static bool stream_chunks_agree (const Lexer* lexer, char* text, size_t chunk,
+        TokenQueue* expected)
+{
+    LexStream* stream = LexStream_new(lexer);
+    Token* want = (expected != NULL ? expected->head : NULL);
+    size_t length = strlen(text);
+    size_t fed = 0;
+    bool same = true;
+    LexStreamStatus status;
+    Token* token;
+
+    while (same) {
+        status = LexStream_next(stream, &token);
+        if (status == LEXSTREAM_NEED_INPUT) {
+            if (fed == length) {
+                LexStream_finish(stream);
+            } else {
+                size_t n = (length - fed < chunk ? length - fed : chunk);
+                LexStream_feed(stream, text + fed, n);
+                fed += n;
+            }
+        } else if (status == LEXSTREAM_TOKEN && expected == NULL) {
+            /* tokens before the error are fine; the error must still come */
+        } else if (status == LEXSTREAM_TOKEN) {
+            same = want != NULL && token->type == want->type &&
+                   token->line == want->line && token->column == want->column &&
+                   token->offset == want->offset && token->length == want->length &&
+                   memcmp(token->text, want->text, token->length) == 0;
+            want = (want != NULL ? want->next : NULL);
+        } else {
+            same = (status == LEXSTREAM_END) == (expected != NULL) && want == NULL;
+            break;
+        }
+    }
+    LexStream_free(stream);
+    return same;
+}
+
+bool stream_agrees (char* text)
+{
+    TokenQueue* expected = run_lexer_engine(LEXER_DFA, text);
+    bool same = true;
+    for (int engine = LEXER_DFA; engine <= LEXER_TABLE && same; engine++) {
+        Lexer* lexer = Lexer_new((LexerEngine)engine);
+        for (size_t chunk = 1; chunk <= 8 && same; chunk++) {
+            same = stream_chunks_agree(lexer, text, chunk, expected);
+        }
+        same = same && stream_chunks_agree(lexer, text, strlen(text) + 1, expected);
+        Lexer_free(lexer);
+    }
+    if (expected != NULL) TokenQueue_free(expected);
+    return same;
+}
+
 extern void public_tests (Suite *s);
 extern void private_tests (Suite *s);
 
@@ -12,7 +12,9 @@
 
 #include <check.h>
 
+#include "cursor.h"
 #include "p1-lexer.h"
+#include "stream.h"
 
 /**
  * @brief Define a test case with text containing an invalid token
@@ -49,6 +51,29 @@ END_TEST
 { ck_assert (valid_tokens(TEXT, NTOKENS, ETOKENS)); } \
 END_TEST
 
+/**
+ * @brief Define a test that checks that all lexer engines agree on some text
+ */
+#define TEST_ENGINES_AGREE(NAME,TEXT) START_TEST (NAME) \
+{ ck_assert (engines_agree(TEXT)); } \
+END_TEST
+
+/**
+ * @brief Define a test that checks that re-lexing after an edit gives the
+ * same tokens as lexing the edited text
+ */
+#define TEST_RELEX(NAME,TEXT,OFFSET,DELETED,INSERTED) START_TEST (NAME) \
+{ ck_assert (relex_agrees(TEXT, OFFSET, DELETED, INSERTED)); } \
+END_TEST
+
+/**
+ * @brief Define a test that checks that streaming gives the same tokens as
+ * lexing all at once
+ */
+#define TEST_STREAM(NAME,TEXT) START_TEST (NAME) \
+{ ck_assert (stream_agrees(TEXT)); } \
+END_TEST
+
 /**
  * @brief Add a test to the test suite
  */
@@ -65,6 +90,18 @@ END_TEST
  */
 TokenQueue* run_lexer (char* text);
 
+/**
+ * @brief Run a specific lexer engine on given text
+ *
+ * Like run_lexer(), but uses a new @ref Lexer with the given engine instead of
+ * the default one.
+ *
+ * @param engine Engine to use
+ * @param text Code to lex
+ * @returns Queue of tokens or @c NULL if there was a lexing error
+ */
+TokenQueue* run_lexer_engine (LexerEngine engine, char* text);
+
 /**
  * @brief Run lexer on given text and check length of resulting token queue
  *
@@ -128,8 +165,53 @@ bool valid_2tokens (char* text, TokenType expected_type1, const char* expected_t
  *
  * @param text Code to lex
  * @param ntokens Expected number of tokens
- * @param expected_tokens Array of expected token info (type and text)
+ * @param expected_tokens Array of expected token info (type, text, line, and
+ * column; a column of zero is not checked)
  * @returns True if and only if the tokens were lexed successfully as the
  * expected types
  */
 bool valid_tokens(char* text, size_t ntokens, Token expected_tokens[]);
+
+/**
+ * @brief Run every lexer engine on given text and verify that they produce the
+ * same tokens (or all fail).
+ *
+ * @param text Code to lex
+ * @returns True if and only if all engines agree
+ */
+bool engines_agree (char* text);
+
+/**
+ * @brief Lex text on several different numbers of threads and verify that
+ * every run produces the same tokens (and symbols) as lexing on one thread
+ * (or fails if it fails).
+ *
+ * @param text Code to lex
+ * @param length Length of the code (in bytes)
+ * @returns True if and only if the parallel runs match
+ */
+bool parallel_agrees (const char* text, size_t length);
+
+/**
+ * @brief Apply an edit to a text and verify that re-lexing it incrementally
+ * gives the same tokens as lexing the edited text from scratch (or fails if
+ * that fails).
+ *
+ * @param text Code before the edit (must lex without errors)
+ * @param offset Where the edit starts
+ * @param deleted Number of characters removed
+ * @param inserted Text inserted in their place
+ * @returns True if and only if the incremental result matches
+ */
+bool relex_agrees (const char* text, size_t offset, size_t deleted,
+        const char* inserted);
+
+/**
+ * @brief Feed text to a @ref LexStream in chunks of several different sizes
+ * (with both the DFA and table engines) and verify that every run produces the
+ * same tokens as @ref Lexer_lex (or fails if it fails).
+ *
+ * @param text Code to lex
+ * @returns True if and only if the streamed tokens match
+ */
+bool stream_agrees (char* text);
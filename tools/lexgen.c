@@ -0,0 +1,912 @@
+/**
+ * @file lexgen.c
+ * @brief Generate a table-driven scanner from a declarative token spec
+ *
+ * Usage:
+ *
+ *     lexgen <spec> <output.c>
+ *
+ * Reads the token rules (see src/tokens.spec for the format), builds a
+ * Thompson NFA for each pattern, combines them with the subset construction,
+ * minimizes the result, and writes a C file with the DFA as static const
+ * tables plus @c scan_table, the loop that walks them (see scanner.h).
+ *
+ * Bytes that no pattern tells apart are merged into equivalence classes, so
+ * the transition table has one column per class instead of one per byte and
+ * fits in a few cache lines.
+ *
+ * This runs at build time only; any error in the spec is reported with its
+ * line number and stops the build.
+ */
+
+#include <ctype.h>
+
+#include "common.h"
+
+/**
+ * @brief Maximum number of rules in a spec
+ */
+#define MAX_RULES 64
+
+/**
+ * @brief Number of possible input bytes
+ */
+#define NBYTES 256
+
+/**
+ * @brief Set of input bytes
+ */
+typedef struct ByteSet
+{
+    uint8_t bits[NBYTES / 8];   /**< @brief One bit per byte value */
+} ByteSet;
+
+/**
+ * @brief Single NFA state
+ *
+ * A state either consumes a byte from @c set and moves to @c next, or has up
+ * to two epsilon transitions (@c out1 and @c out2, -1 if unused).
+ */
+typedef struct NfaState
+{
+    bool consumes;  /**< @brief True if this state reads a byte */
+    ByteSet set;    /**< @brief Bytes accepted (only if @c consumes) */
+    int next;       /**< @brief Target after reading a byte */
+    int out1;       /**< @brief First epsilon target */
+    int out2;       /**< @brief Second epsilon target */
+    int rule;       /**< @brief Rule accepted in this state (or -1) */
+} NfaState;
+
+/**
+ * @brief Piece of an NFA under construction (one entry and one exit state)
+ */
+typedef struct Fragment
+{
+    int start;      /**< @brief Entry state */
+    int end;        /**< @brief Exit state (has no transitions yet) */
+} Fragment;
+
+/**
+ * @brief Single rule of the spec
+ */
+typedef struct Rule
+{
+    char name[64];      /**< @brief Rule name (for comments in the output) */
+    int priority;       /**< @brief Lower wins among equally long matches */
+    const char* kind;   /**< @brief Lexeme kind emitted (C enumerator) */
+    const char* type;   /**< @brief Token type emitted (C enumerator) */
+    bool word;          /**< @brief Classify the match with scan_classify_word */
+    Fragment nfa;       /**< @brief Compiled pattern */
+} Rule;
+
+/**
+ * @brief Generator state
+ */
+typedef struct Generator
+{
+    Rule rules[MAX_RULES];  /**< @brief Rules in spec order */
+    int nrules;             /**< @brief Number of rules */
+
+    NfaState* nfa;          /**< @brief All NFA states */
+    int nnfa;               /**< @brief Number of NFA states */
+    int nfa_capacity;       /**< @brief Allocated size of @c nfa */
+
+    int classes[NBYTES];    /**< @brief Equivalence class of each byte */
+    int nclasses;           /**< @brief Number of equivalence classes */
+
+    int* next;              /**< @brief DFA transitions (@c ndfa x @c nclasses) */
+    int* accept;            /**< @brief Rule accepted in each DFA state (or -1) */
+    int ndfa;               /**< @brief Number of DFA states */
+} Generator;
+
+/**
+ * @brief Name of the spec file (for error messages)
+ */
+static const char* spec_name = "";
+
+/**
+ * @brief Line of the spec being processed (for error messages)
+ */
+static int spec_line = 0;
+
+/**
+ * @brief Report an error in the spec and stop
+ */
+static void fail (const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    fprintf(stderr, "lexgen: %s:%d: ", spec_name, spec_line);
+    vfprintf(stderr, format, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+    exit(EXIT_FAILURE);
+}
+
+static void ByteSet_add (ByteSet* set, int c)
+{
+    set->bits[c / 8] |= (uint8_t)(1 << (c % 8));
+}
+
+static bool ByteSet_has (const ByteSet* set, int c)
+{
+    return (set->bits[c / 8] >> (c % 8)) & 1;
+}
+
+/*
+ * NFA CONSTRUCTION
+ */
+
+static int Nfa_new_state (Generator* gen)
+{
+    if (gen->nnfa == gen->nfa_capacity) {
+        gen->nfa_capacity = (gen->nfa_capacity == 0 ? 256 : gen->nfa_capacity * 2);
+        gen->nfa = (NfaState*)realloc(gen->nfa, gen->nfa_capacity * sizeof(NfaState));
+        CHECK_MALLOC_PTR(gen->nfa)
+    }
+    NfaState* state = &gen->nfa[gen->nnfa];
+    memset(state, 0, sizeof(NfaState));
+    state->next = state->out1 = state->out2 = state->rule = -1;
+    return gen->nnfa++;
+}
+
+/**
+ * @brief Add an epsilon transition to a state
+ */
+static void Nfa_link (Generator* gen, int from, int to)
+{
+    NfaState* state = &gen->nfa[from];
+    if (state->out1 < 0) {
+        state->out1 = to;
+    } else {
+        state->out2 = to;
+    }
+}
+
+static Fragment Fragment_set (Generator* gen, const ByteSet* set)
+{
+    Fragment f = { Nfa_new_state(gen), Nfa_new_state(gen) };
+    gen->nfa[f.start].consumes = true;
+    gen->nfa[f.start].set = *set;
+    gen->nfa[f.start].next = f.end;
+    return f;
+}
+
+static Fragment Fragment_concat (Generator* gen, Fragment a, Fragment b)
+{
+    Nfa_link(gen, a.end, b.start);
+    return (Fragment){ a.start, b.end };
+}
+
+static Fragment Fragment_alternate (Generator* gen, Fragment a, Fragment b)
+{
+    Fragment f = { Nfa_new_state(gen), Nfa_new_state(gen) };
+    Nfa_link(gen, f.start, a.start);
+    Nfa_link(gen, f.start, b.start);
+    Nfa_link(gen, a.end, f.end);
+    Nfa_link(gen, b.end, f.end);
+    return f;
+}
+
+/**
+ * @brief Apply a postfix operator (@c *, @c +, or @c ?) to a fragment
+ */
+static Fragment Fragment_repeat (Generator* gen, Fragment a, char op)
+{
+    Fragment f = { Nfa_new_state(gen), Nfa_new_state(gen) };
+    Nfa_link(gen, f.start, a.start);
+    Nfa_link(gen, a.end, f.end);
+    if (op != '+') {
+        Nfa_link(gen, f.start, f.end);
+    }
+    if (op != '?') {
+        Nfa_link(gen, a.end, a.start);
+    }
+    return f;
+}
+
+/*
+ * PATTERN PARSING
+ */
+
+/**
+ * @brief Parse the character after a backslash
+ */
+static int parse_escape (const char** p)
+{
+    char c = *(*p)++;
+    switch (c) {
+        case '\0': fail("pattern ends with a backslash"); break;
+        case 'n':  return '\n';
+        case 't':  return '\t';
+        case 'r':  return '\r';
+        case 'x': {
+            int value = 0;
+            for (int i = 0; i < 2; i++) {
+                char h = *(*p)++;
+                if (!isxdigit((unsigned char)h)) {
+                    fail("\\x must be followed by two hex digits");
+                }
+                value = value * 16 + (isdigit((unsigned char)h) ? h - '0' :
+                        tolower((unsigned char)h) - 'a' + 10);
+            }
+            return value;
+        }
+    }
+    return (unsigned char)c;
+}
+
+/**
+ * @brief Parse a bracket expression (after the opening bracket)
+ */
+static void parse_class (const char** p, ByteSet* set)
+{
+    bool negate = (**p == '^');
+    if (negate) {
+        (*p)++;
+    }
+
+    ByteSet members;
+    memset(&members, 0, sizeof(members));
+    bool first = true;
+    while (**p != ']' || first) {
+        if (**p == '\0') {
+            fail("unterminated bracket expression");
+        }
+        int low = (**p == '\\' ? ((*p)++, parse_escape(p)) : (unsigned char)*(*p)++);
+        int high = low;
+        if (**p == '-' && (*p)[1] != ']' && (*p)[1] != '\0') {
+            (*p)++;
+            high = (**p == '\\' ? ((*p)++, parse_escape(p)) : (unsigned char)*(*p)++);
+            if (high < low) {
+                fail("invalid range in bracket expression");
+            }
+        }
+        for (int c = low; c <= high; c++) {
+            ByteSet_add(&members, c);
+        }
+        first = false;
+    }
+    (*p)++;
+
+    for (int c = 0; c < NBYTES; c++) {
+        if (ByteSet_has(&members, c) != negate) {
+            ByteSet_add(set, c);
+        }
+    }
+}
+
+static Fragment parse_alternation (Generator* gen, const char** p);
+
+static Fragment parse_atom (Generator* gen, const char** p)
+{
+    ByteSet set;
+    memset(&set, 0, sizeof(set));
+
+    char c = *(*p)++;
+    switch (c) {
+        case '(': {
+            Fragment f = parse_alternation(gen, p);
+            if (**p != ')') {
+                fail("missing ')'");
+            }
+            (*p)++;
+            return f;
+        }
+        case '[':
+            parse_class(p, &set);
+            break;
+        case '.':
+            for (int b = 0; b < NBYTES; b++) {
+                if (b != '\n') {
+                    ByteSet_add(&set, b);
+                }
+            }
+            break;
+        case '\\':
+            ByteSet_add(&set, parse_escape(p));
+            break;
+        case '*': case '+': case '?':
+            fail("'%c' has nothing to repeat", c);
+            break;
+        default:
+            ByteSet_add(&set, (unsigned char)c);
+            break;
+    }
+    return Fragment_set(gen, &set);
+}
+
+static Fragment parse_concatenation (Generator* gen, const char** p)
+{
+    if (**p == '\0' || **p == '|' || **p == ')') {
+        fail("empty alternative");
+    }
+    Fragment f = { -1, -1 };
+    while (**p != '\0' && **p != '|' && **p != ')') {
+        Fragment piece = parse_atom(gen, p);
+        while (**p == '*' || **p == '+' || **p == '?') {
+            piece = Fragment_repeat(gen, piece, *(*p)++);
+        }
+        f = (f.start < 0 ? piece : Fragment_concat(gen, f, piece));
+    }
+    return f;
+}
+
+static Fragment parse_alternation (Generator* gen, const char** p)
+{
+    Fragment f = parse_concatenation(gen, p);
+    while (**p == '|') {
+        (*p)++;
+        f = Fragment_alternate(gen, f, parse_concatenation(gen, p));
+    }
+    return f;
+}
+
+/**
+ * @brief Compile a whole pattern into an NFA fragment
+ */
+static Fragment parse_pattern (Generator* gen, const char* pattern)
+{
+    const char* p = pattern;
+    Fragment f = parse_alternation(gen, &p);
+    if (*p != '\0') {
+        fail("unbalanced ')'");
+    }
+    return f;
+}
+
+/*
+ * SUBSET CONSTRUCTION
+ */
+
+/**
+ * @brief Number of 64-bit words in a set of NFA states
+ */
+static int set_words (const Generator* gen)
+{
+    return (gen->nnfa + 63) / 64;
+}
+
+/**
+ * @brief Add a state and everything reachable from it by epsilon transitions
+ * to a set of NFA states
+ */
+static void closure_add (const Generator* gen, uint64_t* set, int state, int* stack)
+{
+    int top = 0;
+    stack[top++] = state;
+    while (top > 0) {
+        int s = stack[--top];
+        if (s < 0 || (set[s / 64] >> (s % 64)) & 1) {
+            continue;
+        }
+        set[s / 64] |= (uint64_t)1 << (s % 64);
+        stack[top++] = gen->nfa[s].out1;
+        stack[top++] = gen->nfa[s].out2;
+    }
+}
+
+static bool set_has (const uint64_t* set, int state)
+{
+    return (set[state / 64] >> (state % 64)) & 1;
+}
+
+/**
+ * @brief Split the bytes into classes that every pattern treats alike
+ */
+static void compute_classes (Generator* gen)
+{
+    memset(gen->classes, 0, sizeof(gen->classes));
+    gen->nclasses = 1;
+    for (int s = 0; s < gen->nnfa; s++) {
+        if (!gen->nfa[s].consumes) {
+            continue;
+        }
+        /* split every class into its members inside and outside the set */
+        int renumber[2 * NBYTES];
+        for (int i = 0; i < 2 * gen->nclasses; i++) {
+            renumber[i] = -1;
+        }
+        int count = 0;
+        for (int b = 0; b < NBYTES; b++) {
+            int key = 2 * gen->classes[b] + ByteSet_has(&gen->nfa[s].set, b);
+            if (renumber[key] < 0) {
+                renumber[key] = count++;
+            }
+            gen->classes[b] = renumber[key];
+        }
+        gen->nclasses = count;
+    }
+}
+
+/**
+ * @brief Build the DFA (state 0 is the dead state, state 1 the start state)
+ */
+static void build_dfa (Generator* gen, int start)
+{
+    int words = set_words(gen);
+    int* stack = (int*)malloc(3 * gen->nnfa * sizeof(int) + sizeof(int));
+    CHECK_MALLOC_PTR(stack)
+
+    int representative[NBYTES];
+    for (int b = NBYTES - 1; b >= 0; b--) {
+        representative[gen->classes[b]] = b;
+    }
+
+    int capacity = 64;
+    uint64_t* sets = (uint64_t*)calloc((size_t)capacity * words, sizeof(uint64_t));
+    gen->next = (int*)malloc((size_t)capacity * gen->nclasses * sizeof(int));
+    CHECK_MALLOC_PTR(sets)
+    CHECK_MALLOC_PTR(gen->next)
+
+    /* dead state (empty set) and start state */
+    closure_add(gen, sets + words, start, stack);
+    gen->ndfa = 2;
+
+    uint64_t* target = (uint64_t*)malloc(words * sizeof(uint64_t));
+    CHECK_MALLOC_PTR(target)
+    for (int d = 0; d < gen->ndfa; d++) {
+        for (int c = 0; c < gen->nclasses; c++) {
+            memset(target, 0, words * sizeof(uint64_t));
+            for (int s = 0; s < gen->nnfa; s++) {
+                if (set_has(sets + (size_t)d * words, s) && gen->nfa[s].consumes &&
+                        ByteSet_has(&gen->nfa[s].set, representative[c])) {
+                    closure_add(gen, target, gen->nfa[s].next, stack);
+                }
+            }
+
+            int found = 0;
+            while (found < gen->ndfa &&
+                    memcmp(sets + (size_t)found * words, target, words * sizeof(uint64_t)) != 0) {
+                found++;
+            }
+            if (found == gen->ndfa) {
+                if (gen->ndfa == capacity) {
+                    capacity *= 2;
+                    sets = (uint64_t*)realloc(sets, (size_t)capacity * words * sizeof(uint64_t));
+                    gen->next = (int*)realloc(gen->next,
+                            (size_t)capacity * gen->nclasses * sizeof(int));
+                    CHECK_MALLOC_PTR(sets)
+                    CHECK_MALLOC_PTR(gen->next)
+                }
+                memcpy(sets + (size_t)found * words, target, words * sizeof(uint64_t));
+                gen->ndfa++;
+            }
+            gen->next[d * gen->nclasses + c] = found;
+        }
+    }
+
+    /* among equally long matches, the lowest priority (then the first rule) wins */
+    gen->accept = (int*)malloc(gen->ndfa * sizeof(int));
+    CHECK_MALLOC_PTR(gen->accept)
+    for (int d = 0; d < gen->ndfa; d++) {
+        gen->accept[d] = -1;
+        for (int s = 0; s < gen->nnfa; s++) {
+            int r = gen->nfa[s].rule;
+            if (r >= 0 && set_has(sets + (size_t)d * words, s) &&
+                    (gen->accept[d] < 0 ||
+                     gen->rules[r].priority < gen->rules[gen->accept[d]].priority)) {
+                gen->accept[d] = r;
+            }
+        }
+    }
+
+    free(target);
+    free(sets);
+    free(stack);
+}
+
+/*
+ * MINIMIZATION
+ */
+
+/**
+ * @brief Merge equivalent DFA states (Moore's algorithm)
+ *
+ * States start out split by the rule they accept and are split further until
+ * all states in a block go to the same blocks on every class. The blocks are
+ * then numbered in breadth-first order from the start state (keeping the dead
+ * state at 0 and the start state at 1), so states used together tend to sit
+ * together in the table.
+ */
+static void minimize_dfa (Generator* gen)
+{
+    int n = gen->ndfa;
+    int k = gen->nclasses;
+    int* block = (int*)malloc(n * sizeof(int));
+    int* renumber = (int*)malloc(n * sizeof(int));
+    CHECK_MALLOC_PTR(block)
+    CHECK_MALLOC_PTR(renumber)
+
+    int nblocks = 0;
+    for (int d = 0; d < n; d++) {
+        block[d] = -1;
+        for (int e = 0; e < d && block[d] < 0; e++) {
+            if (gen->accept[e] == gen->accept[d]) {
+                block[d] = block[e];
+            }
+        }
+        if (block[d] < 0) {
+            block[d] = nblocks++;
+        }
+    }
+
+    for (;;) {
+        int count = 0;
+        for (int d = 0; d < n; d++) {
+            renumber[d] = -1;
+            for (int e = 0; e < d && renumber[d] < 0; e++) {
+                bool same = (block[e] == block[d]);
+                for (int c = 0; c < k && same; c++) {
+                    same = block[gen->next[e * k + c]] == block[gen->next[d * k + c]];
+                }
+                if (same) {
+                    renumber[d] = renumber[e];
+                }
+            }
+            if (renumber[d] < 0) {
+                renumber[d] = count++;
+            }
+        }
+        memcpy(block, renumber, n * sizeof(int));
+        if (count == nblocks) {
+            break;
+        }
+        nblocks = count;
+    }
+    if (block[1] == block[0]) {
+        fail("the spec does not match anything");
+    }
+
+    /* breadth-first numbering of the blocks */
+    int* order = (int*)malloc(nblocks * sizeof(int));
+    int* id = (int*)malloc(nblocks * sizeof(int));
+    CHECK_MALLOC_PTR(order)
+    CHECK_MALLOC_PTR(id)
+    for (int b = 0; b < nblocks; b++) {
+        id[b] = -1;
+    }
+    int nstates = 0;
+    order[nstates] = block[0];
+    id[block[0]] = nstates++;
+    order[nstates] = block[1];
+    id[block[1]] = nstates++;
+    for (int i = 1; i < nstates; i++) {
+        int d = 0;
+        while (block[d] != order[i]) {
+            d++;
+        }
+        for (int c = 0; c < k; c++) {
+            int b = block[gen->next[d * k + c]];
+            if (id[b] < 0) {
+                order[nstates] = b;
+                id[b] = nstates++;
+            }
+        }
+    }
+
+    int* next = (int*)malloc((size_t)nstates * k * sizeof(int));
+    int* accept = (int*)malloc(nstates * sizeof(int));
+    CHECK_MALLOC_PTR(next)
+    CHECK_MALLOC_PTR(accept)
+    for (int i = 0; i < nstates; i++) {
+        int d = 0;
+        while (block[d] != order[i]) {
+            d++;
+        }
+        accept[i] = gen->accept[d];
+        for (int c = 0; c < k; c++) {
+            next[i * k + c] = id[block[gen->next[d * k + c]]];
+        }
+    }
+
+    free(gen->next);
+    free(gen->accept);
+    gen->next = next;
+    gen->accept = accept;
+    gen->ndfa = nstates;
+    free(id);
+    free(order);
+    free(renumber);
+    free(block);
+}
+
+/*
+ * SPEC PARSING
+ */
+
+/**
+ * @brief Token types that may be used as actions
+ */
+static const char* token_types[] = { "ID", "DECLIT", "HEXLIT", "STRLIT", "KEY", "SYM" };
+
+/**
+ * @brief Set the lexeme kind and token type of a rule from its action
+ */
+static void parse_action (Rule* rule, const char* action)
+{
+    rule->type = "ID";
+    rule->word = false;
+    if (strcmp(action, "skip") == 0) {
+        rule->kind = "LEX_BLANK";
+    } else if (strcmp(action, "newline") == 0) {
+        rule->kind = "LEX_NEWLINE";
+    } else if (strcmp(action, "comment") == 0) {
+        rule->kind = "LEX_COMMENT";
+    } else if (strcmp(action, "error") == 0) {
+        rule->kind = "LEX_INVALID";
+    } else if (strcmp(action, "word") == 0) {
+        rule->kind = "LEX_TOKEN";
+        rule->word = true;
+    } else {
+        rule->kind = "LEX_TOKEN";
+        for (size_t i = 0; i < sizeof(token_types) / sizeof(token_types[0]); i++) {
+            if (strcmp(action, token_types[i]) == 0) {
+                rule->type = token_types[i];
+                return;
+            }
+        }
+        fail("unknown action '%s'", action);
+    }
+}
+
+/**
+ * @brief Read the rules of a spec and compile their patterns
+ *
+ * @returns Start state of the combined NFA
+ */
+static int read_spec (Generator* gen, FILE* in)
+{
+    char line[1024];
+    int start = Nfa_new_state(gen);
+    int chain = start;
+
+    while (fgets(line, sizeof(line), in) != NULL) {
+        spec_line++;
+        size_t length = strlen(line);
+        if (length + 1 == sizeof(line) && line[length - 1] != '\n') {
+            fail("line too long");
+        }
+        while (length > 0 && isspace((unsigned char)line[length - 1])) {
+            line[--length] = '\0';
+        }
+        char* p = line;
+        while (isspace((unsigned char)*p)) {
+            p++;
+        }
+        if (*p == '\0' || *p == '#') {
+            continue;
+        }
+
+        if (gen->nrules == MAX_RULES) {
+            fail("too many rules (at most %d)", MAX_RULES);
+        }
+        Rule* rule = &gen->rules[gen->nrules];
+        char action[32];
+        int used = 0;
+        if (sscanf(p, "%63s %d %31s %n", rule->name, &rule->priority, action, &used) != 3
+                || p[used] == '\0') {
+            fail("expected 'name priority action pattern'");
+        }
+        parse_action(rule, action);
+        rule->nfa = parse_pattern(gen, p + used);
+
+        /* a pattern matching nothing would make the scanner loop forever */
+        int* stack = (int*)malloc(3 * gen->nnfa * sizeof(int));
+        uint64_t* set = (uint64_t*)calloc(set_words(gen), sizeof(uint64_t));
+        CHECK_MALLOC_PTR(stack)
+        CHECK_MALLOC_PTR(set)
+        closure_add(gen, set, rule->nfa.start, stack);
+        if (set_has(set, rule->nfa.end)) {
+            fail("pattern of rule '%s' matches the empty string", rule->name);
+        }
+        free(set);
+        free(stack);
+
+        gen->nfa[rule->nfa.end].rule = gen->nrules++;
+        int link = Nfa_new_state(gen);
+        Nfa_link(gen, chain, link);
+        Nfa_link(gen, link, rule->nfa.start);
+        chain = link;
+    }
+    if (gen->nrules == 0) {
+        fail("no rules");
+    }
+    return start;
+}
+
+/*
+ * OUTPUT
+ */
+
+/**
+ * @brief Write the generated scanner
+ */
+static void write_scanner (const Generator* gen, FILE* out)
+{
+    bool open[gen->ndfa];
+    for (int d = 0; d < gen->ndfa; d++) {
+        open[d] = false;
+        for (int c = 0; c < gen->nclasses; c++) {
+            open[d] = open[d] || (d != 0 && gen->next[d * gen->nclasses + c] != 0);
+        }
+    }
+    const char* state_type = (gen->ndfa <= 256 ? "uint8_t" : "uint16_t");
+
+    fprintf(out,
+        "/**\n"
+        " * @file lextables.c\n"
+        " * @brief Table-driven scanner generated from %s\n"
+        " *\n"
+        " * Generated by tools/lexgen; do not edit. %d rules, %d states, %d byte\n"
+        " * classes.\n"
+        " */\n"
+        "#include \"scanner.h\"\n\n", spec_name, gen->nrules, gen->ndfa, gen->nclasses);
+
+    fprintf(out,
+        "/**\n"
+        " * @brief Dead state (no rule can match any longer)\n"
+        " */\n"
+        "#define LEXTAB_DEAD 0\n\n"
+        "/**\n"
+        " * @brief Start state\n"
+        " */\n"
+        "#define LEXTAB_START 1\n\n");
+
+    fprintf(out,
+        "/**\n"
+        " * @brief Action of a rule\n"
+        " */\n"
+        "typedef struct LexTableRule\n"
+        "{\n"
+        "    LexemeKind kind;    /**< @brief Kind of lexeme */\n"
+        "    TokenType type;     /**< @brief Token type (for @c LEX_TOKEN) */\n"
+        "    bool word;          /**< @brief Classify with @ref scan_classify_word */\n"
+        "} LexTableRule;\n\n"
+        "/**\n"
+        " * @brief Rules, in spec order\n"
+        " */\n"
+        "static const LexTableRule lextab_rules[%d] = {\n", gen->nrules);
+    for (int r = 0; r < gen->nrules; r++) {
+        const Rule* rule = &gen->rules[r];
+        char kind[32], type[32];
+        snprintf(kind, sizeof(kind), "%s,", rule->kind);
+        snprintf(type, sizeof(type), "%s,", rule->type);
+        fprintf(out, "    { %-12s %-7s %-5s },  /* %s */\n", kind, type,
+                rule->word ? "true" : "false", rule->name);
+    }
+    fprintf(out, "};\n\n");
+
+    fprintf(out,
+        "/**\n"
+        " * @brief Equivalence class of each byte\n"
+        " */\n"
+        "static const uint8_t lextab_class[256] = {\n");
+    for (int b = 0; b < NBYTES; b++) {
+        fprintf(out, "%s%2d,%s", b % 16 == 0 ? "    " : " ", gen->classes[b],
+                b % 16 == 15 ? "\n" : "");
+    }
+    fprintf(out, "};\n\n");
+
+    fprintf(out,
+        "/**\n"
+        " * @brief Transitions, indexed by state and byte class\n"
+        " */\n"
+        "static const %s lextab_next[%d][%d] = {\n", state_type, gen->ndfa, gen->nclasses);
+    for (int d = 0; d < gen->ndfa; d++) {
+        fprintf(out, "    {");
+        for (int c = 0; c < gen->nclasses; c++) {
+            fprintf(out, "%s%d", c == 0 ? " " : ", ", gen->next[d * gen->nclasses + c]);
+        }
+        fprintf(out, " },\n");
+    }
+    fprintf(out, "};\n\n");
+
+    fprintf(out,
+        "/**\n"
+        " * @brief Rule accepted in each state (-1 if none)\n"
+        " */\n"
+        "static const int8_t lextab_accept[%d] = {\n", gen->ndfa);
+    for (int d = 0; d < gen->ndfa; d++) {
+        fprintf(out, "%s%2d,%s", d % 16 == 0 ? "    " : " ", gen->accept[d],
+                d % 16 == 15 || d == gen->ndfa - 1 ? "\n" : "");
+    }
+    fprintf(out, "};\n\n");
+
+    fprintf(out,
+        "/**\n"
+        " * @brief Whether more input could move each state to a live state\n"
+        " */\n"
+        "static const bool lextab_open[%d] = {\n", gen->ndfa);
+    for (int d = 0; d < gen->ndfa; d++) {
+        fprintf(out, "%s%d,%s", d % 16 == 0 ? "    " : " ", open[d] ? 1 : 0,
+                d % 16 == 15 || d == gen->ndfa - 1 ? "\n" : "");
+    }
+    fprintf(out, "};\n\n");
+
+    fprintf(out,
+        "void scan_table (const char* text, const char* end, Lexeme* lexeme)\n"
+        "{\n"
+        "    const uint8_t* p = (const uint8_t*)text;\n"
+        "    const uint8_t* stop = (const uint8_t*)end;\n"
+        "    const uint8_t* last = p;\n"
+        "    int state = LEXTAB_START;\n"
+        "    int rule = -1;\n"
+        "\n"
+        "    /* longest match: run until the dead state, remembering the last accept */\n"
+        "    while (p < stop) {\n"
+        "        int target = lextab_next[state][lextab_class[*p]];\n"
+        "        if (target == LEXTAB_DEAD) {\n"
+        "            break;\n"
+        "        }\n"
+        "        state = target;\n"
+        "        p++;\n"
+        "        if (lextab_accept[state] >= 0) {\n"
+        "            rule = lextab_accept[state];\n"
+        "            last = p;\n"
+        "        }\n"
+        "    }\n"
+        "    lexeme->at_end = (p == stop && lextab_open[state]);\n"
+        "\n"
+        "    if (rule < 0) {\n"
+        "        lexeme->kind = LEX_INVALID;\n"
+        "        lexeme->length = 1;\n"
+        "        return;\n"
+        "    }\n"
+        "    lexeme->kind = lextab_rules[rule].kind;\n"
+        "    lexeme->type = lextab_rules[rule].type;\n"
+        "    lexeme->length = (size_t)(last - (const uint8_t*)text);\n"
+        "    if (lextab_rules[rule].word) {\n"
+        "        scan_classify_word(text, lexeme);\n"
+        "    }\n"
+        "}\n");
+}
+
+static void usage (const char* name)
+{
+    fprintf(stderr, "Usage: %s <spec> <output.c>\n", name);
+}
+
+int main (int argc, char** argv)
+{
+    if (argc != 3) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    spec_name = argv[1];
+    FILE* in = fopen(spec_name, "r");
+    if (in == NULL) {
+        perror(spec_name);
+        return EXIT_FAILURE;
+    }
+    Generator* gen = (Generator*)calloc(1, sizeof(Generator));
+    CHECK_MALLOC_PTR(gen)
+    int start = read_spec(gen, in);
+    fclose(in);
+
+    compute_classes(gen);
+    build_dfa(gen, start);
+    minimize_dfa(gen);
+
+    /* write to a temporary file so a failed run never leaves a partial scanner */
+    char temp[4096];
+    snprintf(temp, sizeof(temp), "%s.tmp", argv[2]);
+    FILE* out = fopen(temp, "w");
+    if (out == NULL) {
+        perror(temp);
+        return EXIT_FAILURE;
+    }
+    write_scanner(gen, out);
+    if (fclose(out) != 0 || rename(temp, argv[2]) != 0) {
+        perror(argv[2]);
+        remove(temp);
+        return EXIT_FAILURE;
+    }
+
+    free(gen->accept);
+    free(gen->next);
+    free(gen->nfa);
+    free(gen);
+    return EXIT_SUCCESS;
+}